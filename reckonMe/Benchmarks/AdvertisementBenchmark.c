@@ -0,0 +1,282 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * Micro-benchmark of the Bluetooth LE position advertisement codec
+ * (Classes/PositionAdvertisement.c) against the former format, two big-endian
+ * float64 coordinates and a float32 deviation in 28 base64 characters.
+ *
+ * Random positions on the Mercator grid are encoded and decoded with both.
+ * For each it prints the time per advertisement, the length on air and the
+ * worst round trip error. The former format is reimplemented in plain C here,
+ * in the app it additionally went through NSData and a projection per decode.
+ *
+ * It is a host tool, not part of the app. Build and run from this directory:
+ *
+ *   cc -O2 -I../Classes -o AdvertisementBenchmark AdvertisementBenchmark.c ../Classes/PositionAdvertisement.c -lm
+ *   ./AdvertisementBenchmark
+ */
+
+#include "PositionAdvertisement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define MIN_SECONDS 0.2     /* minimum timed duration per measurement */
+#define POSITIONS   4096
+#define MERCATOR_RADIUS 6378137.0
+#define MERCATOR_EXTENT 20037508.0  /* meters, half the side of the grid */
+
+#define LEGACY_LENGTH 20
+#define LEGACY_ENCODED_LENGTH 28
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static double now(void) {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* generic base64 with padding, as NSData does it */
+static void base64Encode(const uint8_t *bytes, size_t length, char *text) {
+
+    size_t i;
+
+    for (i = 0; i + 2 < length; i += 3, text += 4) {
+
+        uint32_t group = (uint32_t) bytes[i] << 16 | (uint32_t) bytes[i + 1] << 8 | bytes[i + 2];
+
+        text[0] = alphabet[group >> 18];
+        text[1] = alphabet[(group >> 12) & 0x3f];
+        text[2] = alphabet[(group >> 6) & 0x3f];
+        text[3] = alphabet[group & 0x3f];
+    }
+    if (i < length) {
+
+        uint32_t group = (uint32_t) bytes[i] << 16 | (i + 1 < length ? (uint32_t) bytes[i + 1] << 8 : 0);
+
+        text[0] = alphabet[group >> 18];
+        text[1] = alphabet[(group >> 12) & 0x3f];
+        text[2] = i + 1 < length ? alphabet[(group >> 6) & 0x3f] : '=';
+        text[3] = '=';
+        text += 4;
+    }
+    *text = '\0';
+}
+
+static size_t base64Decode(const char *text, uint8_t *bytes) {
+
+    size_t length = 0;
+    uint32_t group = 0;
+    int bits = 0;
+
+    for (; *text != '\0' && *text != '='; text++) {
+
+        const char *position = strchr(alphabet, *text);
+
+        group = group << 6 | (uint32_t) (position - alphabet);
+        bits += 6;
+        if (bits >= 8) {
+
+            bits -= 8;
+            bytes[length++] = (uint8_t) (group >> bits);
+        }
+    }
+    return length;
+}
+
+static void putBigEndian(uint8_t *bytes, uint64_t value, int length) {
+
+    int i;
+
+    for (i = length - 1; i >= 0; i--, value >>= 8) bytes[i] = (uint8_t) value;
+}
+
+static uint64_t getBigEndian(const uint8_t *bytes, int length) {
+
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; i < length; i++) value = value << 8 | bytes[i];
+    return value;
+}
+
+/* the former toBase64Encoding, latitude and longitude of the absolute position */
+static void legacyEncode(const PositionAdvertisement *p, char *text) {
+
+    uint8_t bytes[LEGACY_LENGTH];
+    double latitude = (2 * atan(exp(p->northing / MERCATOR_RADIUS)) - M_PI_2) * 180 / M_PI;
+    double longitude = p->easting / MERCATOR_RADIUS * 180 / M_PI;
+    float deviation = (float) p->deviation;
+    uint64_t bits;
+    uint32_t floatBits;
+
+    memcpy(&bits, &latitude, sizeof(bits));
+    putBigEndian(bytes, bits, 8);
+    memcpy(&bits, &longitude, sizeof(bits));
+    putBigEndian(bytes + 8, bits, 8);
+    memcpy(&floatBits, &deviation, sizeof(floatBits));
+    putBigEndian(bytes + 16, floatBits, 4);
+
+    base64Encode(bytes, LEGACY_LENGTH, text);
+}
+
+/* the former initWithBase64String:, which projected the coordinates back */
+static void legacyDecode(const char *text, PositionAdvertisement *p) {
+
+    uint8_t bytes[LEGACY_LENGTH + 2];
+    double latitude, longitude;
+    uint64_t bits;
+    uint32_t floatBits;
+    float deviation;
+
+    base64Decode(text, bytes);
+
+    bits = getBigEndian(bytes, 8);
+    memcpy(&latitude, &bits, sizeof(bits));
+    bits = getBigEndian(bytes + 8, 8);
+    memcpy(&longitude, &bits, sizeof(bits));
+    floatBits = (uint32_t) getBigEndian(bytes + 16, 4);
+    memcpy(&deviation, &floatBits, sizeof(floatBits));
+
+    p->easting = longitude * M_PI / 180 * MERCATOR_RADIUS;
+    p->northing = log(tan(M_PI_4 + latitude * M_PI / 360)) * MERCATOR_RADIUS;
+    p->deviation = deviation;
+}
+
+static void randomPositions(PositionAdvertisement *positions) {
+
+    int i;
+
+    srand(12345);
+    for (i = 0; i < POSITIONS; i++) {
+
+        positions[i].flags = 0;
+        positions[i].session = 0x1234;
+        positions[i].sequence = (uint16_t) i;
+        positions[i].easting = MERCATOR_EXTENT * (2.0 * rand() / RAND_MAX - 1);
+        positions[i].northing = MERCATOR_EXTENT * (2.0 * rand() / RAND_MAX - 1);
+        positions[i].deviation = 100.0 * rand() / RAND_MAX;
+    }
+}
+
+static double maxError(const PositionAdvertisement *a, const PositionAdvertisement *b, double *deviationError) {
+
+    double error = 0;
+    int i;
+
+    *deviationError = 0;
+    for (i = 0; i < POSITIONS; i++) {
+
+        double distance = hypot(a[i].easting - b[i].easting, a[i].northing - b[i].northing);
+
+        if (distance > error) error = distance;
+        if (fabs(a[i].deviation - b[i].deviation) > *deviationError) *deviationError = fabs(a[i].deviation - b[i].deviation);
+    }
+    return error;
+}
+
+int main(void) {
+
+    PositionAdvertisement *positions = malloc(POSITIONS * sizeof(PositionAdvertisement));
+    PositionAdvertisement *decoded = malloc(POSITIONS * sizeof(PositionAdvertisement));
+    char (*texts)[LEGACY_ENCODED_LENGTH + 1] = malloc(POSITIONS * sizeof(*texts));
+    double start, elapsed, error, deviationError;
+    long rounds;
+    int i, failures = 0;
+
+    if (positions == NULL || decoded == NULL || texts == NULL) return 1;
+    randomPositions(positions);
+
+    //former format
+    rounds = 0;
+    start = now();
+    do {
+        for (i = 0; i < POSITIONS; i++) legacyEncode(&positions[i], texts[i]);
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    printf("legacy   %2zu chars  encode %6.1f ns", strlen(texts[0]), elapsed / (rounds * POSITIONS) * 1e9);
+
+    rounds = 0;
+    start = now();
+    do {
+        for (i = 0; i < POSITIONS; i++) legacyDecode(texts[i], &decoded[i]);
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    error = maxError(positions, decoded, &deviationError);
+    printf("  decode %6.1f ns  max error %.2g m, deviation %.2g m\n",
+           elapsed / (rounds * POSITIONS) * 1e9, error, deviationError);
+
+    //compact format
+    rounds = 0;
+    start = now();
+    do {
+        for (i = 0; i < POSITIONS; i++) PositionAdvertisementEncode(&positions[i], texts[i]);
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    printf("compact  %2zu chars  encode %6.1f ns", strlen(texts[0]), elapsed / (rounds * POSITIONS) * 1e9);
+
+    rounds = 0;
+    start = now();
+    do {
+        for (i = 0; i < POSITIONS; i++) {
+
+            if (!PositionAdvertisementDecode(texts[i], kPositionAdvertisementEncodedLength, &decoded[i])) failures++;
+        }
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    error = maxError(positions, decoded, &deviationError);
+    printf("  decode %6.1f ns  max error %.2g m, deviation %.2g m\n",
+           elapsed / (rounds * POSITIONS) * 1e9, error, deviationError);
+
+    for (i = 0; i < POSITIONS; i++) {
+
+        if (decoded[i].sequence != positions[i].sequence || decoded[i].session != positions[i].session
+            || decoded[i].deviation < positions[i].deviation) failures++;
+    }
+    if (!PositionAdvertisementIsNewer(0, 0xffff) || PositionAdvertisementIsNewer(0xffff, 0)) failures++;
+
+    free(positions);
+    free(decoded);
+    free(texts);
+
+    if (failures > 0) {
+
+        printf("%d advertisements were not decoded correctly\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * Host check of the batch geodetic/geocentric conversions of
+ * Pods/proj4/proj/src/geocent.c against the scalar functions they replace
+ * in pj_transform.c.
+ *
+ * Random points are mixed with the special cases the batch functions hand
+ * over to the scalar ones or have to reject: HUGE_VAL, poles, latitudes
+ * slightly and far out of range, huge longitudes, NaN and infinities. The
+ * conversions run both into separate arrays and in place. Results must agree
+ * within a few ulps, the error codes of both must match.
+ *
+ * It is a host tool, not part of the app. Build and run from this directory,
+ * preferably also with -fsanitize=address,undefined:
+ *
+ *   cc -O2 -Wall -Wextra -I../Pods/proj4/proj/src -o GeocentCheck GeocentCheck.c ../Pods/proj4/proj/src/geocent.c -lm
+ *   ./GeocentCheck
+ *
+ * It exits with 1 if any check fails.
+ */
+
+#include "geocent.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define POINTS      1000    /* not a multiple of the batch size */
+#define ROUNDS      20
+#define WGS84_A     6378137.0
+#define WGS84_B     6356752.314245
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static int failures = 0;
+
+static double uniform(double low, double high) {
+
+    return low + (high - low) * (rand() / (double) RAND_MAX);
+}
+
+//equal bits, both NaN, or within tolerance
+static int same(double expected, double actual, double tolerance) {
+
+    if (isnan(expected) || isnan(actual))
+        return isnan(expected) && isnan(actual);
+    if (isinf(expected) || isinf(actual))
+        return expected == actual;
+    return fabs(expected - actual) <= tolerance;
+}
+
+static void fail(const char *what, long i, double a, double b, double c, double expected, double actual) {
+
+    if (failures++ < 20)
+        printf("FAILED %s at %ld (%.17g, %.17g, %.17g): expected %.17g, got %.17g\n",
+               what, i, a, b, c, expected, actual);
+}
+
+static const double specialLatitudes[] = {
+    M_PI / 2, -M_PI / 2, 1.0005 * M_PI / 2, -1.0005 * M_PI / 2, 1.01 * M_PI / 2,
+    2.0, -3.0, HUGE_VAL, -HUGE_VAL, NAN, 0.0, -0.0
+};
+
+static const double specialLongitudes[] = {
+    HUGE_VAL, -HUGE_VAL, NAN, M_PI, -M_PI, 1.5 * M_PI, 10.0, -10.0,
+    1.0e6, -1.0e6, 1.0e6 + 1, 1.0e7, -1.0e9, 1.0e300, 0.0
+};
+
+#define COUNT(array) (long) (sizeof(array) / sizeof(array[0]))
+
+static void fillGeodetic(double *lat, double *lon, double *hgt) {
+
+    long i;
+
+    for (i = 0; i < POINTS; i++) {
+
+        lat[i] = uniform(-M_PI / 2, M_PI / 2);
+        lon[i] = uniform(-M_PI, M_PI);
+        hgt[i] = uniform(-500, 9000);
+
+        //every few points a special latitude or longitude, or both
+        if (rand() % 4 == 0)
+            lat[i] = specialLatitudes[rand() % COUNT(specialLatitudes)];
+        if (rand() % 4 == 0)
+            lon[i] = specialLongitudes[rand() % COUNT(specialLongitudes)];
+        if (rand() % 50 == 0)
+            hgt[i] = NAN;
+    }
+}
+
+static void fillGeocentric(GeocentricInfo *gi, double *x, double *y, double *z) {
+
+    static const double special[] = { 0.0, -0.0, 1.0e-3, 1.0e9, HUGE_VAL, -HUGE_VAL, NAN };
+    long i;
+
+    for (i = 0; i < POINTS; i++) {
+
+        pj_Convert_Geodetic_To_Geocentric(gi, uniform(-M_PI / 2, M_PI / 2), uniform(-M_PI, M_PI),
+                                          uniform(-500, 9000), x + i, y + i, z + i);
+
+        //poles, the center of the earth, far away and invalid points
+        if (rand() % 4 == 0)
+            x[i] = special[rand() % COUNT(special)];
+        if (rand() % 4 == 0)
+            y[i] = special[rand() % COUNT(special)];
+        if (rand() % 8 == 0)
+            z[i] = special[rand() % COUNT(special)];
+    }
+}
+
+static void checkGeodeticToGeocentric(GeocentricInfo *gi, int inPlace) {
+
+    double lat[POINTS], lon[POINTS], hgt[POINTS];
+    double x[POINTS], y[POINTS], z[POINTS];
+    double ex[POINTS], ey[POINTS], ez[POINTS];
+    long i, expectedError = 0, error;
+
+    fillGeodetic(lat, lon, hgt);
+
+    //as the scalar loop of pj_geodetic_to_geocentric_gi()
+    for (i = 0; i < POINTS; i++) {
+
+        ex[i] = lon[i];
+        ey[i] = lat[i];
+        ez[i] = hgt[i];
+        if (lon[i] == HUGE_VAL)
+            continue;
+        if (pj_Convert_Geodetic_To_Geocentric(gi, lat[i], lon[i], hgt[i], ex + i, ey + i, ez + i) != 0) {
+            expectedError |= GEOCENT_LAT_ERROR;
+            ex[i] = ey[i] = HUGE_VAL;
+        }
+    }
+
+    //the batch function leaves skipped points untouched, pj_transform passes x, y, z in place
+    memcpy(x, lon, sizeof(x));
+    memcpy(y, lat, sizeof(y));
+    memcpy(z, hgt, sizeof(z));
+    if (inPlace)
+        error = pj_Convert_Geodetic_To_Geocentric_Batch(gi, POINTS, y, x, z, x, y, z);
+    else
+        error = pj_Convert_Geodetic_To_Geocentric_Batch(gi, POINTS, lat, lon, hgt, x, y, z);
+
+    if (error != expectedError)
+        fail("geodetic to geocentric error code", -1, 0, 0, 0, expectedError, error);
+
+    for (i = 0; i < POINTS; i++) {
+
+        //a few ulps of the earth radius
+        double tolerance = 4.0e-9 + (isfinite(hgt[i]) ? 4.0e-16 * fabs(hgt[i]) : 0.0);
+
+        if (!same(ex[i], x[i], tolerance))
+            fail("geocentric x", i, lat[i], lon[i], hgt[i], ex[i], x[i]);
+        if (!same(ey[i], y[i], tolerance))
+            fail("geocentric y", i, lat[i], lon[i], hgt[i], ey[i], y[i]);
+        if (!same(ez[i], z[i], tolerance))
+            fail("geocentric z", i, lat[i], lon[i], hgt[i], ez[i], z[i]);
+    }
+}
+
+static void checkGeocentricToGeodetic(GeocentricInfo *gi, int inPlace) {
+
+    double x[POINTS], y[POINTS], z[POINTS];
+    double lat[POINTS], lon[POINTS], hgt[POINTS];
+    double elat[POINTS], elon[POINTS], ehgt[POINTS];
+    long i;
+
+    fillGeocentric(gi, x, y, z);
+
+    //as the scalar loop of pj_geocentric_to_geodetic_gi()
+    for (i = 0; i < POINTS; i++) {
+
+        elat[i] = y[i];
+        elon[i] = x[i];
+        ehgt[i] = z[i];
+        if (x[i] == HUGE_VAL)
+            continue;
+        pj_Convert_Geocentric_To_Geodetic(gi, x[i], y[i], z[i], elat + i, elon + i, ehgt + i);
+    }
+
+    memcpy(lon, x, sizeof(lon));
+    memcpy(lat, y, sizeof(lat));
+    memcpy(hgt, z, sizeof(hgt));
+    if (inPlace)
+        pj_Convert_Geocentric_To_Geodetic_Batch(gi, POINTS, lon, lat, hgt, lat, lon, hgt);
+    else
+        pj_Convert_Geocentric_To_Geodetic_Batch(gi, POINTS, x, y, z, lat, lon, hgt);
+
+    for (i = 0; i < POINTS; i++) {
+
+        if (!same(elat[i], lat[i], 4.0e-16))
+            fail("geodetic latitude", i, x[i], y[i], z[i], elat[i], lat[i]);
+        if (!same(elon[i], lon[i], 4.0e-16))
+            fail("geodetic longitude", i, x[i], y[i], z[i], elon[i], lon[i]);
+        if (!same(ehgt[i], hgt[i], 4.0e-9))
+            fail("geodetic height", i, x[i], y[i], z[i], ehgt[i], hgt[i]);
+    }
+}
+
+int main(void) {
+
+    GeocentricInfo gi;
+    int round;
+
+    if (pj_Set_Geocentric_Parameters(&gi, WGS84_A, WGS84_B) != 0) {
+        printf("pj_Set_Geocentric_Parameters failed\n");
+        return 1;
+    }
+
+    srand(42);
+    for (round = 0; round < ROUNDS; round++) {
+
+        checkGeodeticToGeocentric(&gi, round & 1);
+        checkGeocentricToGeodetic(&gi, round & 1);
+    }
+
+    printf(failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
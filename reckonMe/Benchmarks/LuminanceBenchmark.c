@@ -0,0 +1,187 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met:
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer.
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution.
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * Micro-benchmark of computeLuminanceStatistics() (Classes/LuminanceStatistics.c),
+ * the brightness check of PantsPocketDetector, against the former two-pass
+ * implementation that also ran over the row padding.
+ *
+ * Synthetic Y planes of common capture sizes, with padded rows, are analysed
+ * at several subsampling steps. For each it prints the time per frame and
+ * the difference in mean and standard deviation to an exact reference.
+ *
+ * It is a host tool, not part of the app. Build and run from this directory:
+ *
+ *   cc -O2 -I../Classes -o LuminanceBenchmark LuminanceBenchmark.c ../Classes/LuminanceStatistics.c -lm
+ *   ./LuminanceBenchmark
+ */
+
+#include "LuminanceStatistics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <time.h>
+
+#define MIN_SECONDS 0.2     /* minimum timed duration per measurement */
+#define ROW_ALIGNMENT 64    /* capture buffers pad their rows to this */
+
+typedef struct {
+    const char *name;
+    size_t width, height;
+} FrameSize;
+
+static double now(void) {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* a dim, noisy frame, like the inside of a pocket */
+static void fillFrame(uint8_t *plane, size_t width, size_t height, size_t bytesPerRow) {
+
+    size_t x, y;
+    unsigned int seed = 12345;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < bytesPerRow; x++) {
+
+            seed = seed * 1103515245 + 12345;
+            plane[y * bytesPerRow + x] = x < width ? (uint8_t) (10 + x / 64 + ((seed >> 16) & 15)) : 0xff;
+        }
+    }
+}
+
+/* the former implementation from PantsPocketDetector's captureOutput: */
+static LuminanceStatistics twoPass(const uint8_t *plane, size_t height, size_t bytesPerRow) {
+
+    LuminanceStatistics statistics;
+    double luminanceSum = 0, sumOfSquaredDifferences = 0, averageLuminance;
+    size_t totalBytes = height * bytesPerRow, i;
+
+    for (i = 0; i < totalBytes; i++) {
+
+        luminanceSum += plane[i];
+    }
+    averageLuminance = luminanceSum / totalBytes;
+
+    for (i = 0; i < totalBytes; i++) {
+
+        double difference = (plane[i] - averageLuminance) / UCHAR_MAX;
+        sumOfSquaredDifferences += difference * difference;
+    }
+
+    statistics.mean = averageLuminance / UCHAR_MAX;
+    statistics.standardDeviation = sqrt(sumOfSquaredDifferences / (totalBytes - 1));
+    statistics.samples = totalBytes;
+    return statistics;
+}
+
+/* exact statistics of the visible pixels */
+static LuminanceStatistics reference(const uint8_t *plane, size_t width, size_t height, size_t bytesPerRow) {
+
+    LuminanceStatistics statistics;
+    long double sum = 0, squares = 0, mean;
+    size_t x, y, n = width * height;
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            sum += plane[y * bytesPerRow + x];
+    mean = sum / n;
+
+    for (y = 0; y < height; y++)
+        for (x = 0; x < width; x++)
+            squares += (plane[y * bytesPerRow + x] - mean) * (plane[y * bytesPerRow + x] - mean);
+
+    statistics.mean = (double) (mean / UCHAR_MAX);
+    statistics.standardDeviation = (double) (sqrtl(squares / (n - 1)) / UCHAR_MAX);
+    statistics.samples = n;
+    return statistics;
+}
+
+int main(void) {
+
+    const FrameSize sizes[] = {
+        { "352x288",   352,  288 },
+        { "640x480",   640,  480 },
+        { "1280x720",  1280, 720 },
+        { "1920x1080", 1920, 1080 }
+    };
+    const size_t steps[] = { 1, 2, 4, 8 };
+    volatile double sink = 0;
+    size_t s, k;
+
+    printf("%-10s %-10s %12s %12s %12s\n", "frame", "method", "us/frame", "mean error", "sd error");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+
+        size_t width = sizes[s].width, height = sizes[s].height;
+        size_t bytesPerRow = (width + 8 + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+        uint8_t *plane = malloc(height * bytesPerRow);
+        LuminanceStatistics exact, result;
+        long rounds;
+        double start, elapsed;
+
+        if (plane == NULL) return 1;
+        fillFrame(plane, width, height, bytesPerRow);
+        exact = reference(plane, width, height, bytesPerRow);
+
+        rounds = 0;
+        start = now();
+        do {
+            result = twoPass(plane, height, bytesPerRow);
+            sink += result.mean;
+            rounds++;
+            elapsed = now() - start;
+        } while (elapsed < MIN_SECONDS);
+        printf("%-10s %-10s %12.1f %12.2e %12.2e\n", sizes[s].name, "two pass", elapsed / rounds * 1e6,
+               fabs(result.mean - exact.mean), fabs(result.standardDeviation - exact.standardDeviation));
+
+        for (k = 0; k < sizeof(steps) / sizeof(steps[0]); k++) {
+
+            char method[16];
+
+            rounds = 0;
+            start = now();
+            do {
+                result = computeLuminanceStatistics(plane, width, height, bytesPerRow, steps[k]);
+                sink += result.mean;
+                rounds++;
+                elapsed = now() - start;
+            } while (elapsed < MIN_SECONDS);
+
+            snprintf(method, sizeof(method), "step %zu", steps[k]);
+            printf("%-10s %-10s %12.1f %12.2e %12.2e\n", sizes[s].name, method, elapsed / rounds * 1e6,
+                   fabs(result.mean - exact.mean), fabs(result.standardDeviation - exact.standardDeviation));
+        }
+        free(plane);
+    }
+    return sink == 0;
+}
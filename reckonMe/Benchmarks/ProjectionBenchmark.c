@@ -0,0 +1,312 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met:
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer.
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution.
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * Throughput benchmark for all projections in the vendored proj4 (pj_list.h).
+ *
+ * Every projection is instantiated around a common origin and run over two
+ * lattices of points: a "global" one spanning most of the world and a "local"
+ * one of about 1 km around the origin, the scale of an indoor trace. For each
+ * it measures forward and inverse points per second and the round trip error
+ * in meters, and writes one CSV line per projection and lattice.
+ *
+ * It is a host tool, not part of the app. Build and run from this directory:
+ *
+ *   cc -O2 -Wall -Wextra -I../Pods/proj4/proj/src -c ProjectionBenchmark.c
+ *   cc -O2 -I../Pods/proj4/proj/src -o ProjectionBenchmark ProjectionBenchmark.o \
+ *      $(find ../Pods/proj4/proj/src -name '*.c' ! -name jniproj.c) -lm -lpthread
+ *   ./ProjectionBenchmark [results.csv]
+ *
+ * Results go to ProjectionBenchmark.csv unless another file is given.
+ */
+
+#include <projects.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+/* origin of all projections and center of the local lattice */
+#define ORIGIN_LAT 45.0
+#define ORIGIN_LON 10.0
+
+#define LATTICE_SIDE    100     /* points along each axis */
+#define GLOBAL_LON_SPAN 300.0   /* degrees */
+#define GLOBAL_LAT_SPAN 140.0
+#define LOCAL_SPAN      0.01    /* degrees, about 1 km */
+
+#define MIN_SECONDS     0.1     /* minimum timed duration per measurement */
+#define WATCHDOG_SECONDS 10     /* some inverse iterations never converge off their domain */
+#define EARTH_RADIUS    6371000.0
+
+/* parameters every projection gets, those it doesn't use are ignored */
+static const char *commonParameters =
+    "+ellps=WGS84 +lat_0=45 +lon_0=10 +lat_1=30 +lat_2=60 +lat_ts=45 "
+    "+h=3000000 +zone=32 +no_defs";
+
+/* additional parameters for projections that need more than the above,
+ * they come first in the definition and thereby take precedence */
+static const struct {
+    const char *id;
+    const char *parameters;
+} extraParameters[] = {
+    { "ob_tran", "+o_proj=merc +o_lat_p=40 +o_lon_p=0" },
+    { "lsat",    "+lsat=2 +path=2" },
+    { "tpeqd",   "+lat_1=40 +lon_1=0 +lat_2=50 +lon_2=20" },
+    { "chamb",   "+lat_1=40 +lon_1=0 +lat_2=50 +lon_2=20 +lat_3=45 +lon_3=10" },
+    { "ocea",    "+alpha=30 +lonc=10" },
+    { "omerc",   "+alpha=30 +lonc=10" },
+    { "tpers",   "+tilt=10 +azi=20" },
+    { "geos",    "+h=35785831 +lat_0=0" },
+    { "labrd",   "+azi=19 +k_0=0.9995" },
+    { "lagrng",  "+W=2" },
+    { "oea",     "+m=1 +n=2" },
+    { "gn_sinu", "+m=1 +n=2" },
+    { "urm5",    "+n=0.5 +q=1 +alpha=30" },
+    { "urmfps",  "+n=0.5" },
+    { NULL,      NULL }
+};
+
+typedef struct {
+    const char *name;
+    double      lonCenter, latCenter;
+    double      lonSpan, latSpan;
+} Lattice;
+
+typedef struct {
+    double forwardRate;     /* points per second */
+    double inverseRate;
+    long   forwardFailures;
+    long   inverseFailures;
+    double maxError;        /* round trip, meters */
+    double rmsError;
+} Measurement;
+
+static sigjmp_buf watchdog;
+
+static void watchdogFired(int signal) {
+
+    (void) signal;
+    siglongjmp(watchdog, 1);
+}
+
+static double now(void) {
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static PJ *createProjection(const char *id) {
+
+    char definition[512];
+    const char *extra = "";
+    int i;
+    PJ *projection;
+
+    for (i = 0; extraParameters[i].id != NULL; i++) {
+
+        if (strcmp(extraParameters[i].id, id) == 0) {
+
+            extra = extraParameters[i].parameters;
+        }
+    }
+
+    snprintf(definition, sizeof(definition), "+proj=%s %s %s", id, extra, commonParameters);
+    projection = pj_init_plus(definition);
+
+    if (projection == NULL) {
+
+        //some projections are only defined on the sphere
+        snprintf(definition, sizeof(definition), "+proj=%s %s %s +R=6371000", id, extra, commonParameters);
+        projection = pj_init_plus(definition);
+    }
+    return projection;
+}
+
+static void fillLattice(const Lattice *lattice, LP *points) {
+
+    int i, j;
+
+    for (i = 0; i < LATTICE_SIDE; i++) {
+        for (j = 0; j < LATTICE_SIDE; j++) {
+
+            LP *p = points + i * LATTICE_SIDE + j;
+
+            p->u = (lattice->lonCenter + lattice->lonSpan * ((j + 0.5) / LATTICE_SIDE - 0.5)) * DEG_TO_RAD;
+            p->v = (lattice->latCenter + lattice->latSpan * ((i + 0.5) / LATTICE_SIDE - 0.5)) * DEG_TO_RAD;
+        }
+    }
+}
+
+static void measure(PJ *projection, const LP *points, XY *projected, LP *unprojected, Measurement *m) {
+
+    const int count = LATTICE_SIDE * LATTICE_SIDE;
+    long rounds, i;
+    double start, elapsed, sumSquares = 0;
+    int valid = 0;
+
+    memset(m, 0, sizeof(Measurement));
+
+    //forward, repeated until the timing is meaningful
+    rounds = 0;
+    start = now();
+    do {
+        for (i = 0; i < count; i++) {
+
+            projected[i] = pj_fwd(points[i], projection);
+        }
+        rounds++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    m->forwardRate = rounds * count / elapsed;
+
+    for (i = 0; i < count; i++) {
+
+        if (projected[i].u == HUGE_VAL) m->forwardFailures++;
+    }
+
+    //inverse of whatever the forward pass produced
+    if (projection->inv != NULL) {
+
+        rounds = 0;
+        start = now();
+        do {
+            for (i = 0; i < count; i++) {
+
+                unprojected[i] = pj_inv(projected[i], projection);
+            }
+            rounds++;
+            elapsed = now() - start;
+        } while (elapsed < MIN_SECONDS);
+        m->inverseRate = rounds * count / elapsed;
+    }
+
+    //round trip error as distance on the sphere
+    m->maxError = m->rmsError = NAN;
+    if (projection->inv == NULL) return;
+
+    m->maxError = 0;
+    for (i = 0; i < count; i++) {
+
+        double dLat, dLon, error;
+
+        if (projected[i].u == HUGE_VAL) continue;
+        if (unprojected[i].u == HUGE_VAL) {
+
+            m->inverseFailures++;
+            continue;
+        }
+        dLon = remainder(unprojected[i].u - points[i].u, 2 * M_PI) * cos(points[i].v);
+        dLat = unprojected[i].v - points[i].v;
+        error = EARTH_RADIUS * sqrt(dLon * dLon + dLat * dLat);
+
+        if (error > m->maxError || isnan(error)) m->maxError = error;
+        sumSquares += error * error;
+        valid++;
+    }
+    m->rmsError = valid > 0 ? sqrt(sumSquares / valid) : NAN;
+}
+
+int main(int argc, char **argv) {
+
+    const Lattice lattices[] = {
+        { "global", ORIGIN_LON, 0.0, GLOBAL_LON_SPAN, GLOBAL_LAT_SPAN },
+        { "local", ORIGIN_LON, ORIGIN_LAT, LOCAL_SPAN, LOCAL_SPAN }
+    };
+    const int count = LATTICE_SIDE * LATTICE_SIDE;
+    const char *outputName = argc > 1 ? argv[1] : "ProjectionBenchmark.csv";
+    struct PJ_LIST *list = pj_get_list_ref();
+    LP *points = malloc(count * sizeof(LP));
+    LP *unprojected = malloc(count * sizeof(LP));
+    XY *projected = malloc(count * sizeof(XY));
+    FILE *output = fopen(outputName, "w");
+    int i, l, failed = 0;
+
+    if (output == NULL || points == NULL || unprojected == NULL || projected == NULL) {
+
+        fprintf(stderr, "Unable to set up %s.\n", outputName);
+        return 1;
+    }
+
+    signal(SIGALRM, watchdogFired);
+    fprintf(output, "projection,lattice,forward_points_per_s,inverse_points_per_s,"
+                    "forward_failures,inverse_failures,max_roundtrip_m,rms_roundtrip_m\n");
+
+    for (i = 0; list[i].id != NULL; i++) {
+
+        //volatile, it is read again after the watchdog jumped back
+        PJ * volatile projection = createProjection(list[i].id);
+
+        if (projection == NULL) {
+
+            fprintf(stderr, "%-10s init failed: %s\n", list[i].id,
+                    pj_strerrno(pj_ctx_get_errno(pj_get_default_ctx())));
+            fprintf(output, "%s,,,,,,,\n", list[i].id);
+            failed++;
+            continue;
+        }
+
+        for (l = 0; l < 2; l++) {
+
+            Measurement m;
+
+            fillLattice(&lattices[l], points);
+
+            if (sigsetjmp(watchdog, 1) != 0) {
+
+                fprintf(stderr, "%-10s %-6s timed out\n", list[i].id, lattices[l].name);
+                fprintf(output, "%s,%s,,,,,,\n", list[i].id, lattices[l].name);
+                continue;
+            }
+            alarm(WATCHDOG_SECONDS);
+            measure(projection, points, projected, unprojected, &m);
+            alarm(0);
+
+            fprintf(output, "%s,%s,%.0f,%.0f,%ld,%ld,%.3g,%.3g\n",
+                    list[i].id, lattices[l].name, m.forwardRate, m.inverseRate,
+                    m.forwardFailures, m.inverseFailures, m.maxError, m.rmsError);
+            printf("%-10s %-6s fwd %10.0f/s  inv %10.0f/s  fail %5ld/%-5ld  max %.3g m\n",
+                   list[i].id, lattices[l].name, m.forwardRate, m.inverseRate,
+                   m.forwardFailures, m.inverseFailures, m.maxError);
+        }
+        pj_free(projection);
+    }
+
+    fclose(output);
+    free(points);
+    free(unprojected);
+    free(projected);
+
+    printf("%d projections could not be set up, results in %s\n", failed, outputName);
+    return 0;
+}
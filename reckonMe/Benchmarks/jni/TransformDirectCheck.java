@@ -0,0 +1,218 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+/*
+ * Host check of PJ.transformDirect() in Pods/proj4/proj/src/jniproj.c, the
+ * zero-copy transformation of a direct buffer, against the array based
+ * PJ.transform().
+ *
+ * For several pairs of definitions, among them one that can not be cloned
+ * and is transformed under the global lock, it compares the results of both
+ * bit for bit, also with several threads transforming disjoint ranges of the
+ * same buffer. It then checks that bad arguments and failing points throw,
+ * and that a failing point does not leave an error on the shared source.
+ *
+ * It is a host tool, not part of the app. Build and run on Linux with a
+ * stock JDK from this directory:
+ *
+ *   cc -shared -fPIC -O2 -DJNI_ENABLED -I"$JAVA_HOME/include" -I"$JAVA_HOME/include/linux" \
+ *      -I../../Pods/proj4/proj/src -o libproj.so $(find ../../Pods/proj4/proj/src -name '*.c') -lm -lpthread
+ *   javac org/proj4/*.java TransformDirectCheck.java
+ *   java -Djava.library.path=. TransformDirectCheck
+ *
+ * It exits with 1 if any check fails.
+ */
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.DoubleBuffer;
+import org.proj4.PJ;
+import org.proj4.PJException;
+
+public class TransformDirectCheck {
+
+    private static final int DIMENSION = 3;
+    private static final int POINTS = 100000;
+    private static final int THREADS = 4;
+
+    private static final String[][] PAIRS = {
+        { "+proj=latlong +datum=WGS84", "+proj=utm +zone=32 +datum=WGS84" },
+        { "+proj=latlong +ellps=bessel +towgs84=598.1,73.7,418.2,0.202,0.045,-2.455,6.7", "+proj=geocent +datum=WGS84" },
+        { "+proj=latlong +datum=WGS84", "+proj=ob_tran +o_proj=merc +o_lat_p=40 +o_lon_p=0 +ellps=WGS84" },
+        { "+proj=merc +a=6378137 +b=6378137 +nadgrids=@null", "+proj=latlong +datum=WGS84" }
+    };
+
+    private static int failures = 0;
+
+    private static void check(boolean condition, String message) {
+        if (!condition) {
+            System.out.println("FAILED: " + message);
+            failures++;
+        }
+    }
+
+    private static double[] points(boolean projected) {
+        double[] coordinates = new double[POINTS * DIMENSION];
+        for (int i = 0; i < POINTS; i++) {
+            double longitude = 5 + 10.0 * i / POINTS;
+            double latitude = 40 + 15.0 * ((i * 7919L) % POINTS) / POINTS;
+            coordinates[i * DIMENSION] = projected ? longitude * 111000 : longitude;
+            coordinates[i * DIMENSION + 1] = projected ? latitude * 111000 : latitude;
+            coordinates[i * DIMENSION + 2] = 100;
+        }
+        return coordinates;
+    }
+
+    private static ByteBuffer directBuffer(double[] coordinates) {
+        ByteBuffer buffer = ByteBuffer.allocateDirect(coordinates.length * 8).order(ByteOrder.nativeOrder());
+        buffer.asDoubleBuffer().put(coordinates);
+        return buffer;
+    }
+
+    private static int differences(double[] expected, ByteBuffer buffer) {
+        DoubleBuffer actual = buffer.asDoubleBuffer();
+        int count = 0;
+        for (int i = 0; i < expected.length; i++) {
+            if (Double.doubleToLongBits(expected[i]) != Double.doubleToLongBits(actual.get(i))) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    private static void comparePair(final PJ source, final PJ target, boolean projected) throws Exception {
+        double[] expected = points(projected);
+        ByteBuffer single = directBuffer(expected);
+        final ByteBuffer shared = directBuffer(expected);
+
+        source.transform(target, DIMENSION, expected, 0, POINTS);
+        source.transformDirect(target, DIMENSION, single, 0, POINTS);
+        check(differences(expected, single) == 0, source.getDefinition() + ": direct differs from array");
+
+        //disjoint ranges of one buffer from several threads
+        Thread[] threads = new Thread[THREADS];
+        final Throwable[] thrown = new Throwable[THREADS];
+        final int perThread = (POINTS + THREADS - 1) / THREADS;
+        for (int t = 0; t < THREADS; t++) {
+            final int index = t;
+            threads[t] = new Thread() {
+                @Override public void run() {
+                    int first = index * perThread;
+                    int count = Math.min(perThread, POINTS - first);
+                    try {
+                        source.transformDirect(target, DIMENSION, shared, first * DIMENSION, count);
+                    } catch (Throwable e) {
+                        thrown[index] = e;
+                    }
+                }
+            };
+            threads[t].start();
+        }
+        for (int t = 0; t < THREADS; t++) {
+            threads[t].join();
+            check(thrown[t] == null, "thread " + t + " threw " + thrown[t]);
+        }
+        check(differences(expected, shared) == 0, source.getDefinition() + ": concurrent direct differs from array");
+    }
+
+    private static void expectThrow(Class<?> expected, Runnable call, String message) {
+        try {
+            call.run();
+            check(false, message + ": nothing thrown");
+        } catch (Throwable e) {
+            Throwable cause = (e instanceof WrappedException) ? e.getCause() : e;
+            check(expected.isInstance(cause), message + ": threw " + cause);
+        }
+    }
+
+    private static class WrappedException extends RuntimeException {
+        private static final long serialVersionUID = 1L;
+        WrappedException(Exception cause) {
+            super(cause);
+        }
+    }
+
+    private static void checkErrors() {
+        final PJ source = new PJ("+proj=latlong +datum=WGS84");
+        final PJ target = new PJ("+proj=utm +zone=32 +datum=WGS84");
+        final ByteBuffer small = directBuffer(new double[10]);
+
+        expectThrow(IndexOutOfBoundsException.class, new Runnable() {
+            public void run() {
+                try {
+                    source.transformDirect(target, DIMENSION, small, 0, 5);
+                } catch (PJException e) {
+                    throw new WrappedException(e);
+                }
+            }
+        }, "too many points");
+
+        expectThrow(IllegalArgumentException.class, new Runnable() {
+            public void run() {
+                ByteBuffer misaligned = ((ByteBuffer) small.duplicate().position(4)).slice().order(ByteOrder.nativeOrder());
+                try {
+                    source.transformDirect(target, DIMENSION, misaligned, 0, 1);
+                } catch (PJException e) {
+                    throw new WrappedException(e);
+                }
+            }
+        }, "misaligned buffer");
+
+        expectThrow(IllegalArgumentException.class, new Runnable() {
+            public void run() {
+                try {
+                    source.transformDirect(target, DIMENSION, ByteBuffer.allocate(80), 0, 1);
+                } catch (PJException e) {
+                    throw new WrappedException(e);
+                }
+            }
+        }, "heap buffer");
+
+        expectThrow(PJException.class, new Runnable() {
+            public void run() {
+                try {
+                    source.transformDirect(target, DIMENSION, directBuffer(new double[] {10, 100, 0}), 0, 1);
+                } catch (PJException e) {
+                    throw new WrappedException(e);
+                }
+            }
+        }, "latitude out of range");
+        check(source.getLastError() == null, "the failing point left an error on the source: " + source.getLastError());
+    }
+
+    public static void main(String[] args) throws Exception {
+        System.out.println("Proj.4 " + PJ.getVersion());
+
+        for (String[] pair : PAIRS) {
+            comparePair(new PJ(pair[0]), new PJ(pair[1]), pair[0].contains("merc"));
+        }
+        checkErrors();
+
+        System.out.println(failures == 0 ? "all checks passed" : failures + " checks failed");
+        System.exit(failures == 0 ? 0 : 1);
+    }
+}
@@ -0,0 +1,88 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+package org.proj4;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Minimal counterpart of the org.proj4.PJ class of the Proj.4 Java bindings,
+ * declaring the native methods of Pods/proj4/proj/src/jniproj.c with the
+ * signatures of org_proj4_PJ.h. Only meant for exercising the native code
+ * on a host, see TransformDirectCheck.java.
+ */
+public class PJ {
+
+    public static enum Type {
+        GEOGRAPHIC, GEOCENTRIC, PROJECTED
+    }
+
+    static {
+        System.loadLibrary("proj");
+    }
+
+    /* read by jniproj.c through the "ptr" field */
+    private final long ptr;
+
+    public PJ(final String definition) throws IllegalArgumentException {
+        ptr = allocatePJ(definition);
+        if (ptr == 0) {
+            throw new IllegalArgumentException(definition);
+        }
+    }
+
+    public PJ(final PJ projected) throws IllegalArgumentException {
+        ptr = allocateGeoPJ(projected);
+        if (ptr == 0) {
+            throw new IllegalArgumentException(String.valueOf(projected));
+        }
+    }
+
+    private static native long allocatePJ(String definition);
+    private static native long allocateGeoPJ(PJ projected);
+
+    public static native String getVersion();
+    public native String getDefinition();
+    public native Type getType();
+    public native double getSemiMajorAxis();
+    public native double getSemiMinorAxis();
+    public native double getEccentricitySquared();
+    public native char[] getAxisDirections();
+    public native double getGreenwichLongitude();
+    public native double getLinearUnitToMetre(boolean vertical);
+
+    public native void transform(PJ target, int dimension, double[] coordinates, int offset, int numPts)
+            throws PJException;
+
+    /* coordinates must be a direct buffer in native byte order, offset is counted in doubles */
+    public native void transformDirect(PJ target, int dimension, ByteBuffer coordinates, int offset, int numPts)
+            throws PJException;
+
+    public native String getLastError();
+    @Override public native String toString();
+    @Override protected final native void finalize();
+}
@@ -27,19 +27,51 @@
 
 #import <Foundation/Foundation.h>
 #import "PDRExchange.h"
+#import "SensorClock.h"
+
+
+//a listener together with the implementations of the SensorListener methods
+//it responds to, NULL for those it doesn't
+typedef struct {
+    
+    id<SensorListener> listener;
+    IMP didReceiveDeviceMotionBatch;
+    IMP didReceiveGPSvalue;
+    IMP didReceiveCompassValue;
+    
+} SensorListenerEntry;
+
+//immutable snapshot of the listeners, replaced as a whole on every change
+typedef struct SensorListenerList {
+    
+    NSUInteger count;
+    struct SensorListenerList *nextRetired;
+    SensorListenerEntry entries[];
+    
+} SensorListenerList;
+
+//signatures of the cached implementations, called as imp(listener, selector, arguments...)
+typedef void (*DeviceMotionBatchIMP)(id, SEL, const DeviceMotionSample *, NSUInteger);
+typedef void (*GPSvalueIMP)(id, SEL, double, double, double, double, double, double, double, NSTimeInterval, int);
+typedef void (*CompassValueIMP)(id, SEL, double, double, double, double, double, double, NSTimeInterval, int);
 
 
 @interface AbstractSensor : NSObject {
 	
-    /* Using NSMutableSet is a naive implementation for managing the listeners.
-     * Performance could be gained by fetching the methods addresses from the runtime
-     * and making a C-function call instead of Objective-C messaging.
-     */
+    //the set of listeners, only used when adding/removing them
 	NSMutableSet *listeners;
-    //a mutex to make sure "listeners" isn't changed while being enumerated
+    //a mutex serializing the changes to "listeners" and "listenerList"
     dispatch_semaphore_t listenersSemaphore;
     
-	NSDate *beginningOfEpoch;
+    /* What the sensors iterate when delivering values. Readers never lock:
+     * they announce themselves in dispatchingReaders and use the snapshot
+     * current at that time. Replaced snapshots are retired and freed by a
+     * later change once no reader is left.
+     */
+    SensorListenerList * volatile listenerList;
+    SensorListenerList *retiredListenerLists;
+    volatile int32_t dispatchingReaders;
+    
     BOOL isAvailable;
     BOOL isActive;
 
@@ -55,8 +87,14 @@
 -(void)removeListener:(id<SensorListener>)listener;
 -(void)removeAllListeners;
 
+//the current time in the sensors' time base, see SensorClock.h
 -(NSTimeInterval)getTimestamp;
 
+//wait-free access to the current listeners for delivering values from any thread,
+//every call to beginListenerDispatch has to be matched by endListenerDispatch
+-(const SensorListenerList *)beginListenerDispatch;
+-(void)endListenerDispatch;
+
 //to be implemented by subclasses:
 //raises an exception if called
 - (void) actuallyStart;
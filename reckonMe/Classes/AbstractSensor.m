@@ -26,6 +26,39 @@
 **/
 
 #import "AbstractSensor.h"
+#import <libkern/OSAtomic.h>
+
+
+//anonymous category extending the class with "private" methods
+@interface AbstractSensor ()
+
+-(void)publishListenerList;
+-(void)adaptToListenerCount;
+-(void)performOnMainThread:(dispatch_block_t)block;
+
+@end
+
+
+static IMP implementationIfResponding(id<SensorListener> listener, SEL selector) {
+    
+    NSObject *object = (NSObject *)listener;
+    return [object respondsToSelector:selector] ? [object methodForSelector:selector] : NULL;
+}
+
+static void freeListenerList(SensorListenerList *list) {
+    
+    while (list != NULL) {
+        
+        SensorListenerList *next = list->nextRetired;
+        
+        for (NSUInteger i = 0; i < list->count; i++) {
+            
+            [list->entries[i].listener release];
+        }
+        free(list);
+        list = next;
+    }
+}
 
 
 @implementation AbstractSensor
@@ -42,7 +75,11 @@
         listeners = [[NSMutableSet alloc] initWithCapacity:3];
         listenersSemaphore = dispatch_semaphore_create(1);
         
-        beginningOfEpoch = [[NSDate alloc] initWithTimeIntervalSince1970:0.0];
+        listenerList = NULL;
+        retiredListenerLists = NULL;
+        dispatchingReaders = 0;
+        [self publishListenerList];
+        
         isActive = NO;
         isAvailable = NO;
         shouldRestartIfListenersAvailable = NO;
@@ -54,117 +91,156 @@
 -(void)dealloc {
     
 	[listeners release];
-	[beginningOfEpoch release];
+    freeListenerList(listenerList);
+    freeListenerList(retiredListenerLists);
     dispatch_release(listenersSemaphore);
 	[super dealloc];
 }
 
--(void)addListener:(id <SensorListener>)listener {
+//replaces the snapshot readers iterate, to be called holding listenersSemaphore
+-(void)publishListenerList {
     
-    /*
-     * Perform the operation now if the call comes from the main thread,
-     * schedule it there otherwise.
-     * This allows sensor subclasses working on the main thread to ommit using the listenersSemaphore.
-     */
-    if ([NSThread isMainThread]) {
-        
-        //mutex to allow listener adding/removing while sensors are running
-        dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+    SensorListenerList *list = malloc(sizeof(SensorListenerList) + [listeners count] * sizeof(SensorListenerEntry));
+    list->count = 0;
+    list->nextRetired = NULL;
+    
+    id<SensorListener> listener;
+    for (listener in listeners) {
         
-            [listeners addObject:listener];
-            NSUInteger listenerCount = [listeners count];
-    	
-        dispatch_semaphore_signal(listenersSemaphore);
+        SensorListenerEntry *entry = &list->entries[list->count++];
         
+        entry->listener = [(NSObject *)listener retain];
+        entry->didReceiveDeviceMotionBatch = implementationIfResponding(listener, @selector(didReceiveDeviceMotionBatch:count:));
+        entry->didReceiveGPSvalue = implementationIfResponding(listener, @selector(didReceiveGPSvalueWithLongitude:latitude:altitude:speed:course:horizontalAccuracy:verticalAccuracy:timestamp:label:));
+        entry->didReceiveCompassValue = implementationIfResponding(listener, @selector(didReceiveCompassValueWithMagneticHeading:trueHeading:headingAccuracy:X:Y:Z:timestamp:label:));
+    }
+    
+    SensorListenerList *previous = listenerList;
+    
+    //the snapshot has to be complete before a reader may pick it up
+    OSMemoryBarrier();
+    listenerList = list;
+    
+    if (previous != NULL) {
         
-        if (shouldRestartIfListenersAvailable && (listenerCount > 0)) {
-            
-            [self actuallyStart];
-            shouldRestartIfListenersAvailable = NO;
-            NSLog(@"(Re)started %@ because %@ has been added.", NSStringFromClass([self class]), NSStringFromClass([(NSObject *)listener class]));
-        }
+        previous->nextRetired = retiredListenerLists;
+        retiredListenerLists = previous;
+    }
     
-    } else {
+    //Readers announce themselves before loading the snapshot, so one arriving
+    //after this barrier gets the new one. Without readers, nobody can still
+    //be using a retired snapshot.
+    OSMemoryBarrier();
+    if (dispatchingReaders == 0) {
         
-        //block the calling thread and call from the main thread
-        dispatch_sync(dispatch_get_main_queue(), ^(void) {
-            
-            [self addListener:listener];
-        });
+        freeListenerList(retiredListenerLists);
+        retiredListenerLists = NULL;
     }
 }
 
--(void)removeListener:(id<SensorListener>)listener {
+-(const SensorListenerList *)beginListenerDispatch {
+    
+    OSAtomicIncrement32Barrier(&dispatchingReaders);
+    return listenerList;
+}
+
+-(void)endListenerDispatch {
+    
+    OSAtomicDecrement32Barrier(&dispatchingReaders);
+}
+
+-(void)performOnMainThread:(dispatch_block_t)block {
     
-    /*
-     * Perform the operation now if the call comes from the main thread,
-     * schedule it there otherwise.
-     * This allows sensor subclasses working on the main thread to ommit using the listenersSemaphore.
-     */
     if ([NSThread isMainThread]) {
         
-        dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
-        
-            [listeners removeObject:listener];
-            NSUInteger listenerCount = [listeners count];
+        block();
         
-        dispatch_semaphore_signal(listenersSemaphore);
-        
-        
-        //we use the inActive property here, allowing subclasses to override it
-        if (listenerCount == 0 && self.isActive) {
-            
-            shouldRestartIfListenersAvailable = YES;
-            [self actuallyStop];
-            NSLog(@"Stopped %@ because nobody is listening.", NSStringFromClass([self class]));
-        }   
-    
     } else {
         
-        dispatch_sync(dispatch_get_main_queue(), ^(void) {
-            
-            [self removeListener:listener];
-        });
+        dispatch_async(dispatch_get_main_queue(), block);
     }
 }
 
--(void)removeAllListeners {
+//starts or stops the sensor depending on whether anybody is listening, main thread only
+-(void)adaptToListenerCount {
     
-    /*
-     * Perform the operation now if the call comes from the main thread,
-     * schedule it there otherwise.
-     * This allows sensor subclasses working on the main thread to ommit using the listenersSemaphore.
-     */
-    if ([NSThread isMainThread]) {
+    dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+    
+        NSUInteger listenerCount = [listeners count];
+    
+    dispatch_semaphore_signal(listenersSemaphore);
+    
+    
+    if (shouldRestartIfListenersAvailable && (listenerCount > 0)) {
         
-        dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+        [self actuallyStart];
+        shouldRestartIfListenersAvailable = NO;
+        NSLog(@"(Re)started %@ because a listener has been added.", NSStringFromClass([self class]));
         
-            [listeners removeAllObjects];
+    //we use the isActive property here, allowing subclasses to override it
+    } else if (listenerCount == 0 && self.isActive) {
         
-        dispatch_semaphore_signal(listenersSemaphore);
+        shouldRestartIfListenersAvailable = YES;
+        [self actuallyStop];
+        NSLog(@"Stopped %@ because nobody is listening.", NSStringFromClass([self class]));
+    }
+}
+
+/*
+ * Listeners can be added and removed from any thread without blocking on the
+ * main thread. Only starting and stopping the sensor is left to the main thread,
+ * immediately if the call comes from there, later otherwise.
+ */
+-(void)addListener:(id <SensorListener>)listener {
+    
+    //mutex to allow listener adding/removing while sensors are running
+    dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+    
+        [listeners addObject:listener];
+        [self publishListenerList];
+    
+    dispatch_semaphore_signal(listenersSemaphore);
+    
+    [self performOnMainThread:^(void) {
         
-        //we use the property here, allowing subclasses to override it
-        if (self.isActive) {
-            
-            shouldRestartIfListenersAvailable = YES;
-            [self actuallyStop];
-            NSLog(@"Stopped %@ because nobody is listening.", NSStringFromClass([self class]));
-        }
+        [self adaptToListenerCount];
+    }];
+}
+
+-(void)removeListener:(id<SensorListener>)listener {
     
-    } else {
+    dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+    
+        [listeners removeObject:listener];
+        [self publishListenerList];
+    
+    dispatch_semaphore_signal(listenersSemaphore);
+    
+    [self performOnMainThread:^(void) {
         
-        dispatch_sync(dispatch_get_main_queue(), ^(void) {
-            
-            [self removeAllListeners];
-        });
-    }
+        [self adaptToListenerCount];
+    }];
+}
+
+-(void)removeAllListeners {
+    
+    dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+    
+        [listeners removeAllObjects];
+        [self publishListenerList];
+    
+    dispatch_semaphore_signal(listenersSemaphore);
+    
+    [self performOnMainThread:^(void) {
+        
+        [self adaptToListenerCount];
+    }];
 }
 
 
 -(NSTimeInterval)getTimestamp {
 	
-	NSTimeInterval timestamp = -[beginningOfEpoch timeIntervalSinceNow];
-	return timestamp;
+	return SensorClockNow();
 }
 
 
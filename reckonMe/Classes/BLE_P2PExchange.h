@@ -36,6 +36,8 @@
 #import <CoreBluetooth/CoreBluetooth.h>
 #import "PDRExchange.h"
 
+//All methods may be called from any thread, the work is done on a serial queue of the exchange.
+//The delegate is handed peer positions from that queue, too.
 @interface BLE_P2PExchange : NSObject <CBCentralManagerDelegate, CBPeripheralManagerDelegate>
 
 //values above this threshold lead to an exchange
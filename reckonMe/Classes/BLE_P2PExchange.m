@@ -35,13 +35,66 @@
 #import "BLE_P2PExchange.h"
 #import "AlertSoundPlayer.h"
 #import "Settings.h"
+#import "PositionAdvertisement.h"
+#import "SensorClock.h"
 
 //random UUID generated with uuidgen
 NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
 
+//log levels, messages above kBLELogLevel are not even formatted
+#define kBLELogNone 0
+#define kBLELogInfo 1       //state changes and exchanges
+#define kBLELogVerbose 2    //every advertisement received, dozens per second and peer
+
+#ifndef kBLELogLevel
+#define kBLELogLevel kBLELogInfo
+#endif
+
+#define BLELog(level, ...) do { if ((level) <= kBLELogLevel) NSLog(__VA_ARGS__); } while (0)
+
+//weight of a new RSSI reading in its exponential moving average
+static const double kRSSISmoothing = 0.25;
+//without a reading for this long, the average starts over
+static const NSTimeInterval kRSSIMaxAge = 2;
+//a peer is not considered again for this long after PDRController declined or accepted it
+static const NSTimeInterval kPeerRetryInterval = 0.5;
+//peripheral identifiers rotate, peers not seen for a few kRSSIMaxAge are forgotten
+static const NSTimeInterval kPeerMaxAge = 10;
+
+//what we know about a peer, so repeated advertisements cost a lookup and a string comparison
+@interface BLEPeer : NSObject
+
+@property(nonatomic, copy) NSString *name;
+@property(nonatomic, copy) NSString *lastPayload;
+@property(nonatomic, assign) PositionAdvertisement lastAdvertisement;
+@property(nonatomic, assign) BOOL lastAdvertisementUsed;
+@property(nonatomic, assign) BOOL offerPending;     //handed to the delegate, no answer yet
+
+@property(nonatomic, assign) double smoothedRSSI;
+@property(nonatomic, assign) NSTimeInterval lastSeen;
+@property(nonatomic, assign) NSTimeInterval nextEligible;
+
+@end
+
+@implementation BLEPeer
+
+-(void)dealloc {
+    
+    self.name = nil;
+    self.lastPayload = nil;
+    
+    [super dealloc];
+}
+
+@end
+
 
 //anonymous category extending the class with "private" methods
-@interface BLE_P2PExchange ()
+@interface BLE_P2PExchange () {
+    
+    //CoreBluetooth calls back on this serial queue, all the state below is only touched on it
+    dispatch_queue_t exchangeQueue;
+}
 
 @property(nonatomic, retain) NSArray *services;
 @property(nonatomic, retain) NSString *advertisement;
@@ -51,6 +104,18 @@ NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
 @property(nonatomic, assign) BOOL shouldAdvertise;
 @property(nonatomic, assign) BOOL shouldScan;
 
+//identify our advertisements, see PositionAdvertisement.h
+@property(nonatomic, assign) uint8_t advertisementFlags;
+@property(nonatomic, assign) uint16_t session;
+@property(nonatomic, assign) uint16_t sequence;
+
+//BLEPeer by peripheral identifier
+@property(nonatomic, retain) NSMutableDictionary *peers;
+@property(nonatomic, assign) NSTimeInterval lastPeerPruning;
+
+-(void)encodeAdvertisement;
+-(void)startNewSessionWithFlags:(uint8_t)flags;
+-(void)forgetPeersNotSeenSince:(NSTimeInterval)time;
 -(void)startAdvertising;
 -(void)stopAdvertising;
 -(void)startScanning;
@@ -92,12 +157,16 @@ NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
         
         self.services = @[[CBUUID UUIDWithString:reckonMeUUID]];
         self.advertisement = @"foobar";
+        self.peers = [NSMutableDictionary dictionary];
+        
+        //keep discoveries, which arrive dozens of times per second, away from map rendering
+        exchangeQueue = dispatch_queue_create("BLE exchange queue", DISPATCH_QUEUE_SERIAL);
         
         self.centralManager = [[[CBCentralManager alloc] initWithDelegate:self
-                                                                    queue:nil] autorelease];
+                                                                    queue:exchangeQueue] autorelease];
         
         self.peripheralManager = [[[CBPeripheralManager alloc] initWithDelegate:self
-                                                                          queue:nil] autorelease];
+                                                                          queue:exchangeQueue] autorelease];
         self.rssiThreshold = [Settings sharedInstance].rssi;
     }
     
@@ -109,30 +178,77 @@ NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
     self.delegate = nil;
     self.services = nil;
     self.advertisement = nil;
-    self.advertisedPosition = nil;
+    self.peers = nil;
+    [_advertisedPosition release];
     
     self.centralManager = nil;
     self.peripheralManager = nil;
     
+    dispatch_release(exchangeQueue);
+    
     [super dealloc];
 }
 
 -(void)setAdvertisedPosition:(AbsoluteLocationEntry *)advertisedPosition {
     
-    if (_advertisedPosition != advertisedPosition)
-    {
-        [_advertisedPosition release];
-        _advertisedPosition = advertisedPosition;
-        [_advertisedPosition retain];
-        
-        self.advertisement = [_advertisedPosition toBase64Encoding];
+    dispatch_async(exchangeQueue, ^(void) {
         
-        if (self.shouldAdvertise) {
+        if (_advertisedPosition != advertisedPosition)
+        {
+            [_advertisedPosition release];
+            _advertisedPosition = advertisedPosition;
+            [_advertisedPosition retain];
             
-            [self stopAdvertising];
-            [self startAdvertising];
+            self.sequence++;
+            [self encodeAdvertisement];
+            
+            if (self.shouldAdvertise) {
+                
+                [self stopAdvertising];
+                [self startAdvertising];
+            }
         }
+    });
+}
+
+-(void)encodeAdvertisement {
+    
+    if (!self.advertisedPosition) return;
+    
+    PositionAdvertisement advertisement;
+    char encoded[kPositionAdvertisementEncodedLength + 1];
+    
+    [self.advertisedPosition getAdvertisement:&advertisement];
+    advertisement.flags = self.advertisementFlags;
+    advertisement.session = self.session;
+    advertisement.sequence = self.sequence;
+    
+    PositionAdvertisementEncode(&advertisement, encoded);
+    self.advertisement = [NSString stringWithUTF8String:encoded];
+}
+
+//peers tell a restarted exchange from a stale one by the session
+-(void)startNewSessionWithFlags:(uint8_t)flags {
+    
+    self.advertisementFlags = flags;
+    self.session = arc4random_uniform(UINT16_MAX + 1);
+    self.sequence = 0;
+    
+    [self encodeAdvertisement];
+}
+
+//runs on exchangeQueue, keeps peers the delegate still has to answer for
+-(void)forgetPeersNotSeenSince:(NSTimeInterval)time {
+    
+    NSMutableArray *stale = [NSMutableArray array];
+    
+    for (NSUUID *identifier in self.peers) {
+        
+        BLEPeer *peer = [self.peers objectForKey:identifier];
+        
+        if (peer.lastSeen < time && !peer.offerPending) [stale addObject:identifier];
     }
+    [self.peers removeObjectsForKeys:stale];
 }
 
 //MARK: - start/stop
@@ -161,38 +277,50 @@ NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
 
 -(void)startStationaryBeaconMode {
     
-    self.shouldAdvertise = YES;
-    self.shouldScan = NO;
-    
-    [self startAdvertising];
+    dispatch_async(exchangeQueue, ^(void) {
+        
+        self.shouldAdvertise = YES;
+        self.shouldScan = NO;
+        
+        [self startNewSessionWithFlags:kPositionAdvertisementStationary];
+        [self startAdvertising];
+    });
 }
 
 -(void)startWalkerMode {
     
-    self.shouldAdvertise = YES;
-    self.shouldScan = YES;
-    
-    [self startAdvertising];
-    [self startScanning];
+    dispatch_async(exchangeQueue, ^(void) {
+        
+        self.shouldAdvertise = YES;
+        self.shouldScan = YES;
+        
+        [self startNewSessionWithFlags:0];
+        [self startAdvertising];
+        [self startScanning];
+    });
 }
 
 -(void)stop {
     
-    self.shouldAdvertise = NO;
-    self.shouldScan = NO;
-    
-    [self stopAdvertising];
-    [self stopScanning];
+    dispatch_async(exchangeQueue, ^(void) {
+        
+        self.shouldAdvertise = NO;
+        self.shouldScan = NO;
+        
+        [self stopAdvertising];
+        [self stopScanning];
+        
+        [self.peers removeAllObjects];
+    });
 }
 
 //MARK: - CBCentralManagerDelegate
 - (void)centralManager:(CBCentralManager *)central didDiscoverPeripheral:(CBPeripheral *)peripheral advertisementData:(NSDictionary *)advertisementData RSSI:(NSNumber *)RSSI
 {
     
-    NSLog(@"%@ %@ %@", RSSI, peripheral.name, [advertisementData objectForKey:CBAdvertisementDataLocalNameKey]);
+    BLELog(kBLELogVerbose, @"%@ %@ %@", RSSI, peripheral.name, [advertisementData objectForKey:CBAdvertisementDataLocalNameKey]);
     
     NSInteger signalStrength = [RSSI integerValue];
-    if (signalStrength < self.rssiThreshold) return;
     if (signalStrength == 127) return; //occurs quite often and seems to indicate an invalid value
     
     NSString *advertisedData = [advertisementData objectForKey:CBAdvertisementDataLocalNameKey];
@@ -201,22 +329,103 @@ NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
     NSString *deviceName = peripheral.name;
     if (!deviceName || [deviceName isEqualToString:@""]) return;
     
-    if ([self.delegate shouldConnectToPeerID:deviceName]) {
+    NSTimeInterval now = SensorClockNow();
+    
+    if (now - self.lastPeerPruning > kPeerMaxAge) {
+        
+        [self forgetPeersNotSeenSince:now - kPeerMaxAge];
+        self.lastPeerPruning = now;
+    }
+    
+    BLEPeer *peer = [self.peers objectForKey:peripheral.identifier];
+    
+    if (!peer) {
+        
+        peer = [[BLEPeer alloc] init];
+        [self.peers setObject:peer forKey:peripheral.identifier];
+        [peer release];
+    }
+    
+    //keep one instance of the name, the delegate uses it as a key
+    if (![peer.name isEqualToString:deviceName]) peer.name = deviceName;
+    
+    //single readings fluctuate by several dB, decide on the average
+    if (now - peer.lastSeen > kRSSIMaxAge) {
+        
+        peer.smoothedRSSI = signalStrength;
+    } else {
+        
+        peer.smoothedRSSI += kRSSISmoothing * (signalStrength - peer.smoothedRSSI);
+    }
+    peer.lastSeen = now;
+    
+    if (![advertisedData isEqualToString:peer.lastPayload]) {
+        
+        //base64 is ASCII, so the UTF-8 length equals the string's length
+        PositionAdvertisement advertisement;
+        if (!PositionAdvertisementDecode([advertisedData UTF8String], [advertisedData length], &advertisement)) return;
+        
+        //advertisements of a session may arrive out of order, never go back to an older position
+        if (peer.lastPayload
+            && advertisement.session == peer.lastAdvertisement.session
+            && !PositionAdvertisementIsNewer(advertisement.sequence, peer.lastAdvertisement.sequence)) return;
+        
+        peer.lastPayload = advertisedData;
+        peer.lastAdvertisement = advertisement;
+        peer.lastAdvertisementUsed = NO;
+        
+    } else if (peer.lastAdvertisementUsed
+               && !(peer.lastAdvertisement.flags & kPositionAdvertisementStationary)) {
+        
+        //a walker's position is only fused once, a beacon's stays valid
+        return;
+    }
+    
+    if (peer.offerPending) return;
+    if (now < peer.nextEligible) return;
+    if (peer.smoothedRSSI < self.rssiThreshold) return;
+    
+    PositionAdvertisement advertisement = peer.lastAdvertisement;
+    BOOL isRealDeviceName = ![peer.name isEqualToString:advertisedData];
+    dispatch_queue_t queue = exchangeQueue;
+    
+    //the delegate decides on its own queue, whether it uses the position comes back here
+    BOOL offered = [self.delegate enqueuePeerPosition:&advertisement
+                                               ofPeer:peer.name
+                                           isRealName:isRealDeviceName
+                                             accepted:^(BOOL accepted) {
+                                                 
+                                                 dispatch_async(queue, ^(void) {
+                                                     
+                                                     peer.offerPending = NO;
+                                                     peer.nextEligible = SensorClockNow() + kPeerRetryInterval;
+                                                     
+                                                     if (accepted) BLELog(kBLELogInfo, @"exchange with %@", peer.name);
+                                                     
+                                                     if (accepted
+                                                         && peer.lastAdvertisement.session == advertisement.session
+                                                         && peer.lastAdvertisement.sequence == advertisement.sequence) {
+                                                         
+                                                         peer.lastAdvertisementUsed = YES;
+                                                     }
+                                                 });
+                                             }];
+    
+    if (offered) {
+        
+        BLELog(kBLELogVerbose, @"offered position of %@ at %.1f dBm", peer.name, peer.smoothedRSSI);
+        peer.offerPending = YES;
         
-        AbsoluteLocationEntry *peerPosition = [[AbsoluteLocationEntry alloc] initWithBase64String:advertisedData];
-        BOOL isRealDeviceName = ![deviceName isEqualToString:advertisedData];
+    } else {
         
-        //dispatch async??
-        [self.delegate didReceivePosition:peerPosition
-                                   ofPeer:deviceName
-                               isRealName:isRealDeviceName];
-        [peerPosition release];
+        //the delegate is busy, try again later
+        peer.nextEligible = now + kPeerRetryInterval;
     }
 }
 
 -(void)centralManagerDidUpdateState:(CBCentralManager *)central {
     
-    NSLog(@"CBCentral state: %@", [[[self class] coreBluetoothStateDisplayNames] objectForKey:@(central.state)]);
+    BLELog(kBLELogInfo, @"CBCentral state: %@", [[[self class] coreBluetoothStateDisplayNames] objectForKey:@(central.state)]);
     
     if (central.state == CBCentralManagerStatePoweredOn
         && self.shouldScan) {
@@ -229,7 +438,7 @@ NSString *reckonMeUUID = @"97FD5E48-639B-489F-B2F3-3A99C126512C";
 //MARK: - CBPeripheralManagerDelegate
 -(void)peripheralManagerDidUpdateState:(CBPeripheralManager *)peripheral {
     
-    NSLog(@"CBPeripheral state: %@", [[[self class] coreBluetoothStateDisplayNames] objectForKey:@(peripheral.state)]);
+    BLELog(kBLELogInfo, @"CBPeripheral state: %@", [[[self class] coreBluetoothStateDisplayNames] objectForKey:@(peripheral.state)]);
     
     if (peripheral.state == CBPeripheralManagerStatePoweredOn
         && self.shouldAdvertise) {
@@ -276,55 +276,55 @@ static CompassAndGPS *sharedSingleton;
 - (void)locationManager:(CLLocationManager *)manager didUpdateToLocation:(CLLocation *)newLocation fromLocation:(CLLocation *)oldLocation {
 	
     int label = 0;
-    NSTimeInterval timestamp = [newLocation.timestamp timeIntervalSince1970];
-	id<SensorListener> listener;
+    NSTimeInterval timestamp = SensorClockFromDate(newLocation.timestamp);
+    const SensorListenerList *list = [self beginListenerDispatch];
     
-    /* 
-     * We shouldn't need the semaphore here, as this method is called from the main thread
-     * like the adding/removing listeners methods in our AbstractSensor superclass.
-     */
-    //dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
-    
-    for (listener in listeners) {
+    for (NSUInteger i = 0; i < list->count; i++) {
+        
+        const SensorListenerEntry *entry = &list->entries[i];
         
-        [listener didReceiveGPSvalueWithLongitude:newLocation.coordinate.longitude
-                                         latitude:newLocation.coordinate.latitude
-                                         altitude:newLocation.altitude
-                                            speed:newLocation.speed
-                                           course:newLocation.course
-                               horizontalAccuracy:newLocation.horizontalAccuracy 
-                                 verticalAccuracy:newLocation.verticalAccuracy
-                                        timestamp:timestamp 
-                                            label:label];
+        if (entry->didReceiveGPSvalue == NULL) continue;
+        
+        ((GPSvalueIMP) entry->didReceiveGPSvalue)(entry->listener,
+                                                  @selector(didReceiveGPSvalueWithLongitude:latitude:altitude:speed:course:horizontalAccuracy:verticalAccuracy:timestamp:label:),
+                                                  newLocation.coordinate.longitude,
+                                                  newLocation.coordinate.latitude,
+                                                  newLocation.altitude,
+                                                  newLocation.speed,
+                                                  newLocation.course,
+                                                  newLocation.horizontalAccuracy,
+                                                  newLocation.verticalAccuracy,
+                                                  timestamp,
+                                                  label);
     }
     
-    //dispatch_semaphore_signal(listenersSemaphore);
+    [self endListenerDispatch];
 }
 
 - (void)locationManager:(CLLocationManager *)manager didUpdateHeading:(CLHeading *)newHeading {
     
-    NSTimeInterval timestamp = [newHeading.timestamp timeIntervalSince1970];
-	id<SensorListener> listener;
+    NSTimeInterval timestamp = SensorClockFromDate(newHeading.timestamp);
+    const SensorListenerList *list = [self beginListenerDispatch];
     
-    /* 
-     * We shouldn't need the semaphore here, as this method is called from the main thread
-     * like the adding/removing listeners methods in our AbstractSensor superclass.
-     */
-    //dispatch_semaphore_wait(listenersSemaphore, DISPATCH_TIME_FOREVER);
+    for (NSUInteger i = 0; i < list->count; i++) {
+        
+        const SensorListenerEntry *entry = &list->entries[i];
         
-    for (listener in listeners) {
+        if (entry->didReceiveCompassValue == NULL) continue;
         
-        [listener didReceiveCompassValueWithMagneticHeading:newHeading.magneticHeading
-                                                trueHeading:newHeading.trueHeading
-                                            headingAccuracy:newHeading.headingAccuracy
-                                                          X:newHeading.x
-                                                          Y:newHeading.y
-                                                          Z:newHeading.z
-                                                  timestamp:timestamp
-                                                      label:0];
+        ((CompassValueIMP) entry->didReceiveCompassValue)(entry->listener,
+                                                          @selector(didReceiveCompassValueWithMagneticHeading:trueHeading:headingAccuracy:X:Y:Z:timestamp:label:),
+                                                          newHeading.magneticHeading,
+                                                          newHeading.trueHeading,
+                                                          newHeading.headingAccuracy,
+                                                          newHeading.x,
+                                                          newHeading.y,
+                                                          newHeading.z,
+                                                          timestamp,
+                                                          0);
     }
     
-    //dispatch_semaphore_signal(listenersSemaphore);
+    [self endListenerDispatch];
 }
 
 
@@ -36,10 +36,17 @@
 {
     
     PDRController *pdr;
-    PantsPocketDetector *pocketDetector;
+    NSObject<PocketDetector> *pocketDetector;
     
     NSMutableArray *path;//the path since the last start of PDR, necessary to preserve the state between memory warnings
     
+    //updates from PDRController not yet drawn, guarded by @synchronized(pendingPositions)
+    NSMutableArray *pendingPositions;
+    NSArray *pendingPath;
+    AbsoluteLocationEntry *pendingLastPosition;
+    AbsoluteLocationEntry *pendingAdvertisedPosition;
+    BOOL pendingUpdateScheduled;
+    
     BOOL mapFollowsPosition;
     BOOL mapFollowsHeading;
     BOOL pdrOn;
@@ -30,6 +30,8 @@
 #import "CompassAndGPS.h"
 #import "BLE_P2PExchange.h"
 #import "Gyroscope.h"
+#import "SensorClock.h"
+#import "MotionPocketDetector.h"
 #import "AlertSoundPlayer.h"
 #import "OutdoorMapView.h"
 #import "Settings.h"
@@ -115,6 +117,10 @@ typedef enum {
 
 -(void)correctPositionTo:(AbsoluteLocationEntry *)correctTo;
 
+-(void)schedulePendingUpdate;
+-(void)drawPendingUpdate;
+-(void)discardPendingUpdate;
+
 -(void)releaseSubviews;
 
 @end
@@ -177,6 +183,7 @@ typedef enum {
     self.testing = YES;
     
     path = [[NSMutableArray alloc] initWithCapacity:kInitialPathCapacity];
+    pendingPositions = [[NSMutableArray alloc] init];
     
     //CLLocationCoordinate2D passau = CLLocationCoordinate2DMake(48.565720, 13.450176);
     AbsoluteLocationEntry *passauLocation = [[AbsoluteLocationEntry alloc] initWithTimestamp:0
@@ -189,8 +196,8 @@ typedef enum {
     pdr = [PDRController sharedInstance];
     pdr.view = self;
     
-    pocketDetector = [[PantsPocketDetector alloc] init];
-    pocketDetector.delegate = self;
+    //created when first started, depending on the settings
+    pocketDetector = nil;
     
     [Gyroscope sharedInstance].frequency = 50;
     
@@ -214,6 +221,8 @@ typedef enum {
     [self releaseSubviews];
     
     [path release];
+    [self discardPendingUpdate];
+    [pendingPositions release];
     self.lastGPSfix = nil;
     self.lastPosition = nil;
     
@@ -586,7 +595,17 @@ typedef enum {
 }
 
 -(void)startPocketDetector {
+    
+    //the choice might have changed in the settings since the last time
+    Class detectorClass = [Settings sharedInstance].cameraPocketDetection ? [PantsPocketDetector class] : [MotionPocketDetector class];
+    
+    if (![pocketDetector isMemberOfClass:detectorClass]) {
         
+        [pocketDetector stop];
+        [pocketDetector release];
+        pocketDetector = [[detectorClass alloc] init];
+        pocketDetector.delegate = self;
+    }
     [pocketDetector start];
 }
 
@@ -740,7 +759,7 @@ typedef enum {
 #warning Test if setting the timestamp only incapacitates the unit tests or also a live session
     if (!self.testing) {
         
-        self.lastPosition.timestamp = [[NSDate date] timeIntervalSince1970];
+        self.lastPosition.timestamp = SensorClockNow();
     }
     
     [self correctPositionTo:self.lastPosition];
@@ -933,6 +952,7 @@ typedef enum {
         //update the toolbar items
         [self.toolbar setItems:self.toolbarItemsWhenPDRoff animated:YES];
         
+        [self discardPendingUpdate];
         [path removeAllObjects];
         
         //allow auto-lock again
@@ -1001,24 +1021,37 @@ typedef enum {
     [mapView updateGPSposition:self.lastGPSfix];
 }
 
--(void)didReceiveDeviceMotion:(CMDeviceMotion *)motion timestamp:(NSTimeInterval)timestamp {
+-(void)didReceiveDeviceMotionBatch:(const DeviceMotionSample *)samples count:(NSUInteger)count {
+    
+    if (count == 0) return;
     
-    if (self.status == HeadingCorrectionMode){
+    //only the latest attitude matters for the view
+    double yaw = samples[count - 1].yaw;
+    
+    dispatch_async(dispatch_get_main_queue(), ^(void) {
         
-        if (yawOffset == 0) {
+        if (self.status == HeadingCorrectionMode){
             
-            yawOffset = motion.attitude.yaw;
+            if (yawOffset == 0) {
+                
+                yawOffset = yaw;
+            }
+            lastYaw = yaw - yawOffset;
+            [self.mapView rotatePathViewBy:lastYaw];
         }
-        lastYaw = motion.attitude.yaw - yawOffset;
-        [self.mapView rotatePathViewBy:lastYaw];
-    }
+    });
 }
 
+//PDRController reports from its own queue, several times per step while exchanging.
+//The reports are collected and drawn at once by a single block on the main queue.
 - (void)didReceivePosition:(AbsoluteLocationEntry *)position isResultOfExchange:(BOOL)fromExchange {
     
-    dispatch_async(dispatch_get_main_queue(), ^(void) {
+    @synchronized(pendingPositions) {
+        
+        [pendingPositions addObject:position];
         
-        self.lastPosition = position;
+        [pendingLastPosition release];
+        pendingLastPosition = [position retain];
         
         /* Postpone the advertisement of new position stemming from an exchange 
          * in order to give the other peer an opportunity to pick up the "old" position.
@@ -1026,48 +1059,139 @@ typedef enum {
          */
         if (!fromExchange) {
             
-            [BLE_P2PExchange sharedInstance].advertisedPosition = self.lastPosition;
+            [pendingAdvertisedPosition release];
+            pendingAdvertisedPosition = [position retain];
         }
         
-        //update path
-        [path addObject:position];
-        [mapView addPathLineTo:position];
+        [self schedulePendingUpdate];
+    }
+}
+
+- (void)didReceivePeerPosition:(AbsoluteLocationEntry *)position ofPeer:(NSString *)peerName isRealName:(BOOL)isRealName {
+    
+    dispatch_async(dispatch_get_main_queue(), ^(void) {
+        
+        [self.mapView addExchangeWithPeerAtPosition:position
+                                           peerName:isRealName ? peerName : @"Another User"];
+        
+        if (isRealName) {
+            
+            [AlertSoundPlayer.sharedInstance say:[NSString stringWithFormat:@"Hello, %@!", peerName]
+                          interruptOngoingSpeech:NO
+                                         vibrate:YES];
+            
+        } else {
+            
+            [AlertSoundPlayer.sharedInstance say:@"Hello!"
+                          interruptOngoingSpeech:NO
+                                         vibrate:YES];
+        }
+    });
+}
+
+- (void)didReceiveCompletePath:(NSArray *)newPath {
+    
+    @synchronized(pendingPositions) {
         
-        self.correctHeadingButton.enabled = [path count] >= 2;
+        //the new path already contains the positions not drawn so far
+        [pendingPositions removeAllObjects];
         
-        [mapView moveMapCenterTo:position];
+        [pendingPath release];
+        pendingPath = [newPath copy];
+        
+        [self schedulePendingUpdate];
+    }
+}
+
+//MARK: - coalescing PDR updates
+
+//call within @synchronized(pendingPositions)
+-(void)schedulePendingUpdate {
+    
+    if (pendingUpdateScheduled) return;
+    
+    pendingUpdateScheduled = YES;
+    dispatch_async(dispatch_get_main_queue(), ^(void) {
         
-        [self.mapView moveCurrentPositionMarkerTo:position];
+        [self drawPendingUpdate];
     });
 }
 
-- (void)didReceivePeerPosition:(AbsoluteLocationEntry *)position ofPeer:(NSString *)peerName isRealName:(BOOL)isRealName {
+-(void)drawPendingUpdate {
     
-    [self.mapView addExchangeWithPeerAtPosition:position
-                                       peerName:isRealName ? peerName : @"Another User"];
+    NSArray *newPath, *positions;
+    AbsoluteLocationEntry *newLastPosition, *advertisedPosition;
     
-    if (isRealName) {
+    @synchronized(pendingPositions) {
         
-        [AlertSoundPlayer.sharedInstance say:[NSString stringWithFormat:@"Hello, %@!", peerName]
-                      interruptOngoingSpeech:NO
-                                     vibrate:YES];
+        newPath = pendingPath;
+        positions = [[NSArray alloc] initWithArray:pendingPositions];
+        newLastPosition = pendingLastPosition;
+        advertisedPosition = pendingAdvertisedPosition;
         
-    } else {
+        pendingPath = nil;
+        pendingLastPosition = nil;
+        pendingAdvertisedPosition = nil;
+        [pendingPositions removeAllObjects];
+        pendingUpdateScheduled = NO;
+    }
+    
+    if (newLastPosition) {
         
-        [AlertSoundPlayer.sharedInstance say:@"Hello!"
-                      interruptOngoingSpeech:NO
-                                     vibrate:YES];
+        self.lastPosition = newLastPosition;
     }
+    
+    if (advertisedPosition) {
+        
+        [BLE_P2PExchange sharedInstance].advertisedPosition = advertisedPosition;
+    }
+    
+    //update path
+    if (newPath) {
+        
+        [path setArray:newPath];
+        [self.mapView replacePathBy:newPath];
+    }
+    
+    for (AbsoluteLocationEntry *position in positions) {
+        
+        [path addObject:position];
+        [mapView addPathLineTo:position];
+    }
+    
+    self.correctHeadingButton.enabled = [path count] >= 2;
+    
+    if (newLastPosition) {
+        
+        [mapView moveMapCenterTo:newLastPosition];
+    }
+    
+    AbsoluteLocationEntry *current = [positions lastObject] ? [positions lastObject] : [newPath lastObject];
+    if (current) {
+        
+        [self.mapView moveCurrentPositionMarkerTo:current];
+    }
+    
+    [newPath release];
+    [positions release];
+    [newLastPosition release];
+    [advertisedPosition release];
 }
 
-- (void)didReceiveCompletePath:(NSArray *)newPath {
+//drops what PDRController reported but was not drawn yet, e.g. when PDR is stopped
+-(void)discardPendingUpdate {
     
-    [path setArray:newPath];
-    [self.mapView replacePathBy:newPath];
-    [self.mapView moveCurrentPositionMarkerTo:[newPath lastObject]];
+    @synchronized(pendingPositions) {
         
-    self.correctHeadingButton.enabled = [newPath count] >= 2;
-
+        [pendingPath release];
+        [pendingLastPosition release];
+        [pendingAdvertisedPosition release];
+        
+        pendingPath = nil;
+        pendingLastPosition = nil;
+        pendingAdvertisedPosition = nil;
+        [pendingPositions removeAllObjects];
+    }
 }
 
 @end
@@ -36,17 +36,30 @@ typedef struct {
 
 } ProjectedPoint;
 
+struct LocalApproximation;
 
 @interface GeodeticProjection : NSObject
 {
     projPJ projection;
     
+    //polynomial fit of the projection around the current session's origin, NULL if none
+    struct LocalApproximation * volatile approximation;
+    //approximations of earlier sessions, freed by a later fit once no conversion is running
+    struct LocalApproximation *retiredApproximations;
+    volatile int32_t convertingReaders;
 }
 
 +(ProjectedPoint)coordinatesToCartesian:(CLLocationCoordinate2D)coordinates;
 +(CLLocationCoordinate2D)cartesianToCoordinates:(ProjectedPoint)cartesian;
 
+//Fits forward and inverse projection around the given point by bivariate polynomials, 
+//which the conversions above use within the fitted area instead of proj4.
+//Call it when a session starts, the fit replaces that of the previous session.
++(void)approximateAroundOrigin:(ProjectedPoint)origin;
+
 //the scale by which the Mercator projection distorts distances around a certain latitude
 +(double)mercatorScaleForLatitude:(double)latitude;
+//the same for a northing in the projection, without inverting it
++(double)mercatorScaleForNorthing:(double)northing;
 
 @end
@@ -25,11 +25,214 @@
 *	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 **/
 
+//needs to come before proj_api.h for the approximation structures
+#import "projects.h"
 #import "GeodeticProjection.h"
-#import "proj_api.h"
+#import <libkern/OSAtomic.h>
 
 NSString const *googleProjection = @"+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +no_defs";
 
+//half the side length of the approximated square around the origin, in meters on the ground
+static const double approximationRadius = 2000;
+//Chebyshev nodes per axis, the fit is truncated to the terms above the resolution
+static const int approximationNodes = 12;
+static const double forwardResolution = 1e-5;   //meters
+static const double inverseResolution = 1e-10;  //degrees
+//the fit is discarded if it deviates more than this from proj4, about 1 mm either way
+static const double maxForwardError = 1e-3;     //meters
+static const double maxInverseError = 1e-8;     //degrees
+//points per axis at which the fit is compared to proj4
+static const int checkPoints = 21;
+
+//Both directions work on offsets from the origin, which keeps the power series well conditioned.
+struct LocalApproximation {
+
+    double longitude, latitude;
+    double easting, northing;
+    
+    //half side lengths of the fitted boxes
+    double longitudeRange, latitudeRange;
+    double eastingRange, northingRange;
+    
+    Tseries *forward;   //degrees -> meters
+    Tseries *inverse;   //meters -> degrees
+    
+    //largest deviation from proj4 over the box, including the truncated terms
+    double forwardError, inverseError;
+    
+    struct LocalApproximation *next;
+};
+typedef struct LocalApproximation LocalApproximation;
+
+//mk_cheby() takes a plain function, so this is the state of the fit in progress
+static PJ *fitProjection;
+static const LocalApproximation *fitApproximation;
+
+static projUV forwardOffset(projUV offset) {
+    
+    projUV lp, xy;
+    lp.u = (fitApproximation->longitude + offset.u) * DEG_TO_RAD;
+    lp.v = (fitApproximation->latitude + offset.v) * DEG_TO_RAD;
+    
+    xy = pj_fwd(lp, fitProjection);
+    
+    if (xy.u != HUGE_VAL) {
+        
+        xy.u -= fitApproximation->easting;
+        xy.v -= fitApproximation->northing;
+    }
+    return xy;
+}
+
+static projUV inverseOffset(projUV offset) {
+    
+    projUV xy, lp;
+    xy.u = fitApproximation->easting + offset.u;
+    xy.v = fitApproximation->northing + offset.v;
+    
+    lp = pj_inv(xy, fitProjection);
+    
+    if (lp.u != HUGE_VAL) {
+        
+        lp.u = lp.u * RAD_TO_DEG - fitApproximation->longitude;
+        lp.v = lp.v * RAD_TO_DEG - fitApproximation->latitude;
+    }
+    return lp;
+}
+
+static void freeSeries(Tseries *series) {
+    
+    int i;
+    
+    if (series == NULL) return;
+    
+    for (i = 0; i <= series->mu; i++) pj_dalloc(series->cu[i].c);
+    for (i = 0; i <= series->mv; i++) pj_dalloc(series->cv[i].c);
+    pj_dalloc(series->cu);
+    pj_dalloc(series->cv);
+    pj_dalloc(series);
+}
+
+static void freeApproximation(LocalApproximation *local) {
+    
+    freeSeries(local->forward);
+    freeSeries(local->inverse);
+    free(local);
+}
+
+//Fits the function over [-range, range] by a power series and sets error to the largest 
+//deviation from it on a lattice, or to HUGE_VAL if no fit within the resolution exists.
+static Tseries *fitSeries(projUV (*function)(projUV), projUV range, double resolution, double *error) {
+    
+    projUV low, high, residual;
+    Tseries *series;
+    int i, j;
+    
+    low.u = -range.u;
+    low.v = -range.v;
+    high = range;
+    
+    series = mk_cheby(low, high, resolution, &residual, function, approximationNodes, approximationNodes, 1);
+    
+    //mk_cheby() flags a residual above the resolution by negating it
+    if (series == NULL || residual.u < 0) {
+        
+        freeSeries(series);
+        *error = HUGE_VAL;
+        return NULL;
+    }
+    
+    *error = MAX(residual.u, residual.v);
+    
+    for (i = 0; i < checkPoints; i++) {
+        for (j = 0; j < checkPoints; j++) {
+            
+            projUV p, exact, approximated;
+            p.u = low.u + (high.u - low.u) * i / (checkPoints - 1);
+            p.v = low.v + (high.v - low.v) * j / (checkPoints - 1);
+            
+            exact = function(p);
+            approximated = bpseval(p, series);
+            
+            if (exact.u == HUGE_VAL) {
+                
+                *error = HUGE_VAL;
+            } else {
+                
+                *error = MAX(*error, fabs(exact.u - approximated.u));
+                *error = MAX(*error, fabs(exact.v - approximated.v));
+            }
+        }
+    }
+    return series;
+}
+
+static LocalApproximation *createApproximation(PJ *projection, ProjectedPoint origin, double radius) {
+    
+    LocalApproximation *local = calloc(1, sizeof(LocalApproximation));
+    projUV xy, lp, range, north, south, east;
+    double scale;
+    
+    if (local == NULL) return NULL;
+    
+    xy.u = origin.easting;
+    xy.v = origin.northing;
+    lp = pj_inv(xy, projection);
+    
+    if (lp.u == HUGE_VAL) {
+        
+        free(local);
+        return NULL;
+    }
+    local->longitude = lp.u * RAD_TO_DEG;
+    local->latitude = lp.v * RAD_TO_DEG;
+    
+    //re-project to have the origin consistent in both directions
+    xy = pj_fwd(lp, projection);
+    local->easting = xy.u;
+    local->northing = xy.v;
+    
+    //the Mercator projection stretches distances by 1/cos(latitude)
+    scale = 1 / cos(lp.v);
+    local->eastingRange = local->northingRange = radius * scale;
+    
+    //the geographic box is the one that fits into the projected box
+    xy.u = local->easting + local->eastingRange;
+    xy.v = local->northing;
+    east = pj_inv(xy, projection);
+    xy.u = local->easting;
+    xy.v = local->northing + local->northingRange;
+    north = pj_inv(xy, projection);
+    xy.v = local->northing - local->northingRange;
+    south = pj_inv(xy, projection);
+    
+    local->longitudeRange = (east.u - lp.u) * RAD_TO_DEG;
+    local->latitudeRange = MIN(north.v - lp.v, lp.v - south.v) * RAD_TO_DEG;
+    
+    fitProjection = projection;
+    fitApproximation = local;
+    
+    range.u = local->longitudeRange;
+    range.v = local->latitudeRange;
+    local->forward = fitSeries(forwardOffset, range, forwardResolution, &local->forwardError);
+    
+    range.u = local->eastingRange;
+    range.v = local->northingRange;
+    local->inverse = fitSeries(inverseOffset, range, inverseResolution, &local->inverseError);
+    
+    fitProjection = NULL;
+    fitApproximation = NULL;
+    
+    if (local->forwardError > maxForwardError || local->inverseError > maxInverseError) {
+        
+        NSLog(@"Unable to approximate the projection around %f, %f (errors %g m, %g deg).", 
+              local->latitude, local->longitude, local->forwardError, local->inverseError);
+        freeApproximation(local);
+        return NULL;
+    }
+    return local;
+}
+
 @implementation GeodeticProjection
 
 
@@ -66,6 +269,18 @@ NSString const *googleProjection = @"+proj=merc +a=6378137 +b=6378137 +lat_ts=0.
 
 -(void)dealloc {
     
+    if (approximation) {
+        
+        freeApproximation(approximation);
+    }
+    
+    while (retiredApproximations) {
+        
+        LocalApproximation *next = retiredApproximations->next;
+        freeApproximation(retiredApproximations);
+        retiredApproximations = next;
+    }
+    
     if (projection) {
         
         pj_free(projection);
@@ -81,13 +296,38 @@ NSString const *googleProjection = @"+proj=merc +a=6378137 +b=6378137 +lat_ts=0.
 
 -(ProjectedPoint)coordinatesToCartesian:(CLLocationCoordinate2D)coordinates {
 
+    ProjectedPoint result_point;
+    BOOL approximated = NO;
+    
+    //announce the reader before loading the fit, which is then not freed before the reader leaves
+    OSAtomicIncrement32Barrier(&convertingReaders);
+    LocalApproximation *local = approximation;
+    
+    if (local) {
+        
+        projUV offset;
+        offset.u = coordinates.longitude - local->longitude;
+        offset.v = coordinates.latitude - local->latitude;
+        
+        if (fabs(offset.u) <= local->longitudeRange && fabs(offset.v) <= local->latitudeRange) {
+            
+            projUV result = bpseval(offset, local->forward);
+            
+            result_point.easting = local->easting + result.u;
+            result_point.northing = local->northing + result.v;
+            approximated = YES;
+        }
+    }
+    OSAtomicDecrement32Barrier(&convertingReaders);
+    
+    if (approximated) return result_point;
+    
     projUV uv;
     uv.u = coordinates.longitude * DEG_TO_RAD;
     uv.v = coordinates.latitude * DEG_TO_RAD;
     
     projUV result = pj_fwd(uv, projection);
     
-    ProjectedPoint result_point;
     result_point.easting = result.u;
     result_point.northing = result.v;
 
@@ -101,13 +341,38 @@ NSString const *googleProjection = @"+proj=merc +a=6378137 +b=6378137 +lat_ts=0.
 
 -(CLLocationCoordinate2D)cartesianToCoordinates:(ProjectedPoint)cartesian {
 
+    CLLocationCoordinate2D result_coordinate;
+    BOOL approximated = NO;
+    
+    //announce the reader before loading the fit, as in coordinatesToCartesian:
+    OSAtomicIncrement32Barrier(&convertingReaders);
+    LocalApproximation *local = approximation;
+    
+    if (local) {
+        
+        projUV offset;
+        offset.u = cartesian.easting - local->easting;
+        offset.v = cartesian.northing - local->northing;
+        
+        if (fabs(offset.u) <= local->eastingRange && fabs(offset.v) <= local->northingRange) {
+            
+            projUV result = bpseval(offset, local->inverse);
+            
+            result_coordinate.longitude = local->longitude + result.u;
+            result_coordinate.latitude = local->latitude + result.v;
+            approximated = YES;
+        }
+    }
+    OSAtomicDecrement32Barrier(&convertingReaders);
+    
+    if (approximated) return result_coordinate;
+    
     projUV uv;
     uv.u = cartesian.easting;
     uv.v = cartesian.northing;
 
     projUV result = pj_inv(uv, projection);
 
-    CLLocationCoordinate2D result_coordinate;
     result_coordinate.longitude = result.u * RAD_TO_DEG;
     result_coordinate.latitude = result.v * RAD_TO_DEG;
 
@@ -116,10 +381,56 @@ NSString const *googleProjection = @"+proj=merc +a=6378137 +b=6378137 +lat_ts=0.
 }
 
 
++(void)approximateAroundOrigin:(ProjectedPoint)origin {
+    
+    [[self sharedInstance] approximateAroundOrigin:origin];
+}
+
+-(void)approximateAroundOrigin:(ProjectedPoint)origin {
+    
+    @synchronized(self) {
+        
+        LocalApproximation *local = createApproximation(projection, origin, approximationRadius);
+        LocalApproximation *previous = approximation;
+        
+        //readers pick up the pointer without locking, so publish the fit only once it is complete
+        OSMemoryBarrier();
+        approximation = local;
+        
+        //conversions running concurrently might still use the previous fit, keep it around
+        if (previous) {
+            
+            previous->next = retiredApproximations;
+            retiredApproximations = previous;
+        }
+        
+        //Readers announce themselves before loading the fit, so one arriving after
+        //this barrier gets the new one. Without readers, nobody can still be using
+        //a retired fit.
+        OSMemoryBarrier();
+        if (convertingReaders == 0) {
+            
+            while (retiredApproximations) {
+                
+                LocalApproximation *next = retiredApproximations->next;
+                freeApproximation(retiredApproximations);
+                retiredApproximations = next;
+            }
+        }
+    }
+}
+
+
 +(double)mercatorScaleForLatitude:(double)latitude {
 
     return 1 / cos(latitude * DEG_TO_RAD);
 }
 
++(double)mercatorScaleForNorthing:(double)northing {
+    
+    //on the sphere of googleProjection, 1 / cos(latitude) equals cosh(northing / radius)
+    return cosh(northing / 6378137.0);
+}
+
 
 @end
@@ -28,6 +28,10 @@
 #import <Foundation/Foundation.h>
 #import <CoreMotion/CMMotionManager.h>
 #import "AbstractSensor.h"
+#import "PDRExchange.h"
+
+//upper bound of samples handed to the listeners at once
+#define kMaxDeviceMotionBatchSize 32
 
 
 @interface Gyroscope : AbstractSensor {
@@ -42,16 +46,21 @@
     //turned on, not whether it isnt
     BOOL isMotionManagerActive;
     
-    //the start of the timestamps in CMDeviceMotion is not defined in the documentation
-    //maybe it starts at device boot up?? Oh, Apple....
-    NSTimeInterval timestampOffsetFrom1970;
-    BOOL timestampOffsetInitialized;
+    //CoreMotion pushes the samples onto this queue, they are collected in
+    //batch and handed on once batchSize of them have arrived
+    NSOperationQueue *motionQueue;
+    DeviceMotionSample batch[kMaxDeviceMotionBatchSize];
+    NSUInteger batchCount;
+    NSUInteger batchSize;
     
-    NSTimer *pollingTimer;
+    SensorSequenceStatistics motionStatistics;
 }
 
 @property(nonatomic,readonly) BOOL isAccelerometerActive;
 @property(nonatomic) int frequency;
+//samples CoreMotion delivered, skipped or sent out of order, a snapshot taken on motionQueue.
+//Not to be called on motionQueue.
+@property(nonatomic, readonly) SensorSequenceStatistics motionStatistics;
 
 //singleton pattern
 +(Gyroscope *)sharedInstance;
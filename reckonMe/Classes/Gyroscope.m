@@ -27,12 +27,17 @@
 
 #import "Gyroscope.h"
 
+//time span covered by one batch of samples [s]
+static const NSTimeInterval kBatchDuration = 0.1;
+
 
 //anonymous category extending the class with "private" methods
 @interface Gyroscope () 
 
 -(void)startMotionManager;
 -(void)stopMotionManager;
+-(void)captureDeviceMotion:(CMDeviceMotion *)motion;
+-(void)deliverBatch;
 
 @end
 
@@ -48,6 +53,20 @@ static Gyroscope *sharedSingleton;
     return sharedSingleton;
 }
 
+//a snapshot, as the statistics are updated on motionQueue
+-(SensorSequenceStatistics)motionStatistics {
+    
+    __block SensorSequenceStatistics snapshot;
+    
+    NSBlockOperation *copy = [NSBlockOperation blockOperationWithBlock:^(void) {
+        
+        snapshot = motionStatistics;
+    }];
+    [motionQueue addOperations:[NSArray arrayWithObject:copy] waitUntilFinished:YES];
+    
+    return snapshot;
+}
+
 #pragma mark -
 #pragma mark initialization methods
 
@@ -76,22 +95,22 @@ static Gyroscope *sharedSingleton;
 
         accelerometerListeners = [[NSMutableSet alloc] initWithCapacity:3];
         
-        timestampOffsetInitialized = NO;
-        
         isMotionManagerActive = NO;
         
+        motionQueue = [[NSOperationQueue alloc] init];
+        motionQueue.maxConcurrentOperationCount = 1;
+        batchCount = 0;
+        
         //gyroscope available?
         if ((isAvailable = [motionManager isDeviceMotionAvailable])) {
             
-            self.frequency = 1.0 / 60;
+            self.frequency = 60;
             
         } else {
             
             [motionManager release];
             motionManager = nil;
         }
-        
-        pollingTimer = nil;
 	}
     
 	return self;
@@ -103,6 +122,8 @@ static Gyroscope *sharedSingleton;
         
     if (motionManager) [motionManager release];
     
+    [motionQueue waitUntilAllOperationsAreFinished];
+    [motionQueue release];
     [accelerometerListeners release];
 	[super dealloc];
 }
@@ -196,24 +217,18 @@ static Gyroscope *sharedSingleton;
         
         frequency = _frequency;
         
-        /*
-         * We dispatch the restarting of the timer for later, as testing has
-         * shown that - for reasons unknown - the app would stall if resuming
-         * from background and this method being called due to changes in frequncy.
-         */
-        dispatch_async(dispatch_get_main_queue(), ^(void) {
+        NSUInteger size = (NSUInteger) lround(frequency * kBatchDuration);
+        size = MAX(1, MIN(size, kMaxDeviceMotionBatchSize));
+        
+        //CoreMotion accepts a new interval while the updates are running
+        motionManager.deviceMotionUpdateInterval = 1.0 / frequency;
+        
+        //the batch belongs to motionQueue
+        [motionQueue addOperationWithBlock:^(void) {
             
-            if (self.isActive) {
-                
-                //restart the timer
-                [pollingTimer invalidate];
-                pollingTimer = [NSTimer scheduledTimerWithTimeInterval:(1.0 / frequency)
-                                                                target:self 
-                                                              selector:@selector(captureDeviceMotion)
-                                                              userInfo:nil
-                                                               repeats:YES];
-            }
-        });
+            batchSize = size;
+            if (batchCount >= batchSize) [self deliverBatch];
+        }];
     }
 }
 
@@ -227,47 +242,64 @@ static Gyroscope *sharedSingleton;
             
             isMotionManagerActive = YES;
             
-            //let the motion manage sample at 100Hz, actual polling might be lower     
-            motionManager.deviceMotionUpdateInterval = 1.0 / 100;
+            //CoreMotion samples at the requested frequency and pushes every
+            //sample onto motionQueue, the main thread is not involved
+            motionManager.deviceMotionUpdateInterval = 1.0 / frequency;
             
-            [motionManager startDeviceMotionUpdatesUsingReferenceFrame:CMAttitudeReferenceFrameXArbitraryZVertical];
-//            CMAttitudeReferenceFrameXTrueNorthZVertical];
-            
-            [pollingTimer invalidate];
-            pollingTimer = [NSTimer scheduledTimerWithTimeInterval:(1.0 / frequency)
-                                                            target:self 
-                                                          selector:@selector(captureDeviceMotion)
-                                                          userInfo:nil
-                                                           repeats:YES];
+            [motionManager startDeviceMotionUpdatesUsingReferenceFrame:CMAttitudeReferenceFrameXArbitraryZVertical
+//            CMAttitudeReferenceFrameXTrueNorthZVertical
+                                                               toQueue:motionQueue
+                                                           withHandler:^(CMDeviceMotion *motion, NSError *error) {
+                                                               
+                                                               if (motion) [self captureDeviceMotion:motion];
+                                                           }];
         }
     }
 }
 
 
--(void)captureDeviceMotion {
+//runs on motionQueue
+-(void)captureDeviceMotion:(CMDeviceMotion *)motion {
+    
+    //CoreMotion's timestamps count the uptime
+    NSTimeInterval timestamp = SensorClockFromUptime(motion.timestamp);
+    
+    if (!isActive) return;
+    if (!SensorSequenceCheck(&motionStatistics, timestamp, motionManager.deviceMotionUpdateInterval)) return;
+    
+    CMAttitude *attitude = motion.attitude;
+    DeviceMotionSample *sample = &batch[batchCount++];
+    
+    sample->timestamp = timestamp;
+    sample->quaternion = attitude.quaternion;
+    sample->yaw = attitude.yaw;
+    sample->userAcceleration = motion.userAcceleration;
+    sample->gravity = motion.gravity;
+    sample->rotationRate = motion.rotationRate;
+    
+    if (batchCount >= batchSize) [self deliverBatch];
+}
+
+//runs on motionQueue
+-(void)deliverBatch {
     
-    CMDeviceMotion *motion = motionManager.deviceMotion;
+    const SensorListenerList *list = [self beginListenerDispatch];
     
-    if (motion) {
+    for (NSUInteger i = 0; i < list->count; i++) {
         
-        if (!timestampOffsetInitialized) {
-            
-            timestampOffsetFrom1970 = [self getTimestamp] - motion.timestamp;
-            timestampOffsetInitialized = YES;
-        }
+        const SensorListenerEntry *entry = &list->entries[i];
         
-        NSTimeInterval timestamp = motion.timestamp + timestampOffsetFrom1970;
-        if (isActive) {
-            
-            id<SensorListener> listener;
-            for (listener in listeners) {
-
-                [listener didReceiveDeviceMotion:motion
-                                       timestamp:timestamp];
-            }
-            
-        }
+        if (entry->didReceiveDeviceMotionBatch == NULL) continue;
+        
+        ((DeviceMotionBatchIMP) entry->didReceiveDeviceMotionBatch)(entry->listener,
+                                                                    @selector(didReceiveDeviceMotionBatch:count:),
+                                                                    batch,
+                                                                    batchCount);
     }
+    
+    [self endListenerDispatch];
+    
+    batchCount = 0;
 }
 
 -(void)stopMotionManager {
@@ -275,13 +307,18 @@ static Gyroscope *sharedSingleton;
     //stop only if accelerometer AND gyroscope should be off
     if (isAvailable && !isAccelerometerActive && !isActive) {
         
-        [pollingTimer invalidate];
-        pollingTimer = nil;
-        
         [motionManager stopDeviceMotionUpdates];
         
         isMotionManagerActive = NO;
-        timestampOffsetInitialized = NO;
+        
+        //drop a partial batch and don't count the pause as a gap,
+        //queued behind any sample still pending
+        [motionQueue addOperationWithBlock:^(void) {
+            
+            batchCount = 0;
+            SensorSequenceLog(@"Device motion", &motionStatistics);
+            motionStatistics.received = 0;
+        }];
     }
     
 }
@@ -28,6 +28,7 @@
 #import <Foundation/Foundation.h>
 #import "GeodeticProjection.h"
 #import <CoreLocation/CoreLocation.h>
+#import "PositionAdvertisement.h"
 
 @interface LocationEntry : NSObject <NSCoding> {
     
@@ -68,9 +69,12 @@
                  origin:(CLLocationCoordinate2D) _origin
               Deviation:(double) _deviation;
 
-- (instancetype)initWithBase64String:(NSString *)encodedPosition;
+//a peer's position as received over Bluetooth LE, timestamped with the current time
+- (instancetype)initWithAdvertisement:(const PositionAdvertisement *)advertisement;
 
 - (NSString *)stringRepresentationForRecording;
-- (NSString *)toBase64Encoding;
+
+//fills in the position and deviation, leaves flags, session and sequence to the caller
+- (void)getAdvertisement:(PositionAdvertisement *)advertisement;
     
 @end
@@ -26,6 +26,7 @@
 **/
 
 #import "LocationEntry.h"
+#import "SensorClock.h"
 
 NSString* const timestampKey = @"timestamp";
 NSString* const eastingDeltaKey = @"eastingDelta";
@@ -124,29 +125,20 @@ NSString* const originEastingKey = @"originEasting";
     return self;
 }
 
-- (instancetype)initWithBase64String:(NSString *)encodedPosition {
-    
-    NSAssert([encodedPosition length] == 28, @"base64-encoded position string has a wrong length (!=28)");
+- (instancetype)initWithAdvertisement:(const PositionAdvertisement *)advertisement {
     
     if (self = [super init]) {
         
-        NSData *data = [[NSData alloc] initWithBase64EncodedString:encodedPosition
-                                                           options:0];
-        NSInteger offset = 0;
-        
-        double lat = [[self class] decodeDoubleFrom:data atOffset:&offset];
-        double lon = [[self class] decodeDoubleFrom:data atOffset:&offset];
-        double dev = [[self class] decodeFloatFrom:data atOffset:&offset];
-        [data release];
-        
         //set LocationEntry values
-        timestamp = [[NSDate date] timeIntervalSince1970]; //now
+        timestamp = SensorClockNow();
         eastingDelta = 0;
         northingDelta = 0;
-        deviation = dev;
+        deviation = advertisement->deviation;
         
-        //set remaining AbsoluteLocation values
-        [self setOrigin:CLLocationCoordinate2DMake(lat, lon)];
+        //the advertisement is already projected, no need to go through coordinates
+        originEasting = advertisement->easting;
+        originNorthing = advertisement->northing;
+        mercatorScaleFactor = [GeodeticProjection mercatorScaleForNorthing:originNorthing];
     }
     return self;
 }
@@ -159,74 +151,13 @@ NSString* const originEastingKey = @"originEasting";
     //we omit encoding mercatorScaleFactor as it is implicitly specified by the origin
 }
 
-+(void)encodeDouble:(Float64)value into:(NSMutableData *)data {
-    
-    CFSwappedFloat64 swappedValue = CFConvertDoubleHostToSwapped(value);
-    [data appendBytes:&swappedValue length:sizeof(CFSwappedFloat64)];
-}
-
-+(void)encodeFloat:(Float32)value into:(NSMutableData *)data {
-    
-    CFSwappedFloat32 swappedValue = CFConvertFloat32HostToSwapped(value);
-    [data appendBytes:&swappedValue length:sizeof(CFSwappedFloat32)];
-}
-
-/*
- * Returns the decoded value AND increases *offset for the next potential
- * call of a decode... method.
- */
-+(Float64)decodeDoubleFrom:(NSData *)data atOffset:(NSInteger *)offset {
-    
-    NSRange range = {*offset, sizeof(CFSwappedFloat64)};
-    *offset += range.length;
-    
-    CFSwappedFloat64 swappedValue;
-    [data getBytes:&swappedValue range:range];
-    
-    return CFConvertDoubleSwappedToHost(swappedValue);
-}
-
-/*
- * Returns the decoded value AND increases *offset for the next potential
- * call of a decode... method.
- */
-+(Float32)decodeFloatFrom:(NSData *)data atOffset:(NSInteger *)offset {
-    
-    NSRange range = {*offset, sizeof(CFSwappedFloat32)};
-    *offset += range.length;
-    
-    CFSwappedFloat32 swappedValue;
-    [data getBytes:&swappedValue range:range];
-    
-    return CFConvertFloat32SwappedToHost(swappedValue);
-}
-
--(NSString *)toBase64Encoding {
-    
-    CLLocationCoordinate2D absolute = self.absolutePosition;
-    
-    //to be encoded
-    Float64 lat = absolute.latitude;
-    Float64 lon = absolute.longitude;
-    Float32 dev = (Float32) self.deviation; //we are losing precision here
+-(void)getAdvertisement:(PositionAdvertisement *)advertisement {
     
-    // Create NSData object
-    NSMutableData *data = [NSMutableData new];
-    [[self class] encodeDouble:lat
-                          into:data];
-    [[self class] encodeDouble:lon
-                          into:data];
-    [[self class] encodeFloat:dev
-                         into:data];
-    
-    // Get NSString from NSData object in Base64
-    NSString *base64Encoded = [data base64EncodedStringWithOptions:0];
-    [data release];
-    
-    return base64Encoded;
+    advertisement->easting = self.easting;
+    advertisement->northing = self.northing;
+    advertisement->deviation = self.deviation;
 }
 
-
 -(void)setOrigin:(CLLocationCoordinate2D)origin {
     
     ProjectedPoint newOrigin = [GeodeticProjection coordinatesToCartesian:origin];
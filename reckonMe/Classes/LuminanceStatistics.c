@@ -0,0 +1,170 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "LuminanceStatistics.h"
+#include <math.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LUMINANCE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LUMINANCE_SSE2 1
+#endif
+
+//pixels processed between two flushes of the vector accumulators, keeps their lanes from overflowing
+#define BLOCKS_PER_FLUSH 128
+
+/*
+ * Adds every step-th of the count bytes at row to *sum and their squares to
+ * *sumOfSquares. Steps dividing 16 are vectorized by masking out the other
+ * bytes of each block.
+ */
+static void accumulateRow(const uint8_t *row, size_t count, size_t step, uint64_t *sum, uint64_t *sumOfSquares) {
+    
+    size_t i;
+    
+#if LUMINANCE_NEON || LUMINANCE_SSE2
+    //whole blocks of 16 bytes, if the step keeps to the same bytes in each of them
+    size_t vectorized = (16 % step == 0) ? count - count % 16 : 0;
+    uint8_t maskBytes[16];
+    
+    //the steps used here are powers of two
+    for (i = 0; i < 16; i++) maskBytes[i] = (i & (step - 1)) == 0 ? 0xff : 0;
+#endif
+    
+    i = 0;
+    
+#if LUMINANCE_NEON
+    const uint8x16_t mask = vld1q_u8(maskBytes);
+    
+    while (i < vectorized) {
+        
+        uint16x8_t sums = vdupq_n_u16(0);
+        uint32x4_t squares = vdupq_n_u32(0);
+        int blocks;
+        
+        //at most 2 * 255 per lane and block for the sum, 2 * 255^2 for the squares
+        for (blocks = 0; blocks < BLOCKS_PER_FLUSH && i < vectorized; blocks++, i += 16) {
+            
+            uint8x16_t pixels = vandq_u8(vld1q_u8(row + i), mask);
+            
+            sums = vpadalq_u8(sums, pixels);
+            squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(pixels), vget_low_u8(pixels)));
+            squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(pixels), vget_high_u8(pixels)));
+        }
+        
+        uint64x2_t wideSums = vpaddlq_u32(vpaddlq_u16(sums));
+        uint64x2_t wideSquares = vpaddlq_u32(squares);
+        
+        *sum += vgetq_lane_u64(wideSums, 0) + vgetq_lane_u64(wideSums, 1);
+        *sumOfSquares += vgetq_lane_u64(wideSquares, 0) + vgetq_lane_u64(wideSquares, 1);
+    }
+#elif LUMINANCE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_loadu_si128((const __m128i *)maskBytes);
+    
+    while (i < vectorized) {
+        
+        __m128i sums = _mm_setzero_si128();
+        __m128i squares = _mm_setzero_si128();
+        uint32_t lanes[4];
+        uint64_t halves[2];
+        int blocks;
+        
+        //the sums go straight into 64 bit lanes, the squares into 32 bit lanes taking 4 * 255^2 per block
+        for (blocks = 0; blocks < BLOCKS_PER_FLUSH && i < vectorized; blocks++, i += 16) {
+            
+            __m128i pixels = _mm_and_si128(_mm_loadu_si128((const __m128i *)(row + i)), mask);
+            __m128i low = _mm_unpacklo_epi8(pixels, zero);
+            __m128i high = _mm_unpackhi_epi8(pixels, zero);
+            
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(pixels, zero));
+            squares = _mm_add_epi32(squares, _mm_madd_epi16(low, low));
+            squares = _mm_add_epi32(squares, _mm_madd_epi16(high, high));
+        }
+        
+        _mm_storeu_si128((__m128i *)halves, sums);
+        _mm_storeu_si128((__m128i *)lanes, squares);
+        
+        *sum += halves[0] + halves[1];
+        *sumOfSquares += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    
+    uint32_t tailSum = 0, tailSquares = 0, tailCount = 0;
+    
+    //i is a multiple of 16 here, and thereby of the step
+    for (; i < count; i += step) {
+        
+        tailSum += row[i];
+        tailSquares += row[i] * row[i];
+        
+        //flush before the 32 bit accumulators could overflow
+        if (++tailCount == 0x10000) {
+            
+            *sum += tailSum;
+            *sumOfSquares += tailSquares;
+            tailSum = tailSquares = tailCount = 0;
+        }
+    }
+    *sum += tailSum;
+    *sumOfSquares += tailSquares;
+}
+
+LuminanceStatistics computeLuminanceStatistics(const uint8_t *plane, size_t width, size_t height, size_t bytesPerRow, size_t step) {
+    
+    LuminanceStatistics statistics = { 0, 0, 0 };
+    uint64_t sum = 0, sumOfSquares = 0;
+    size_t y;
+    
+    if (step == 0) step = 1;
+    
+    for (y = 0; y < height; y += step) {
+        
+        accumulateRow(plane + y * bytesPerRow, width, step, &sum, &sumOfSquares);
+    }
+    
+    statistics.samples = ((width + step - 1) / step) * ((height + step - 1) / step);
+    
+    if (statistics.samples > 0) {
+        
+        double n = (double) statistics.samples;
+        double mean = sum / n;
+        
+        statistics.mean = mean / UINT8_MAX;
+    
+        if (statistics.samples > 1) {
+            
+            double variance = (sumOfSquares - sum * mean) / (n - 1);
+            
+            statistics.standardDeviation = variance > 0 ? sqrt(variance) / UINT8_MAX : 0;
+        }
+    }
+    
+    return statistics;
+}
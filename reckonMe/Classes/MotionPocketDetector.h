@@ -0,0 +1,55 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import <Foundation/Foundation.h>
+#import "PDRExchange.h"
+#import "PantsPocketDetector.h"
+
+#define kMotionPocketDetectorMaxScreenTilt 0.5  //|gravity.z| in g below which the device is upright, as in a pocket
+#define kMotionPocketDetectorMinStepEnergy 0.004 //mean square of the step band acceleration in g^2 when walking
+#define kMotionPocketDetectorDecisionTime 2     //seconds a new state has to persist
+
+/*
+ * A camera-free alternative to PantsPocketDetector: it listens to the Gyroscope
+ * and reports being "in the pocket" while the device is held upright, with its
+ * screen facing sideways, and the acceleration shows the energy of walking.
+ */
+@interface MotionPocketDetector : NSObject <PocketDetector, SensorListener>
+{
+    BOOL started;
+    
+    //all touched on the Gyroscope's queue only
+    NSTimeInterval lastTimestamp;
+    NSTimeInterval candidateSince;
+    CMAcceleration gravity;             //low passed
+    double accelerationBaseline;        //slow mean of |user acceleration|
+    double stepBandAcceleration;        //|user acceleration| around the step frequency
+    double stepBandEnergy;              //its mean square
+    BOOL inPocket;
+}
+
+@end
@@ -0,0 +1,156 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import "MotionPocketDetector.h"
+#import "Gyroscope.h"
+
+//time constants of the filters [s]
+static const double kGravitySmoothing = 0.5;
+static const double kBaselineSmoothing = 0.5;   //the band starts at about 0.3 Hz...
+static const double kStepBandSmoothing = 0.08;  //...and ends at about 2 Hz
+static const double kEnergySmoothing = 2;
+
+//gaps longer than this restart the filters [s]
+static const double kMaxSampleInterval = 0.5;
+
+//weight of a new value in an exponential moving average with time constant tau
+static inline double smoothingFactor(double dt, double tau) {
+    
+    return dt / (tau + dt);
+}
+
+
+@implementation MotionPocketDetector
+
+@synthesize delegate;
+@dynamic isStarted, isInPocket;
+
+-(id)init {
+    
+    if (self = [super init]) {
+        
+        delegate = nil;
+        started = NO;
+        inPocket = NO;
+        lastTimestamp = 0;
+    }
+    
+    return self;
+}
+
+-(void)dealloc {
+    
+    [self stop];
+    [super dealloc];
+}
+
+-(BOOL)isStarted {
+    
+    return started;
+}
+
+-(BOOL)isInPocket {
+    
+    return inPocket;
+}
+
+-(void)start {
+    
+    if (!started) {
+        
+        started = YES;
+        [[Gyroscope sharedInstance] addListener:self];
+        [[Gyroscope sharedInstance] start];
+    }
+}
+
+-(void)stop {
+    
+    if (started) {
+        
+        started = NO;
+        [[Gyroscope sharedInstance] removeListener:self];
+    }
+}
+
+#pragma mark -
+#pragma mark SensorListener
+
+//called on the Gyroscope's queue
+-(void)didReceiveDeviceMotionBatch:(const DeviceMotionSample *)samples count:(NSUInteger)count {
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        
+        const DeviceMotionSample *sample = &samples[i];
+        double dt = sample->timestamp - lastTimestamp;
+        double acceleration = sqrt(sample->userAcceleration.x * sample->userAcceleration.x
+                                 + sample->userAcceleration.y * sample->userAcceleration.y
+                                 + sample->userAcceleration.z * sample->userAcceleration.z);
+        
+        lastTimestamp = sample->timestamp;
+        
+        if (dt <= 0 || dt > kMaxSampleInterval) {
+            
+            //(re)start the filters with this sample
+            gravity = sample->gravity;
+            accelerationBaseline = acceleration;
+            stepBandAcceleration = 0;
+            stepBandEnergy = 0;
+            candidateSince = sample->timestamp;
+            continue;
+        }
+        
+        //CoreMotion's gravity is already fused from all sensors, it only needs to be calmed down
+        double k = smoothingFactor(dt, kGravitySmoothing);
+        gravity.x += (sample->gravity.x - gravity.x) * k;
+        gravity.y += (sample->gravity.y - gravity.y) * k;
+        gravity.z += (sample->gravity.z - gravity.z) * k;
+        
+        //band pass around the step frequency and its mean square
+        accelerationBaseline += (acceleration - accelerationBaseline) * smoothingFactor(dt, kBaselineSmoothing);
+        stepBandAcceleration += (acceleration - accelerationBaseline - stepBandAcceleration) * smoothingFactor(dt, kStepBandSmoothing);
+        stepBandEnergy += (stepBandAcceleration * stepBandAcceleration - stepBandEnergy) * smoothingFactor(dt, kEnergySmoothing);
+        
+        BOOL looksLikePocket = (fabs(gravity.z) < kMotionPocketDetectorMaxScreenTilt)
+                            && (stepBandEnergy > kMotionPocketDetectorMinStepEnergy);
+        
+        if (looksLikePocket == inPocket) {
+            
+            candidateSince = sample->timestamp;
+            
+        } else if (sample->timestamp - candidateSince >= kMotionPocketDetectorDecisionTime) {
+            
+            inPocket = looksLikePocket;
+            candidateSince = sample->timestamp;
+            
+            NSLog(@"motion inPocket: %d (tilt %.2f, energy %.4f)", inPocket, gravity.z, stepBandEnergy);
+            [self.delegate devicesPocketStatusChanged:inPocket];
+        }
+    }
+}
+
+@end
@@ -29,6 +29,7 @@
 #import <GLKit/GLKMath.h>
 #import "LocationEntry.h"
 #import "PDRExchange.h"
+#import "SensorClock.h"
 #include <list>
 #include <map>
 
@@ -45,5 +46,9 @@
 
 @property(nonatomic, readonly) bool pdrRunning;
 
+//device motion received, the out of order samples among it have been discarded
+//a consistent copy, must not be read from within PDRController's computation queue
+@property(nonatomic, readonly) SensorSequenceStatistics motionStatistics;
+
 @end
 
@@ -85,6 +85,9 @@ const double kMaxAngleStrideThreshold = 80.0;
 // maximal time distance [s] between the peaks to be recognised as a step
 const double kMaxStepDuration = 2.0;
 
+// peer positions which may wait for computePDRqueue, more are turned away
+const int kMaxPendingPeerPositions = 8;
+
 
 struct MotionManagerEntry {
     double timestamp;
@@ -107,6 +110,13 @@ struct TraceEntry {
     TraceEntry() : x(0), y(0), deviation(1.0) {}  
 };
 
+struct PendingPeerPosition {
+    PositionAdvertisement advertisement;
+    NSString *peerID;               // retained
+    BOOL isRealName;
+    void (^accepted)(BOOL);         // copied, may be nil
+};
+
 @interface PDRController () 
 
 - (void)runPdrWithTimestamp:(NSTimeInterval) timestamp;
@@ -115,6 +125,11 @@ struct TraceEntry {
 - (void)pruneDataOlderThan:(double) timestamp;
 - (void)resetPDR;
 - (void)computePDR;
+- (void)processPendingPeerPositions;
+- (void)setUpSessionWithGPSfix:(AbsoluteLocationEntry *)location;
+- (void)applyManualPositionCorrection:(AbsoluteLocationEntry *)position;
+- (void)rotateCollaborativeTraceBy:(double) radians;
+- (NSMutableArray *)findPartOfPathToBeRotatedWithPinLocation:(AbsoluteLocationEntry *)pinLocation;
 - (NSMutableArray *)collaborativeTraceToNSMutableArrayStartingAt:(list<TraceEntry>::iterator) startingPosition;
 
 @end
@@ -138,6 +153,16 @@ static PDRController *sharedSingleton;
     
     dispatch_queue_t computePDRqueue;
     
+    // only touched on computePDRqueue, the property hands out copies
+    SensorSequenceStatistics motionStatistics;
+    // timestamp of the last PDR run, only touched on computePDRqueue
+    NSTimeInterval lastTimeRun;
+    
+    // ring of peer positions handed over by the exchange, guarded by pendingPeerPositionsSemaphore
+    PendingPeerPosition pendingPeerPositions[kMaxPendingPeerPositions];
+    int firstPendingPeerPosition, numPendingPeerPositions;
+    dispatch_semaphore_t pendingPeerPositionsSemaphore;
+    
     double stepLength;
     NSInteger distanceBetweenConsecutiveMeetings;
 }
@@ -168,21 +193,44 @@ static PDRController *sharedSingleton;
     return sharedSingleton;
 }
 
+
+//a snapshot, as the statistics are updated on computePDRqueue; not to be called on that queue
+- (SensorSequenceStatistics)motionStatistics {
+    
+    __block SensorSequenceStatistics snapshot;
+    
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        snapshot = motionStatistics;
+    });
+    return snapshot;
+}
+
 #pragma mark -
 #pragma mark PDRDataListener
 
 
-- (void)didReceiveDeviceMotion:(CMDeviceMotion *)motionTN timestamp:(NSTimeInterval)timestampTN {
-
-    if (!motionManagerData.empty() && motionManagerData.back().timestamp >= timestampTN)
+- (void)didReceiveDeviceMotionBatch:(const DeviceMotionSample *)samples count:(NSUInteger)count {
+    
+    if (count == 0)
         return;
-    if (pdrRunning) 
-        motionManagerData.push_back(
-                                    MotionManagerEntry(timestampTN, motionTN.attitude.quaternion, motionTN.userAcceleration)
-                                    );
     
+    //the samples are only valid during this call
+    vector<DeviceMotionSample> motionBatch(samples, samples + count);
+    
+    //motionManagerData is only touched on the serial computePDRqueue
     dispatch_async(computePDRqueue, ^(void) {
-        [self runPdrWithTimestamp:timestampTN];
+        
+        for (auto it = motionBatch.cbegin(); it != motionBatch.cend(); ++it) {
+            
+            if (!SensorSequenceCheck(&motionStatistics, it->timestamp, 0))
+                continue;
+            if (pdrRunning)
+                motionManagerData.push_back(
+                                            MotionManagerEntry(it->timestamp, it->quaternion, it->userAcceleration)
+                                            );
+        }
+        [self runPdrWithTimestamp:motionBatch.back().timestamp];
     });
 }
  
@@ -191,16 +239,33 @@ static PDRController *sharedSingleton;
 #pragma mark PDRControllerProtocol
 
 
+// The traces are extended by the steps and exchanges on computePDRqueue.
+// The calls of the view controller, which arrive on the main thread, modify them there, too.
 - (void)startPDRsessionWithGPSfix:(AbsoluteLocationEntry *)location {
-
+    
     [self resetPDR];
     
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        [self setUpSessionWithGPSfix:location];
+    });
+}
+
+    
+- (void)setUpSessionWithGPSfix:(AbsoluteLocationEntry *)location {
+
     distanceBetweenConsecutiveMeetings = [Settings sharedInstance].distanceBetweenConsecutiveMeetings;
     stepLength = [Settings sharedInstance].stepLength;
     
     originEasting = location.easting;
     originNorthing = location.northing;
-   
+
+    // the session stays close to its origin, where a local fit replaces proj4 for the conversions
+    ProjectedPoint originProjected;
+    originProjected.easting = originEasting;
+    originProjected.northing = originNorthing;
+    [GeodeticProjection approximateAroundOrigin:originProjected];
+
     // TEMPORARY CHANGE
     double timestamp = location.timestamp;
         
@@ -244,12 +309,25 @@ static PDRController *sharedSingleton;
     
 - (void)stopPDRsession {
     
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        SensorSequenceLog(@"PDR device motion", &motionStatistics);
+    });
     [self resetPDR];
 }
 
     
 - (void)didReceiveManualPostionCorrection:(AbsoluteLocationEntry *)position {
     
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        [self applyManualPositionCorrection:position];
+    });
+}
+
+    
+- (void)applyManualPositionCorrection:(AbsoluteLocationEntry *)position {
+    
     if(!pdrRunning)
         return;
 
@@ -398,15 +476,108 @@ static PDRController *sharedSingleton;
 }
 
     
+- (BOOL)enqueuePeerPosition:(const PositionAdvertisement *)advertisement ofPeer:(NSString *)peerID isRealName:(BOOL)isRealName accepted:(void (^)(BOOL))accepted {
+    
+    bool wasEmpty;
+    
+    dispatch_semaphore_wait(pendingPeerPositionsSemaphore, DISPATCH_TIME_FOREVER);
+    
+    if (numPendingPeerPositions == kMaxPendingPeerPositions) {
+        
+        dispatch_semaphore_signal(pendingPeerPositionsSemaphore);
+        return NO;
+    }
+    
+    PendingPeerPosition &pending = pendingPeerPositions[(firstPendingPeerPosition + numPendingPeerPositions) % kMaxPendingPeerPositions];
+    pending.advertisement = *advertisement;
+    pending.peerID = [peerID retain];
+    pending.isRealName = isRealName;
+    pending.accepted = [accepted copy];
+    
+    wasEmpty = (numPendingPeerPositions++ == 0);
+    
+    dispatch_semaphore_signal(pendingPeerPositionsSemaphore);
+    
+    // one block drains everything that queued up in the meantime
+    if (wasEmpty) {
+        
+        dispatch_async(computePDRqueue, ^(void) {
+            
+            [self processPendingPeerPositions];
+        });
+    }
+    return YES;
+}
+
+    
+// runs on computePDRqueue, where the traces are modified by the steps as well
+- (void)processPendingPeerPositions {
+    
+    while (true) {
+        
+        dispatch_semaphore_wait(pendingPeerPositionsSemaphore, DISPATCH_TIME_FOREVER);
+        
+        if (numPendingPeerPositions == 0) {
+            
+            dispatch_semaphore_signal(pendingPeerPositionsSemaphore);
+            return;
+        }
+        
+        PendingPeerPosition pending = pendingPeerPositions[firstPendingPeerPosition];
+        firstPendingPeerPosition = (firstPendingPeerPosition + 1) % kMaxPendingPeerPositions;
+        numPendingPeerPositions--;
+        
+        dispatch_semaphore_signal(pendingPeerPositionsSemaphore);
+        
+        //we are not in the main thread -> we need our own pool
+        @autoreleasepool {
+            
+            bool shouldConnect = [self shouldConnectToPeerID:pending.peerID];
+            
+            if (shouldConnect) {
+                
+                AbsoluteLocationEntry *peerPosition = [[AbsoluteLocationEntry alloc] initWithAdvertisement:&pending.advertisement];
+                
+                [self didReceivePosition:peerPosition
+                                  ofPeer:pending.peerID
+                              isRealName:pending.isRealName];
+                [peerPosition release];
+            }
+            
+            if (pending.accepted) {
+                
+                pending.accepted(shouldConnect);
+            }
+            [pending.peerID release];
+            [pending.accepted release];
+        }
+    }
+}
+
+    
 - (AbsoluteLocationEntry *)positionForExchange {
     
-    TraceEntry lastPosition = collaborativeTrace.back();
-    AbsoluteLocationEntry *result = [self absoluteLocationEntryFrom:lastPosition];
-    return result;
+    __block AbsoluteLocationEntry *result;
+    
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        TraceEntry lastPosition = collaborativeTrace.back();
+        result = [[self absoluteLocationEntryFrom:lastPosition] retain];
+    });
+    return [result autorelease];
 }
 
     
 - (void)rotatePathBy:(double) radians {
+    
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        [self rotateCollaborativeTraceBy:radians];
+    });
+}
+
+    
+- (void)rotateCollaborativeTraceBy:(double) radians {
    
     // rotates the collaborative path, starting from the collaborativeTraceRotationIndex
     // pushes the full path to the view
@@ -440,6 +611,18 @@ static PDRController *sharedSingleton;
 
     
 - (NSMutableArray *)partOfPathToBeManuallyRotatedWithPinLocation:(AbsoluteLocationEntry *)pinLocation {
+    
+    __block NSMutableArray *result;
+    
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        result = [[self findPartOfPathToBeRotatedWithPinLocation:pinLocation] retain];
+    });
+    return [result autorelease];
+}
+
+    
+- (NSMutableArray *)findPartOfPathToBeRotatedWithPinLocation:(AbsoluteLocationEntry *)pinLocation {
 
     if (NULL != pinLocation && collaborativeTrace.size() > 2) {
         
@@ -473,7 +656,6 @@ static PDRController *sharedSingleton;
     
 - (void)runPdrWithTimestamp:(NSTimeInterval)timestamp {
     
-    static NSTimeInterval lastTimeRun = 0;
     static NSTimeInterval threshold = 2; // [s]
     
     if (pdrRunning && (timestamp > lastTimeRun + threshold)) {
@@ -532,17 +714,24 @@ static PDRController *sharedSingleton;
 }
 
     
+// called on the main thread, the state is reset on computePDRqueue, where the motion data is collected
 - (void)resetPDR {
     
-    pdrRunning = NO;
-    lastStepWasManualCorrection = NO;
-    self.pathRotationAmount = 0;
-    pdrTrace.clear();
-    collaborativeTrace.clear();
-    collaborativeTraceRotationIndex = collaborativeTrace.begin();
-    motionManagerData.clear();
-    timestampsOfLastMeetings.clear();
-    timestampOfLastInformationExchange = -1000;
+    dispatch_sync(computePDRqueue, ^(void) {
+        
+        pdrRunning = NO;
+        lastStepWasManualCorrection = NO;
+        self.pathRotationAmount = 0;
+        pdrTrace.clear();
+        collaborativeTrace.clear();
+        collaborativeTraceRotationIndex = collaborativeTrace.begin();
+        motionManagerData.clear();
+        //a new session may come with older timestamps, e.g. a replay
+        motionStatistics.received = 0;
+        lastTimeRun = 0;
+        timestampsOfLastMeetings.clear();
+        timestampOfLastInformationExchange = -1000;
+    });
 }
 
     
@@ -911,7 +1100,12 @@ static PDRController *sharedSingleton;
         
         lastStepWasManualCorrection = NO;
         
-        computePDRqueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);//dispatch_queue_create("PDR computation queue", DISPATCH_QUEUE_SERIAL);
+        computePDRqueue = dispatch_queue_create("PDR computation queue", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(computePDRqueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+        
+        firstPendingPeerPosition = 0;
+        numPendingPeerPositions = 0;
+        pendingPeerPositionsSemaphore = dispatch_semaphore_create(1);
     }
     
     return self;
@@ -920,7 +1114,8 @@ static PDRController *sharedSingleton;
     
 - (void)dealloc {
     
-    //dispatch_release(computePDRqueue);
+    dispatch_release(computePDRqueue);
+    dispatch_release(pendingPeerPositionsSemaphore);
     [super dealloc];
 }
 
@@ -30,9 +30,23 @@
 #import <CoreMotion/CMDeviceMotion.h>
 #import "LocationEntry.h"
 
+//one CMDeviceMotion reduced to plain values, taken on the sensor's queue
+typedef struct {
+    
+    NSTimeInterval timestamp;   //seconds since 1970
+    CMQuaternion quaternion;
+    double yaw;
+    CMAcceleration userAcceleration;
+    CMAcceleration gravity;
+    CMRotationRate rotationRate;
+    
+} DeviceMotionSample;
+
 @protocol SensorListener
 
--(void)didReceiveDeviceMotion:(CMDeviceMotion *)motion timestamp:(NSTimeInterval)timestamp;
+//Called on Gyroscope's queue, not on the main thread. The samples are ordered
+//by time and only valid for the duration of the call.
+-(void)didReceiveDeviceMotionBatch:(const DeviceMotionSample *)samples count:(NSUInteger)count;
 
 @optional
 
@@ -56,6 +70,11 @@
 
 - (void)didReceivePosition:(AbsoluteLocationEntry *)position ofPeer:(NSString *)peerID isRealName:(BOOL)isRealName;
 
+/* Called from any thread. Hands a peer's position over to be considered by the two methods above,
+ * returns NO without blocking if too many positions are still waiting. Otherwise, accepted is called
+ * later, on an arbitrary queue, telling whether the position was used. */
+- (BOOL)enqueuePeerPosition:(const PositionAdvertisement *)advertisement ofPeer:(NSString *)peerID isRealName:(BOOL)isRealName accepted:(void (^)(BOOL accepted))accepted;
+
 - (AbsoluteLocationEntry *)positionForExchange;
 
 - (void)rotatePathBy:(double)radians;
@@ -27,10 +27,12 @@
 
 #import <Foundation/Foundation.h>
 #import <AVFoundation/AVFoundation.h>
+#import <CoreMedia/CoreMedia.h>
 
 #define kPantsPocketDetectorLuminanceThreshold 0.10 //luminance in [0,1]
 #define kPantsPocketDetectorLuminanceStandardDeviationThreshold 0.023
 #define kPantsPocketDetectorCaptureInterval 1 //seconds
+#define kPantsPocketDetectorLuminanceSubsampling 4 //every 4th pixel of every 4th row
 
 @protocol PantsPocketDetectorDelegate <NSObject>
 
@@ -39,14 +41,26 @@
 
 @end
 
-@interface PantsPocketDetector : NSObject <AVCaptureVideoDataOutputSampleBufferDelegate>
+//what FirstViewController expects from a pocket detector
+@protocol PocketDetector <NSObject>
+
+@property(nonatomic, assign) id<PantsPocketDetectorDelegate> delegate;
+@property(nonatomic, readonly) BOOL isStarted;
+@property(nonatomic, readonly) BOOL isInPocket;
+
+-(void)start;
+-(void)stop;
+
+@end
+
+@interface PantsPocketDetector : NSObject <PocketDetector, AVCaptureVideoDataOutputSampleBufferDelegate>
 {
     
     AVCaptureSession *captureSession;
     AVCaptureVideoDataOutput *videoOut;
     dispatch_queue_t captureQueue;
     
-    unsigned int frameCounter;
+    CMTime lastAnalysedFrame;
 }
 
 @property(nonatomic, assign) id<PantsPocketDetectorDelegate> delegate;
@@ -26,6 +26,7 @@
 **/
 
 #import "PantsPocketDetector.h"
+#import "LuminanceStatistics.h"
 
 typedef enum {
     
@@ -55,6 +56,7 @@ typedef enum {
 -(void)didReceiveEvent:(PocketDetectorEvent)event;
 
 -(void)proximitySensorStateChanged;
+-(void)limitFrameRateOfDevice:(AVCaptureDevice *)device;
 -(void)startCapturing;
 -(void)stopCapturing;
 
@@ -73,7 +75,7 @@ typedef enum {
         isCameraAvailable = NO;
         self.status = Off;
         
-        frameCounter = 0;
+        lastAnalysedFrame = kCMTimeInvalid;
         
         captureSession = [[AVCaptureSession alloc] init];
         videoOut = [[AVCaptureVideoDataOutput alloc] init];
@@ -84,9 +86,14 @@ typedef enum {
                                                              forKey:(NSString *)kCVPixelBufferPixelFormatTypeKey];
         
         
-        if ([captureSession canSetSessionPreset:AVCaptureSessionPreset352x288]) {
+        //the lowest resolution available, brightness doesn't need more
+        if ([captureSession canSetSessionPreset:AVCaptureSessionPresetLow]) {
             
-            captureSession.sessionPreset = AVCaptureSessionPreset352x288;//lowest possible resolution
+            captureSession.sessionPreset = AVCaptureSessionPresetLow;
+            
+        } else if ([captureSession canSetSessionPreset:AVCaptureSessionPreset352x288]) {
+            
+            captureSession.sessionPreset = AVCaptureSessionPreset352x288;
         }
         
         //look for the camera at the back...
@@ -104,6 +111,7 @@ typedef enum {
                 && (device.position == AVCaptureDevicePositionFront)) {
                 
                 [captureSession addInput:deviceInput];//...and add it to the session
+                [self limitFrameRateOfDevice:device];
 
                 /* if you want to fumble with that, go ahead: (Ben suggests not to! ;) )
                 if ([device lockForConfiguration:nil]) {
@@ -298,11 +306,32 @@ typedef enum {
 }
 
 //MARK: - capturing
+
+//asks the camera for no more frames than we analyse, as far as its current format allows
+-(void)limitFrameRateOfDevice:(AVCaptureDevice *)device {
+    
+    CMTime frameDuration = CMTimeMake(kPantsPocketDetectorCaptureInterval, 1);
+    CMTime longestSupported = kCMTimeZero;
+    
+    for (AVFrameRateRange *range in device.activeFormat.videoSupportedFrameRateRanges) {
+        
+        longestSupported = CMTimeMaximum(longestSupported, range.maxFrameDuration);
+    }
+    frameDuration = CMTimeMinimum(frameDuration, longestSupported);
+    
+    if (CMTIME_COMPARE_INLINE(frameDuration, >, kCMTimeZero) && [device lockForConfiguration:nil]) {
+        
+        device.activeVideoMaxFrameDuration = frameDuration;
+        device.activeVideoMinFrameDuration = frameDuration;
+        [device unlockForConfiguration];
+    }
+}
+
 -(void)startCapturing {
     NSLog(@"startCap");
     if (!captureSession.isRunning) {
         
-        frameCounter = 0;
+        lastAnalysedFrame = kCMTimeInvalid;
         [captureSession startRunning];
     }
 }
@@ -333,7 +362,20 @@ typedef enum {
 
 - (void)captureOutput:(AVCaptureOutput *)captureOutput didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer fromConnection:(AVCaptureConnection *)connection {
     
-    if (++frameCounter % (30 * kPantsPocketDetectorCaptureInterval) == 0) {//assuming 30fps due to lack of other information
+    //the camera may not go as slow as the capture interval, skip what arrives early
+    CMTime frameTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    
+    if (!CMTIME_IS_VALID(lastAnalysedFrame)) {
+        
+        //like before, the first look is an interval after starting, giving the exposure time to settle
+        lastAnalysedFrame = frameTime;
+        return;
+    }
+    
+    //with some tolerance for the jitter of the frame times
+    if (CMTimeGetSeconds(CMTimeSubtract(frameTime, lastAnalysedFrame)) >= kPantsPocketDetectorCaptureInterval * 0.9) {
+        
+        lastAnalysedFrame = frameTime;
         
         // Get a CMSampleBuffer's Core Video image buffer for the media data
         CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer); 
@@ -341,35 +383,19 @@ typedef enum {
         CVPixelBufferLockBaseAddress(imageBuffer, kCVPixelBufferLock_ReadOnly); 
         
         size_t yPlaneIndex = 0;//hopefully the right index (undocumented!) for the Y-plane (Y = luminance in YCbCr color model)
-        size_t bytesPerRowOfYPlane = CVPixelBufferGetBytesPerRowOfPlane(imageBuffer, yPlaneIndex);
-        size_t heightOfYPlane = CVPixelBufferGetHeightOfPlane(imageBuffer, yPlaneIndex);
-        
-        unsigned char* pixelsOfYPlane = CVPixelBufferGetBaseAddressOfPlane(imageBuffer, yPlaneIndex);
         
-        //compute the average luminance
-        double luminanceSum = 0;
-        size_t totalBytes = heightOfYPlane * bytesPerRowOfYPlane;
-        
-        for (size_t i = 0; i < totalBytes; i++) {
-            
-            luminanceSum += pixelsOfYPlane[i];
-        }
-        
-        double averageLuminance = luminanceSum / totalBytes;
-        
-        //compute the standard deviation
-        double sumOfSquaredDifferences = 0;
-        for (size_t i = 0; i < totalBytes; i++) {
-            
-            double difference = (pixelsOfYPlane[i] - averageLuminance) / UCHAR_MAX;
-            sumOfSquaredDifferences += difference * difference;
-        }              
+        //a single pass over the visible pixels, without the padding at the end of each row
+        LuminanceStatistics luminance = computeLuminanceStatistics(CVPixelBufferGetBaseAddressOfPlane(imageBuffer, yPlaneIndex),
+                                                                   CVPixelBufferGetWidthOfPlane(imageBuffer, yPlaneIndex),
+                                                                   CVPixelBufferGetHeightOfPlane(imageBuffer, yPlaneIndex),
+                                                                   CVPixelBufferGetBytesPerRowOfPlane(imageBuffer, yPlaneIndex),
+                                                                   kPantsPocketDetectorLuminanceSubsampling);
         
         //we're done with the image -> unlock the pixel buffer
         CVPixelBufferUnlockBaseAddress(imageBuffer, kCVPixelBufferLock_ReadOnly);
         
-        double standardDeviation = sqrt( sumOfSquaredDifferences / (totalBytes - 1) );
-        averageLuminance /= UCHAR_MAX; 
+        double averageLuminance = luminance.mean;
+        double standardDeviation = luminance.standardDeviation;
         
         if (   (averageLuminance <= kPantsPocketDetectorLuminanceThreshold)
             && (standardDeviation <= kPantsPocketDetectorLuminanceStandardDeviationThreshold)) {
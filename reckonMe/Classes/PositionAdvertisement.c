@@ -0,0 +1,166 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "PositionAdvertisement.h"
+#include <math.h>
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//value of each base64 character, 0xff for all others
+static const uint8_t base64Values[256] = {
+    
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static inline void putUInt16(uint8_t *bytes, uint16_t value) {
+    
+    bytes[0] = (uint8_t) (value >> 8);
+    bytes[1] = (uint8_t) value;
+}
+
+static inline void putUInt32(uint8_t *bytes, uint32_t value) {
+    
+    bytes[0] = (uint8_t) (value >> 24);
+    bytes[1] = (uint8_t) (value >> 16);
+    bytes[2] = (uint8_t) (value >> 8);
+    bytes[3] = (uint8_t) value;
+}
+
+static inline uint16_t getUInt16(const uint8_t *bytes) {
+    
+    return (uint16_t) (bytes[0] << 8 | bytes[1]);
+}
+
+static inline uint32_t getUInt32(const uint8_t *bytes) {
+    
+    return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+//meters to cm, clamped to the int32 range, which spans the whole Mercator grid
+static int32_t toCentimeters(double meters) {
+    
+    double centimeters = round(meters * 100);
+    
+    if (!(centimeters >= INT32_MIN)) return INT32_MIN; //also catches NaN
+    if (centimeters > INT32_MAX) return INT32_MAX;
+    return (int32_t) centimeters;
+}
+
+//meters to dm, rounded up so a peer never trusts the position more than we do
+static uint16_t toDecimeters(double meters) {
+    
+    double decimeters = ceil(meters * 10);
+    
+    if (!(decimeters >= 1)) return 1;
+    if (decimeters > UINT16_MAX) return UINT16_MAX;
+    return (uint16_t) decimeters;
+}
+
+void PositionAdvertisementPack(const PositionAdvertisement *advertisement, uint8_t *bytes) {
+    
+    bytes[0] = (uint8_t) (kPositionAdvertisementVersion << 4 | (advertisement->flags & 0xf));
+    putUInt16(bytes + 1, advertisement->session);
+    putUInt16(bytes + 3, advertisement->sequence);
+    putUInt32(bytes + 5, (uint32_t) toCentimeters(advertisement->easting));
+    putUInt32(bytes + 9, (uint32_t) toCentimeters(advertisement->northing));
+    putUInt16(bytes + 13, toDecimeters(advertisement->deviation));
+}
+
+bool PositionAdvertisementUnpack(const uint8_t *bytes, PositionAdvertisement *advertisement) {
+    
+    if (bytes[0] >> 4 != kPositionAdvertisementVersion) return false;
+    
+    advertisement->flags = bytes[0] & 0xf;
+    advertisement->session = getUInt16(bytes + 1);
+    advertisement->sequence = getUInt16(bytes + 3);
+    advertisement->easting = (int32_t) getUInt32(bytes + 5) / 100.0;
+    advertisement->northing = (int32_t) getUInt32(bytes + 9) / 100.0;
+    advertisement->deviation = getUInt16(bytes + 13) / 10.0;
+    
+    return true;
+}
+
+void PositionAdvertisementEncode(const PositionAdvertisement *advertisement, char *text) {
+    
+    uint8_t bytes[kPositionAdvertisementLength];
+    int i;
+    
+    PositionAdvertisementPack(advertisement, bytes);
+    
+    //15 bytes are 5 groups of 3 bytes, 4 characters each
+    for (i = 0; i < kPositionAdvertisementLength; i += 3, text += 4) {
+        
+        uint32_t group = (uint32_t) bytes[i] << 16 | (uint32_t) bytes[i + 1] << 8 | bytes[i + 2];
+        
+        text[0] = base64Alphabet[group >> 18];
+        text[1] = base64Alphabet[(group >> 12) & 0x3f];
+        text[2] = base64Alphabet[(group >> 6) & 0x3f];
+        text[3] = base64Alphabet[group & 0x3f];
+    }
+    *text = '\0';
+}
+
+bool PositionAdvertisementDecode(const char *text, size_t length, PositionAdvertisement *advertisement) {
+    
+    uint8_t bytes[kPositionAdvertisementLength];
+    int i;
+    
+    if (length != kPositionAdvertisementEncodedLength) return false;
+    
+    for (i = 0; i < kPositionAdvertisementLength; i += 3, text += 4) {
+        
+        uint8_t a = base64Values[(uint8_t) text[0]];
+        uint8_t b = base64Values[(uint8_t) text[1]];
+        uint8_t c = base64Values[(uint8_t) text[2]];
+        uint8_t d = base64Values[(uint8_t) text[3]];
+        uint32_t group;
+        
+        if ((a | b | c | d) & 0xc0) return false;
+        
+        group = (uint32_t) a << 18 | (uint32_t) b << 12 | (uint32_t) c << 6 | d;
+        bytes[i] = (uint8_t) (group >> 16);
+        bytes[i + 1] = (uint8_t) (group >> 8);
+        bytes[i + 2] = (uint8_t) group;
+    }
+    
+    return PositionAdvertisementUnpack(bytes, advertisement);
+}
@@ -0,0 +1,95 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef reckonMe_PositionAdvertisement_h
+#define reckonMe_PositionAdvertisement_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Position of a device as advertised over Bluetooth LE, packed into 15 bytes:
+ *
+ *   0      version (high nibble) and flags (low nibble)
+ *   1-2    session, random per start of the exchange
+ *   3-4    sequence, incremented with every new position of a session
+ *   5-8    easting, signed, in cm of the Mercator grid
+ *   9-12   northing, signed, in cm of the Mercator grid
+ *   13-14  deviation, unsigned, in dm, rounded up
+ *
+ * All fields are big-endian. iOS only lets an app advertise a local name and
+ * service UUIDs, so the packet is carried base64-encoded in the local name,
+ * where its 15 bytes take exactly 20 characters without padding.
+ */
+
+#define kPositionAdvertisementVersion 1
+#define kPositionAdvertisementLength 15
+#define kPositionAdvertisementEncodedLength 20
+
+//flags
+#define kPositionAdvertisementStationary 0x1   //a beacon at a known position, not a walker
+
+typedef struct {
+    
+    uint8_t flags;
+    uint16_t session;
+    uint16_t sequence;
+    
+    double easting;     //meters in the Mercator grid
+    double northing;
+    double deviation;   //meters
+    
+} PositionAdvertisement;
+
+//packs the advertisement into kPositionAdvertisementLength bytes, values out of range are clamped
+void PositionAdvertisementPack(const PositionAdvertisement *advertisement, uint8_t *bytes);
+
+//returns false if the bytes are of another version
+bool PositionAdvertisementUnpack(const uint8_t *bytes, PositionAdvertisement *advertisement);
+
+//writes kPositionAdvertisementEncodedLength characters and a terminating NUL to text
+void PositionAdvertisementEncode(const PositionAdvertisement *advertisement, char *text);
+
+//returns false if text is not a base64-encoded advertisement of the current version
+bool PositionAdvertisementDecode(const char *text, size_t length, PositionAdvertisement *advertisement);
+
+//whether sequence a comes after b, allowing for wrap around
+static inline bool PositionAdvertisementIsNewer(uint16_t a, uint16_t b) {
+    
+    return (int16_t) (uint16_t) (a - b) > 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import <Foundation/Foundation.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The time base shared by all sensor values: seconds since 1970, but counted
+ * by the monotonic host clock. The wall clock is consulted once, when the
+ * clock is first used, so later adjustments of the wall clock never make the
+ * timestamps jump.
+ */
+
+//now
+NSTimeInterval SensorClockNow(void);
+
+//converts a time from the system's uptime clock, e.g. CMLogItem.timestamp
+NSTimeInterval SensorClockFromUptime(NSTimeInterval uptime);
+
+//converts a wall clock date, e.g. CLLocation.timestamp, by its age
+NSTimeInterval SensorClockFromDate(NSDate *date);
+
+
+//tracks the regularity of a stream of sensor values
+typedef struct {
+    
+    NSTimeInterval lastTimestamp;
+    int64_t received;
+    int64_t dropped;        //estimated from gaps of more than 1.5 expected intervals
+    int64_t outOfOrder;     //values not later than their predecessor
+    
+} SensorSequenceStatistics;
+
+//Counts a value of the stream, returns NO if it is out of order. Gaps are only
+//looked for if expectedInterval > 0.
+BOOL SensorSequenceCheck(SensorSequenceStatistics *statistics, NSTimeInterval timestamp, NSTimeInterval expectedInterval);
+
+//writes the counters of the named stream to the log, e.g. when a session stops
+void SensorSequenceLog(NSString *stream, const SensorSequenceStatistics *statistics);
+
+#ifdef __cplusplus
+}
+#endif
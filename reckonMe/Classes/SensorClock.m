@@ -0,0 +1,93 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import "SensorClock.h"
+#import <mach/mach_time.h>
+
+static double secondsPerTick;
+static NSTimeInterval offsetFrom1970;   //added to the uptime to get the timestamp
+
+static void initializeSensorClock(void) {
+    
+    static dispatch_once_t once;
+    
+    dispatch_once(&once, ^(void) {
+        
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = (double) timebase.numer / timebase.denom * 1e-9;
+        
+        //the only look at the wall clock
+        offsetFrom1970 = [[NSDate date] timeIntervalSince1970] - mach_absolute_time() * secondsPerTick;
+    });
+}
+
+NSTimeInterval SensorClockNow(void) {
+    
+    initializeSensorClock();
+    return mach_absolute_time() * secondsPerTick + offsetFrom1970;
+}
+
+NSTimeInterval SensorClockFromUptime(NSTimeInterval uptime) {
+    
+    //CoreMotion's uptime is based on mach_absolute_time() as well
+    initializeSensorClock();
+    return uptime + offsetFrom1970;
+}
+
+NSTimeInterval SensorClockFromDate(NSDate *date) {
+    
+    return SensorClockNow() + [date timeIntervalSinceNow];
+}
+
+BOOL SensorSequenceCheck(SensorSequenceStatistics *statistics, NSTimeInterval timestamp, NSTimeInterval expectedInterval) {
+    
+    if (statistics->received > 0) {
+        
+        NSTimeInterval interval = timestamp - statistics->lastTimestamp;
+        
+        if (interval <= 0) {
+            
+            statistics->outOfOrder++;
+            return NO;
+        }
+        if (expectedInterval > 0 && interval > 1.5 * expectedInterval) {
+            
+            statistics->dropped += (int64_t) (interval / expectedInterval + 0.5) - 1;
+        }
+    }
+    
+    statistics->received++;
+    statistics->lastTimestamp = timestamp;
+    return YES;
+}
+
+void SensorSequenceLog(NSString *stream, const SensorSequenceStatistics *statistics) {
+    
+    NSLog(@"%@: %lld received, %lld dropped, %lld out of order", stream,
+          statistics->received, statistics->dropped, statistics->outOfOrder);
+}
@@ -0,0 +1,129 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import <Foundation/Foundation.h>
+#import "PDRExchange.h"
+
+@class AbstractSensor;
+
+/*
+ * On-disk layout of a sensor recording: a SensorRecordingHeader followed by
+ * "capacity" fixed-size SensorRecords used as a ring, the oldest records are
+ * overwritten once it is full. All values are in the byte order of the device.
+ */
+#define kSensorRecordingMagic "RMSR"
+#define kSensorRecordingVersion 1
+
+typedef enum {
+    
+    SensorRecordDeviceMotion = 1,
+    SensorRecordGPS,
+    SensorRecordCompass
+    
+} SensorRecordType;
+
+typedef struct {
+    
+    double longitude, latitude, altitude;
+    double speed, course;
+    double horizontalAccuracy, verticalAccuracy;
+    NSTimeInterval timestamp;
+    int32_t label;
+    
+} GPSRecord;
+
+typedef struct {
+    
+    double magneticHeading, trueHeading, headingAccuracy;
+    double x, y, z;
+    NSTimeInterval timestamp;
+    int32_t label;
+    
+} CompassRecord;
+
+typedef struct {
+    
+    uint32_t type;  //SensorRecordType
+    uint32_t reserved;
+    union {
+        DeviceMotionSample motion;
+        GPSRecord gps;
+        CompassRecord compass;
+    };
+    
+} SensorRecord;
+
+typedef struct {
+    
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;      //records in the ring
+    uint64_t written;       //records written since creation, the next one goes to written % capacity
+    uint8_t reserved[40];   //pads the header to 64 bytes
+    
+} SensorRecordingHeader;
+
+static inline NSTimeInterval SensorRecordTimestamp(const SensorRecord *record) {
+    
+    switch (record->type) {
+            
+        case SensorRecordDeviceMotion: return record->motion.timestamp;
+        case SensorRecordGPS: return record->gps.timestamp;
+        default: return record->compass.timestamp;
+    }
+}
+
+
+/*
+ * A listener writing everything it receives to a memory mapped ring file,
+ * to be replayed by SensorReplay. It may be added to any number of sensors
+ * and be called from any thread.
+ */
+@interface SensorRecorder : NSObject <SensorListener> {
+    
+    int fileDescriptor;
+    size_t mappedSize;
+    SensorRecordingHeader *header;
+    SensorRecord *records;
+    
+    //serializes the writers, which may be on different sensors' threads
+    dispatch_semaphore_t writeSemaphore;
+}
+
+@property(nonatomic, readonly) NSString *path;
+
+//creates or truncates the file at path, returns nil if it can't be set up
+-(id)initWithPath:(NSString *)path capacity:(NSUInteger)recordCount;
+
+-(void)recordFrom:(AbstractSensor *)sensor;
+-(void)stopRecordingFrom:(AbstractSensor *)sensor;
+
+//pushes what has been written so far to disk
+-(void)flush;
+
+@end
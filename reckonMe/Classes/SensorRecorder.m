@@ -0,0 +1,191 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import "SensorRecorder.h"
+#import "AbstractSensor.h"
+#import "Gyroscope.h"
+#import <sys/mman.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+
+//anonymous category extending the class with "private" methods
+@interface SensorRecorder ()
+
+-(void)appendRecords:(const SensorRecord *)newRecords count:(NSUInteger)count;
+
+@end
+
+
+@implementation SensorRecorder
+
+@synthesize path;
+
+-(id)initWithPath:(NSString *)_path capacity:(NSUInteger)recordCount {
+    
+    self = [super init];
+    
+    if (self != nil) {
+        
+        path = [_path copy];
+        writeSemaphore = dispatch_semaphore_create(1);
+        header = NULL;
+        mappedSize = sizeof(SensorRecordingHeader) + recordCount * sizeof(SensorRecord);
+        
+        fileDescriptor = open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        
+        if (recordCount == 0 || recordCount > UINT32_MAX || fileDescriptor < 0 || ftruncate(fileDescriptor, mappedSize) != 0) {
+            
+            NSLog(@"Unable to create the sensor recording %@.", path);
+            [self release];
+            return nil;
+        }
+        
+        void *mapping = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        
+        if (mapping == MAP_FAILED) {
+            
+            NSLog(@"Unable to map the sensor recording %@.", path);
+            [self release];
+            return nil;
+        }
+        
+        header = mapping;
+        records = (SensorRecord *)(header + 1);
+        
+        memcpy(header->magic, kSensorRecordingMagic, sizeof(header->magic));
+        header->version = kSensorRecordingVersion;
+        header->recordSize = sizeof(SensorRecord);
+        header->capacity = (uint32_t) recordCount;
+        header->written = 0;
+    }
+    
+    return self;
+}
+
+-(void)dealloc {
+    
+    if (header != NULL) {
+        
+        msync(header, mappedSize, MS_SYNC);
+        munmap(header, mappedSize);
+    }
+    if (fileDescriptor >= 0) close(fileDescriptor);
+    
+    dispatch_release(writeSemaphore);
+    [path release];
+    [super dealloc];
+}
+
+-(void)recordFrom:(AbstractSensor *)sensor {
+    
+    [sensor addListener:self];
+}
+
+-(void)stopRecordingFrom:(AbstractSensor *)sensor {
+    
+    [sensor removeListener:self];
+}
+
+-(void)flush {
+    
+    msync(header, mappedSize, MS_ASYNC);
+}
+
+-(void)appendRecords:(const SensorRecord *)newRecords count:(NSUInteger)count {
+    
+    dispatch_semaphore_wait(writeSemaphore, DISPATCH_TIME_FOREVER);
+    
+        for (NSUInteger i = 0; i < count; i++) {
+            
+            records[header->written % header->capacity] = newRecords[i];
+            header->written++;
+        }
+    
+    dispatch_semaphore_signal(writeSemaphore);
+}
+
+#pragma mark -
+#pragma mark SensorListener
+
+-(void)didReceiveDeviceMotionBatch:(const DeviceMotionSample *)samples count:(NSUInteger)count {
+    
+    SensorRecord batch[kMaxDeviceMotionBatchSize];
+    
+    while (count > 0) {
+        
+        NSUInteger n = MIN(count, kMaxDeviceMotionBatchSize);
+        
+        for (NSUInteger i = 0; i < n; i++) {
+            
+            batch[i].type = SensorRecordDeviceMotion;
+            batch[i].reserved = 0;
+            batch[i].motion = samples[i];
+        }
+        [self appendRecords:batch count:n];
+        
+        samples += n;
+        count -= n;
+    }
+}
+
+- (void)didReceiveGPSvalueWithLongitude:(double)longitude latitude:(double)latitude altitude:(double)altitude speed:(double)speed course:(double)course horizontalAccuracy:(double)horizontalAccuracy verticalAccuracy:(double)verticalAccuracy timestamp:(NSTimeInterval)timestamp label:(int)label {
+    
+    SensorRecord record = {0};
+    
+    record.type = SensorRecordGPS;
+    record.gps.longitude = longitude;
+    record.gps.latitude = latitude;
+    record.gps.altitude = altitude;
+    record.gps.speed = speed;
+    record.gps.course = course;
+    record.gps.horizontalAccuracy = horizontalAccuracy;
+    record.gps.verticalAccuracy = verticalAccuracy;
+    record.gps.timestamp = timestamp;
+    record.gps.label = label;
+    
+    [self appendRecords:&record count:1];
+}
+
+- (void)didReceiveCompassValueWithMagneticHeading:(double)magneticHeading trueHeading:(double)trueHeading headingAccuracy:(double)headingAccuracy X:(double)x Y:(double)y Z:(double)z timestamp:(NSTimeInterval)timestamp label:(int)label {
+    
+    SensorRecord record = {0};
+    
+    record.type = SensorRecordCompass;
+    record.compass.magneticHeading = magneticHeading;
+    record.compass.trueHeading = trueHeading;
+    record.compass.headingAccuracy = headingAccuracy;
+    record.compass.x = x;
+    record.compass.y = y;
+    record.compass.z = z;
+    record.compass.timestamp = timestamp;
+    record.compass.label = label;
+    
+    [self appendRecords:&record count:1];
+}
+
+@end
@@ -0,0 +1,69 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import <Foundation/Foundation.h>
+#import "AbstractSensor.h"
+#import "SensorRecorder.h"
+
+//replays as fast as possible
+#define kSensorReplayUnthrottled 0
+
+
+/*
+ * A sensor emitting a recording made by SensorRecorder through the
+ * SensorListener protocol. The recorded timestamps are handed on unchanged,
+ * so the listeners see the same values regardless of the playback speed.
+ * Device motion is delivered on the replay's own queue, like Gyroscope does,
+ * GPS and compass values on the main thread, like CompassAndGPS does.
+ */
+@interface SensorReplay : AbstractSensor {
+    
+    size_t mappedSize;
+    const SensorRecordingHeader *header;
+    const SensorRecord *records;
+    
+    NSUInteger recordCount;
+    NSUInteger firstRecord;     //index of the oldest record in the ring
+    NSUInteger nextRecord;      //position in playback order
+    
+    dispatch_queue_t replayQueue;
+}
+
+//playback speed relative to the recording, 1 for real time, kSensorReplayUnthrottled
+//to deliver without waiting
+@property(nonatomic) double speed;
+
+//called on the main thread once all records have been delivered
+@property(nonatomic, copy) void (^finishedHandler)(void);
+
+//nil if the file is not a valid recording
+-(id)initWithRecording:(NSString *)path;
+
+//starts over with the first record on the next start
+-(void)rewind;
+
+@end
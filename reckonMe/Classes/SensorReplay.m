@@ -0,0 +1,273 @@
+/**
+*	The BSD 2-Clause License (aka "FreeBSD License")
+*
+*	Copyright (c) 2012, Benjamin Thiel, Kamil Kloch
+*	All rights reserved.
+*
+*	Redistribution and use in source and binary forms, with or without
+*	modification, are permitted provided that the following conditions are met: 
+*
+*	1. Redistributions of source code must retain the above copyright notice, this
+*	   list of conditions and the following disclaimer. 
+*	2. Redistributions in binary form must reproduce the above copyright notice,
+*	   this list of conditions and the following disclaimer in the documentation
+*	   and/or other materials provided with the distribution. 
+*
+*	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+*	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+*	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*	DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+*	ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+*	(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*	LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+*	ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+*	(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+*	SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#import "SensorReplay.h"
+#import "Gyroscope.h"
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+//consecutive motion records within this time span are delivered as one batch [s]
+static const NSTimeInterval kReplayBatchDuration = 0.1;
+
+
+//anonymous category extending the class with "private" methods
+@interface SensorReplay ()
+
+-(const SensorRecord *)recordAt:(NSUInteger)position;
+-(void)replay;
+-(void)deliverMotion:(const DeviceMotionSample *)samples count:(NSUInteger)count;
+-(void)deliverLocationRecord:(const SensorRecord *)record;
+
+@end
+
+
+@implementation SensorReplay
+
+@synthesize speed, finishedHandler;
+
+-(id)initWithRecording:(NSString *)path {
+    
+    self = [super init];
+    
+    if (self != nil) {
+        
+        header = NULL;
+        replayQueue = dispatch_queue_create("sensor replay queue", DISPATCH_QUEUE_SERIAL);
+        speed = 1;
+        
+        int fileDescriptor = open([path fileSystemRepresentation], O_RDONLY);
+        struct stat status;
+        
+        if (fileDescriptor >= 0 && fstat(fileDescriptor, &status) == 0 && status.st_size >= (off_t) sizeof(SensorRecordingHeader)) {
+            
+            mappedSize = (size_t) status.st_size;
+            void *mapping = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+            
+            if (mapping != MAP_FAILED) header = mapping;
+        }
+        if (fileDescriptor >= 0) close(fileDescriptor);
+        
+        if (header == NULL
+            || memcmp(header->magic, kSensorRecordingMagic, sizeof(header->magic)) != 0
+            || header->version != kSensorRecordingVersion
+            || header->recordSize != sizeof(SensorRecord)
+            || header->capacity == 0
+            || mappedSize < sizeof(SensorRecordingHeader) + (size_t) header->capacity * sizeof(SensorRecord)) {
+            
+            NSLog(@"%@ is not a sensor recording.", path);
+            [self release];
+            return nil;
+        }
+        
+        records = (const SensorRecord *)(header + 1);
+        recordCount = (NSUInteger) MIN(header->written, (uint64_t) header->capacity);
+        firstRecord = (NSUInteger) ((header->written - recordCount) % header->capacity);
+        nextRecord = 0;
+        
+        isAvailable = YES;
+    }
+    
+    return self;
+}
+
+-(void)dealloc {
+    
+    if (header != NULL) munmap((void *) header, mappedSize);
+    dispatch_release(replayQueue);
+    [finishedHandler release];
+    [super dealloc];
+}
+
+-(const SensorRecord *)recordAt:(NSUInteger)position {
+    
+    return &records[(firstRecord + position) % header->capacity];
+}
+
+-(void)rewind {
+    
+    dispatch_async(replayQueue, ^(void) {
+        
+        nextRecord = 0;
+    });
+}
+
+#pragma mark -
+#pragma mark sensor methods
+
+-(void)actuallyStart {
+    
+    if (isAvailable && !isActive) {
+        
+        isActive = YES;
+        dispatch_async(replayQueue, ^(void) {
+            
+            [self replay];
+        });
+    }
+}
+
+-(void)actuallyStop {
+    
+    //the replay loop notices and returns
+    isActive = NO;
+}
+
+#pragma mark -
+#pragma mark playback
+
+//runs on replayQueue until stopped or through
+-(void)replay {
+    
+    DeviceMotionSample batch[kMaxDeviceMotionBatchSize];
+    double startOfPlayback = SensorClockNow();
+    NSTimeInterval startOfRecording = nextRecord < recordCount ? SensorRecordTimestamp([self recordAt:nextRecord]) : 0;
+    
+    while (isActive && nextRecord < recordCount) {
+        
+        const SensorRecord *record = [self recordAt:nextRecord];
+        NSUInteger batchCount = 0;
+        NSTimeInterval timestamp = SensorRecordTimestamp(record);
+        
+        if (record->type == SensorRecordDeviceMotion) {
+            
+            //gather what the Gyroscope would have delivered at once
+            NSTimeInterval startOfBatch = record->motion.timestamp;
+            
+            while (nextRecord < recordCount && batchCount < kMaxDeviceMotionBatchSize) {
+                
+                record = [self recordAt:nextRecord];
+                
+                if (record->type != SensorRecordDeviceMotion
+                    || record->motion.timestamp - startOfBatch >= kReplayBatchDuration) break;
+                
+                batch[batchCount++] = record->motion;
+                nextRecord++;
+            }
+            timestamp = batch[batchCount - 1].timestamp;
+            
+        } else {
+            
+            nextRecord++;
+        }
+        
+        //hold the value back until it is due at the chosen speed
+        if (speed > 0) {
+            
+            double delay = startOfPlayback + (timestamp - startOfRecording) / speed - SensorClockNow();
+            if (delay > 0) [NSThread sleepForTimeInterval:delay];
+        }
+        
+        if (batchCount > 0) {
+            
+            [self deliverMotion:batch count:batchCount];
+            
+        } else if (record->type == SensorRecordGPS || record->type == SensorRecordCompass) {
+            
+            [self deliverLocationRecord:record];
+        }
+    }
+    
+    if (nextRecord >= recordCount && isActive) {
+        
+        isActive = NO;
+        dispatch_async(dispatch_get_main_queue(), ^(void) {
+            
+            if (finishedHandler) finishedHandler();
+        });
+    }
+}
+
+-(void)deliverMotion:(const DeviceMotionSample *)samples count:(NSUInteger)count {
+    
+    const SensorListenerList *list = [self beginListenerDispatch];
+    
+    for (NSUInteger i = 0; i < list->count; i++) {
+        
+        const SensorListenerEntry *entry = &list->entries[i];
+        
+        if (entry->didReceiveDeviceMotionBatch == NULL) continue;
+        
+        ((DeviceMotionBatchIMP) entry->didReceiveDeviceMotionBatch)(entry->listener,
+                                                                    @selector(didReceiveDeviceMotionBatch:count:),
+                                                                    samples,
+                                                                    count);
+    }
+    
+    [self endListenerDispatch];
+}
+
+-(void)deliverLocationRecord:(const SensorRecord *)record {
+    
+    //synchronously, so the order relative to device motion is kept
+    dispatch_sync(dispatch_get_main_queue(), ^(void) {
+        
+        const SensorListenerList *list = [self beginListenerDispatch];
+        
+        for (NSUInteger i = 0; i < list->count; i++) {
+            
+            const SensorListenerEntry *entry = &list->entries[i];
+            
+            if (record->type == SensorRecordGPS && entry->didReceiveGPSvalue != NULL) {
+                
+                const GPSRecord *gps = &record->gps;
+                
+                ((GPSvalueIMP) entry->didReceiveGPSvalue)(entry->listener,
+                                                          @selector(didReceiveGPSvalueWithLongitude:latitude:altitude:speed:course:horizontalAccuracy:verticalAccuracy:timestamp:label:),
+                                                          gps->longitude,
+                                                          gps->latitude,
+                                                          gps->altitude,
+                                                          gps->speed,
+                                                          gps->course,
+                                                          gps->horizontalAccuracy,
+                                                          gps->verticalAccuracy,
+                                                          gps->timestamp,
+                                                          gps->label);
+                
+            } else if (record->type == SensorRecordCompass && entry->didReceiveCompassValue != NULL) {
+                
+                const CompassRecord *compass = &record->compass;
+                
+                ((CompassValueIMP) entry->didReceiveCompassValue)(entry->listener,
+                                                                  @selector(didReceiveCompassValueWithMagneticHeading:trueHeading:headingAccuracy:X:Y:Z:timestamp:label:),
+                                                                  compass->magneticHeading,
+                                                                  compass->trueHeading,
+                                                                  compass->headingAccuracy,
+                                                                  compass->x,
+                                                                  compass->y,
+                                                                  compass->z,
+                                                                  compass->timestamp,
+                                                                  compass->label);
+            }
+        }
+        
+        [self endListenerDispatch];
+    });
+}
+
+@end
@@ -48,5 +48,7 @@ extern const NSInteger kDefaultRSSI;
 @property (nonatomic) BOOL exchangeEnabled;
 @property (nonatomic) NSInteger rssi;
 @property (nonatomic) BOOL showSatelliteImagery;
+//NO detects the pocket from the motion sensors alone, sparing the camera
+@property (nonatomic) BOOL cameraPocketDetection;
 
 @end
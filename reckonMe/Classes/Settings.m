@@ -40,6 +40,7 @@ const double kDefaultStepLength = 0.8;
 const BOOL kDefaultExchangeEnabled = YES;
 const BOOL kDefaultBeaconMode = NO;
 const BOOL kDefaultShowSatelliteImagery = NO;
+const BOOL kDefaultCameraPocketDetection = YES;
 const NSInteger kDefaultRSSI = -70;
 
 NSString* const kDistanceKey = @"distBetweenEx"; 
@@ -48,6 +49,7 @@ NSString* const kBeaconModeKey = @"beaconMode";
 NSString* const kExchangeEnabledKey = @"exchangeEnabled";
 NSString* const kRSSIKey = @"RSSI";
 NSString* const kSatelliteImageryKey = @"satelliteImagery";
+NSString* const kCameraPocketDetectionKey = @"cameraPocketDetection";
 
 @implementation Settings
 
@@ -57,6 +59,7 @@ NSString* const kSatelliteImageryKey = @"satelliteImagery";
 @dynamic exchangeEnabled;
 @dynamic rssi;
 @dynamic showSatelliteImagery;
+@dynamic cameraPocketDetection;
 
 +(Settings *)sharedInstance {
     
@@ -81,6 +84,7 @@ NSString* const kSatelliteImageryKey = @"satelliteImagery";
                                   [NSNumber numberWithBool:kDefaultBeaconMode], kBeaconModeKey,
                                   [NSNumber numberWithBool:kDefaultExchangeEnabled], kExchangeEnabledKey,
                                   [NSNumber numberWithBool:kDefaultShowSatelliteImagery], kSatelliteImageryKey,
+                                  [NSNumber numberWithBool:kDefaultCameraPocketDetection], kCameraPocketDetectionKey,
                                   [NSNumber numberWithInt:kDefaultRSSI], kRSSIKey,
                                   nil];
         
@@ -133,6 +137,17 @@ NSString* const kSatelliteImageryKey = @"satelliteImagery";
     return [[NSUserDefaults standardUserDefaults] boolForKey:kSatelliteImageryKey];
 }
 
+-(void)setCameraPocketDetection:(BOOL)cameraPocketDetection {
+    
+    [[NSUserDefaults standardUserDefaults] setBool:cameraPocketDetection
+                                            forKey:kCameraPocketDetectionKey];
+}
+
+-(BOOL)cameraPocketDetection {
+    
+    return [[NSUserDefaults standardUserDefaults] boolForKey:kCameraPocketDetectionKey];
+}
+
 -(void)setBeaconMode:(BOOL)beaconMode {
     
     [[NSUserDefaults standardUserDefaults] setBool:beaconMode
@@ -433,3 +433,275 @@ void pj_Convert_Geocentric_To_Geodetic (GeocentricInfo *gi,
     return;
 #endif /* defined(USE_ITERATIVE_METHOD) */
 } /* END OF Convert_Geocentric_To_Geodetic */
+
+
+/***************************************************************************/
+/*
+ *                          BATCH CONVERSIONS
+ *
+ * The batch functions convert arrays of points a block at a time.  Each
+ * block is processed in passes over plain arrays with no data dependent
+ * branches, so the compiler can vectorize them.  Points that need special
+ * handling (poles, huge or non-finite coordinates) are passed to the scalar
+ * functions.
+ */
+
+#define GEOCENT_BATCH     64
+#define GEOCENT_SKIP      1     /* point is HUGE_VAL, left untouched */
+#define GEOCENT_BAD_LAT   2     /* latitude out of range */
+#define GEOCENT_SCALAR    4     /* handled by the scalar function */
+
+/* largest angle geocent_sincos() reduces accurately */
+#define GEOCENT_SINCOS_MAX  1.0e6
+
+/* pi/2 split in three parts for Cody-Waite argument reduction */
+#define PIO2_1   1.57079632673412561417e+00
+#define PIO2_2   6.07710050630396597660e-11
+#define PIO2_3   2.02226624871116645580e-21
+#define TWO_OVER_PI  6.36619772367581382433e-01
+#define ROUND_MAGIC  6755399441055744.0
+
+/*
+ * The function geocent_sincos computes sin and cos of Count angles of at
+ * most GEOCENT_SINCOS_MAX, with the fdlibm minimax kernels on the reduced
+ * argument.  Results are within one ulp of the libm functions.
+ */
+
+static void geocent_sincos (long Count,
+                            const double *Angle,
+                            double *Sin,
+                            double *Cos)
+{
+  long i;
+
+  for (i = 0; i < Count; i++)
+  {
+    /* round to nearest by adding and removing 1.5 * 2^52 */
+    double k = (Angle[i] * TWO_OVER_PI + ROUND_MAGIC) - ROUND_MAGIC;
+    int    q = (int) k & 3;                  /* quadrant */
+    double r = ((Angle[i] - k * PIO2_1) - k * PIO2_2) - k * PIO2_3;
+    double z = r * r;
+    double s, c, hz, w;
+
+    s = r + z * r * (-1.66666666666666324348e-01
+          + z * (8.33333333332248946124e-03
+          + z * (-1.98412698298579493134e-04
+          + z * (2.75573137070700676789e-06
+          + z * (-2.50507602534068634195e-08
+          + z * 1.58969099521155010221e-10)))));
+
+    hz = 0.5 * z;
+    w = 1.0 - hz;
+    c = w + (((1.0 - w) - hz) + z * z * (4.16666666666666019037e-02
+          + z * (-1.38888888888741095749e-03
+          + z * (2.48015872894767294178e-05
+          + z * (-2.75573143513906633035e-07
+          + z * (2.08757232129817482790e-09
+          + z * -1.13596475577881948265e-11))))));
+
+    Sin[i] = (q == 0) ? s : (q == 1) ? c : (q == 2) ? -s : -c;
+    Cos[i] = (q == 0) ? c : (q == 1) ? -s : (q == 2) ? -c : s;
+  }
+}
+
+
+long pj_Convert_Geodetic_To_Geocentric_Batch (GeocentricInfo *gi,
+                                              long Count,
+                                              const double *Latitude,
+                                              const double *Longitude,
+                                              const double *Height,
+                                              double *X,
+                                              double *Y,
+                                              double *Z)
+{ /* BEGIN Convert_Geodetic_To_Geocentric_Batch */
+/*
+ * The function Convert_Geodetic_To_Geocentric_Batch converts Count points
+ * as Convert_Geodetic_To_Geocentric does.  The output arrays may be the
+ * same as the input arrays.  Points whose Longitude is HUGE_VAL are
+ * skipped, points in error get X and Y set to HUGE_VAL.  The error codes
+ * of all points are combined.
+ */
+  long Error_Code = GEOCENT_NO_ERROR;
+  long start;
+
+  for (start = 0; start < Count; start += GEOCENT_BATCH)
+  {
+    double lat[GEOCENT_BATCH], lon[GEOCENT_BATCH], hgt[GEOCENT_BATCH];
+    double sin_lat[GEOCENT_BATCH], cos_lat[GEOCENT_BATCH];
+    double sin_lon[GEOCENT_BATCH], cos_lon[GEOCENT_BATCH];
+    double x[GEOCENT_BATCH], y[GEOCENT_BATCH], z[GEOCENT_BATCH];
+    int state[GEOCENT_BATCH];
+    int n = (Count - start < GEOCENT_BATCH) ? (int) (Count - start) : GEOCENT_BATCH;
+    int i;
+
+    /* range checks, as in Convert_Geodetic_To_Geocentric */
+    for (i = 0; i < n; i++)
+    {
+      double Lat = Latitude[start+i];
+      double Lon = Longitude[start+i];
+      int skip = (Lon == HUGE_VAL);
+      int bad;
+
+      Lat = (Lat < -PI_OVER_2 && Lat > -1.001 * PI_OVER_2) ? -PI_OVER_2 : Lat;
+      Lat = (Lat > PI_OVER_2 && Lat < 1.001 * PI_OVER_2) ? PI_OVER_2 : Lat;
+      bad = (Lat < -PI_OVER_2) || (Lat > PI_OVER_2);
+      Lon = (Lon > PI) ? Lon - (2*PI) : Lon;
+
+      /* NaN and infinities must not reach geocent_sincos() */
+      state[i] = skip ? GEOCENT_SKIP
+               : bad ? GEOCENT_BAD_LAT
+               : (Lat != Lat || !(fabs(Lon) <= GEOCENT_SINCOS_MAX)) ? GEOCENT_SCALAR : 0;
+      lat[i] = state[i] ? 0.0 : Lat;
+      lon[i] = state[i] ? 0.0 : Lon;
+      hgt[i] = Height[start+i];
+    }
+
+    geocent_sincos( n, lat, sin_lat, cos_lat );
+    geocent_sincos( n, lon, sin_lon, cos_lon );
+
+    for (i = 0; i < n; i++)
+    {
+      double Rn = gi->Geocent_a 
+        / (sqrt(1.0e0 - gi->Geocent_e2 * (sin_lat[i] * sin_lat[i])));
+
+      x[i] = (Rn + hgt[i]) * cos_lat[i] * cos_lon[i];
+      y[i] = (Rn + hgt[i]) * cos_lat[i] * sin_lon[i];
+      z[i] = ((Rn * (1 - gi->Geocent_e2)) + hgt[i]) * sin_lat[i];
+    }
+
+    /* store, all inputs of the block have been read */
+    for (i = 0; i < n; i++)
+    {
+      long io = start + i;
+
+      if (state[i] == 0)
+      {
+        X[io] = x[i];
+        Y[io] = y[i];
+        Z[io] = z[i];
+      }
+      else if (state[i] == GEOCENT_BAD_LAT)
+      {
+        Error_Code |= GEOCENT_LAT_ERROR;
+        X[io] = Y[io] = HUGE_VAL;
+      }
+      else if (state[i] == GEOCENT_SCALAR)
+      {
+        double Lat = Latitude[io], Lon = Longitude[io];
+
+        if (pj_Convert_Geodetic_To_Geocentric( gi, Lat, Lon, hgt[i], 
+                                               X+io, Y+io, Z+io ) != 0)
+        {
+          Error_Code |= GEOCENT_LAT_ERROR;
+          X[io] = Y[io] = HUGE_VAL;
+        }
+      }
+    }
+  }
+
+  return (Error_Code);
+} /* END OF Convert_Geodetic_To_Geocentric_Batch */
+
+
+void pj_Convert_Geocentric_To_Geodetic_Batch (GeocentricInfo *gi,
+                                              long Count,
+                                              const double *X,
+                                              const double *Y,
+                                              const double *Z,
+                                              double *Latitude,
+                                              double *Longitude,
+                                              double *Height)
+{ /* BEGIN Convert_Geocentric_To_Geodetic_Batch */
+/*
+ * The function Convert_Geocentric_To_Geodetic_Batch converts Count points
+ * as Convert_Geocentric_To_Geodetic does, running the iteration for all
+ * points of a block together until each has converged.  A point stops
+ * updating at the same iteration as in the scalar function.  The output
+ * arrays may be the same as the input arrays.  Points whose X is
+ * HUGE_VAL are skipped.
+ */
+  double e2 = gi->Geocent_e2;
+  long start;
+
+  for (start = 0; start < Count; start += GEOCENT_BATCH)
+  {
+    double x[GEOCENT_BATCH], y[GEOCENT_BATCH], z[GEOCENT_BATCH];
+    double P[GEOCENT_BATCH], CT[GEOCENT_BATCH], ST[GEOCENT_BATCH];
+    double CPHI0[GEOCENT_BATCH], SPHI0[GEOCENT_BATCH], H[GEOCENT_BATCH];
+    int state[GEOCENT_BATCH], done[GEOCENT_BATCH];
+    int n = (Count - start < GEOCENT_BATCH) ? (int) (Count - start) : GEOCENT_BATCH;
+    int i, iter;
+
+    /* starting values, as in Convert_Geocentric_To_Geodetic */
+    for (i = 0; i < n; i++)
+    {
+      double RR, RX;
+
+      x[i] = X[start+i];
+      y[i] = Y[start+i];
+      z[i] = Z[start+i];
+
+      state[i] = (x[i] == HUGE_VAL) ? GEOCENT_SKIP : 0;
+      x[i] = state[i] ? 1.0 : x[i];
+
+      P[i] = sqrt(x[i]*x[i]+y[i]*y[i]);
+      RR = sqrt(x[i]*x[i]+y[i]*y[i]+z[i]*z[i]);
+      state[i] |= (P[i]/gi->Geocent_a < genau) ? GEOCENT_SCALAR : 0;
+
+      CT[i] = z[i]/RR;
+      ST[i] = P[i]/RR;
+      RX = 1.0/sqrt(1.0-e2*(2.0-e2)*ST[i]*ST[i]);
+      CPHI0[i] = ST[i]*(1.0-e2)*RX;
+      SPHI0[i] = CT[i]*RX;
+      H[i] = 0.0;
+      done[i] = state[i] != 0;
+    }
+
+    for (iter = 0; iter < maxiter; iter++)
+    {
+      int active = 0;
+
+      for (i = 0; i < n; i++)
+      {
+        double RN, Ht, RK, RX, CPHI, SPHI, SDPHI;
+        int update = !done[i];
+
+        RN = gi->Geocent_a/sqrt(1.0-e2*SPHI0[i]*SPHI0[i]);
+        Ht = P[i]*CPHI0[i]+z[i]*SPHI0[i]-RN*(1.0-e2*SPHI0[i]*SPHI0[i]);
+        RK = e2*RN/(RN+Ht);
+        RX = 1.0/sqrt(1.0-RK*(2.0-RK)*ST[i]*ST[i]);
+        CPHI = ST[i]*(1.0-RK)*RX;
+        SPHI = CT[i]*RX;
+        SDPHI = SPHI*CPHI0[i]-CPHI*SPHI0[i];
+
+        H[i] = update ? Ht : H[i];
+        CPHI0[i] = update ? CPHI : CPHI0[i];
+        SPHI0[i] = update ? SPHI : SPHI0[i];
+        done[i] = done[i] || !(SDPHI*SDPHI > genau2);
+        active += !done[i];
+      }
+
+      if (!active)
+        break;
+    }
+
+    /* store, all inputs of the block have been read */
+    for (i = 0; i < n; i++)
+    {
+      long io = start + i;
+
+      if (state[i] == 0)
+      {
+        Longitude[io] = atan2(y[i],x[i]);
+        Latitude[io] = atan(SPHI0[i]/fabs(CPHI0[i]));
+        Height[io] = H[i];
+      }
+      else if (state[i] == GEOCENT_SCALAR)
+      {
+        pj_Convert_Geocentric_To_Geodetic( gi, x[i], y[i], z[i],
+                                           Latitude+io, Longitude+io, 
+                                           Height+io );
+      }
+    }
+  }
+} /* END OF Convert_Geocentric_To_Geodetic_Batch */
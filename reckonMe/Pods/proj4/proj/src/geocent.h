@@ -172,6 +172,38 @@ void pj_Convert_Geocentric_To_Geodetic (GeocentricInfo *gi,
  */
 
 
+long pj_Convert_Geodetic_To_Geocentric_Batch (GeocentricInfo *gi,
+                                              long Count,
+                                              const double *Latitude,
+                                              const double *Longitude,
+                                              const double *Height,
+                                              double *X,
+                                              double *Y,
+                                              double *Z);
+/*
+ * The function Convert_Geodetic_To_Geocentric_Batch converts Count points
+ * like Convert_Geodetic_To_Geocentric, a block of points at a time.  The
+ * output arrays may be the same as the input arrays.  Points with a
+ * Longitude of HUGE_VAL are skipped, points in error get X and Y set to
+ * HUGE_VAL, and the error codes of all points are combined.
+ */
+
+
+void pj_Convert_Geocentric_To_Geodetic_Batch (GeocentricInfo *gi,
+                                              long Count,
+                                              const double *X,
+                                              const double *Y,
+                                              const double *Z,
+                                              double *Latitude,
+                                              double *Longitude,
+                                              double *Height);
+/*
+ * The function Convert_Geocentric_To_Geodetic_Batch converts Count points
+ * like Convert_Geocentric_To_Geodetic, a block of points at a time.  The
+ * output arrays may be the same as the input arrays.  Points with an X of
+ * HUGE_VAL are skipped.
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,9 @@
 #define PJ_MAX_DIMENSION 100
 /* The PJ_MAX_DIMENSION value appears also in quoted strings.
    Please perform a search-and-replace if this value is changed. */
+#define PJ_DIRECT_BLOCK 512
+/* Number of points converted and transformed at once by transformDirect,
+   small enough for the block to stay in the CPU cache in between. */
 
 PJ_CVSID("$Id: jniproj.c 2095 2011-09-02 08:44:02Z desruisseaux $");
 
@@ -411,6 +414,115 @@ JNIEXPORT void JNICALL Java_org_proj4_PJ_transform
     }
 }
 
+/*!
+ * \brief
+ * Transforms in-place the coordinates in a block-wise manner, converting the angular ordinates
+ * of each block just before and after its transformation while the block is still in cache.
+ * Stops at the first block that fails.
+ *
+ * \param src_pj    - The source CRS.
+ * \param dst_pj    - The target CRS.
+ * \param x         - The first coordinate to transform.
+ * \param numPts    - Number of points to transform.
+ * \param dimension - Dimension of points in the coordinate array.
+ * \return The pj_transform error code of the failed block, or 0.
+ */
+static int transformBlocks(PJ *src_pj, PJ *dst_pj, double *x, jint numPts, int dimension) {
+    jint done, count;
+    for (done = 0; done < numPts; done += count) {
+        double *block = x + (long) done * dimension;
+        int err;
+        count = numPts - done;
+        if (count > PJ_DIRECT_BLOCK) {
+            count = PJ_DIRECT_BLOCK;
+        }
+        convertAngularOrdinates(src_pj, block, count, dimension, M_PI/180);
+        err = pj_transform(src_pj, dst_pj, count, dimension, block, block + 1,
+                           (dimension >= 3) ? block + 2 : NULL);
+        convertAngularOrdinates(dst_pj, block, count, dimension, 180/M_PI);
+        if (err) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * \brief
+ * Transforms in-place the coordinates in the given direct buffer, without copying them.
+ * Each invocation works on its own context and clones of the PJ structures, so different
+ * threads can transform disjoint ranges of the same buffer concurrently. Projections which
+ * can not be cloned are transformed under the global Proj.4 lock instead.
+ *
+ * \param env         - The JNI environment.
+ * \param object      - The Java object wrapping the PJ structure (not allowed to be NULL).
+ * \param target      - The target CRS.
+ * \param dimension   - The dimension of each coordinate value. Must be equals or greater than 2.
+ * \param coordinates - A direct buffer in native byte order with the coordinates to transform,
+ *                      as a sequence of (x,y,<z>,...) tuples of doubles.
+ * \param offset      - Index of the first coordinate in the buffer, counted in doubles.
+ * \param numPts      - Number of points to transform.
+ */
+JNIEXPORT void JNICALL Java_org_proj4_PJ_transformDirect
+  (JNIEnv *env, jobject object, jobject target, jint dimension, jobject coordinates, jint offset, jint numPts)
+{
+    if (!target || !coordinates) {
+        jclass c = (*env)->FindClass(env, "java/lang/NullPointerException");
+        if (c) (*env)->ThrowNew(env, c, "The target CRS and the coordinates buffer can not be null.");
+        return;
+    }
+    if (dimension < 2 || dimension > PJ_MAX_DIMENSION) { /* Arbitrary upper value for catching potential misuse. */
+        jclass c = (*env)->FindClass(env, "java/lang/IllegalArgumentException");
+        if (c) (*env)->ThrowNew(env, c, "Illegal dimension. Must be in the [2-100] range.");
+        return;
+    }
+    double *data = (*env)->GetDirectBufferAddress(env, coordinates);
+    if (!data || ((size_t) data) % sizeof(double) != 0) {
+        jclass c = (*env)->FindClass(env, "java/lang/IllegalArgumentException");
+        if (c) (*env)->ThrowNew(env, c, "The coordinates must be in a direct buffer aligned on doubles.");
+        return;
+    }
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, coordinates) / (jlong) sizeof(double);
+    if ((offset < 0) || (numPts < 0) || (offset + (jlong) dimension*numPts) > capacity) {
+        jclass c = (*env)->FindClass(env, "java/lang/IndexOutOfBoundsException");
+        if (c) (*env)->ThrowNew(env, c, "Illegal offset or illegal number of points.");
+        return;
+    }
+    PJ *src_pj = getPJ(env, object);
+    PJ *dst_pj = getPJ(env, target);
+    if (src_pj && dst_pj) {
+        int err;
+        if (pj_can_clone_pj(src_pj) && pj_can_clone_pj(dst_pj)) {
+            /* pj_transform writes errors and lazily loaded grid lists to the PJ
+               structures and their context, hence private copies of both. */
+            projCtx_t ctx = *src_pj->ctx;
+            ctx.last_errno = 0;
+            PJ *src_clone = pj_clone_pj(&ctx, src_pj);
+            PJ *dst_clone = pj_clone_pj(&ctx, dst_pj);
+            if (!src_clone || !dst_clone) {
+                pj_free(src_clone);
+                pj_free(dst_clone);
+                jclass c = (*env)->FindClass(env, "java/lang/OutOfMemoryError");
+                if (c) (*env)->ThrowNew(env, c, "Can not copy the PJ structures.");
+                return;
+            }
+            err = transformBlocks(src_clone, dst_clone, data + offset, numPts, dimension);
+            pj_free(src_clone);
+            pj_free(dst_clone);
+            /* The error is only reported by the exception below, the shared
+               context of src_pj is not written by concurrent callers. */
+        } else {
+            pj_acquire_lock();
+            err = transformBlocks(src_pj, dst_pj, data + offset, numPts, dimension);
+            pj_release_lock();
+        }
+        if (err) {
+            jclass c = (*env)->FindClass(env, "org/proj4/PJException");
+            if (c) (*env)->ThrowNew(env, c, pj_strerrno(err));
+        }
+    }
+}
+
 /*!
  * \brief
  * Returns a description of the last error that occurred, or NULL if none.
@@ -66,3 +66,113 @@ nad_cvt(LP in, int inverse, struct CTABLE *ct) {
 	}
 	return in;
 }
+/* Batch form of nad_cvt(), shifting n points of lam/phi in place, with
+** the same results point for point.  Points are taken NAD_BATCH at a time
+** through nad_intr_batch(); for the inverse, each round of the fixed
+** point iteration only interpolates the points still iterating.
+*/
+	void
+nad_cvt_batch(double *lam, double *phi, long n, int inverse, struct CTABLE *ct) {
+	double tb_lam[NAD_BATCH], tb_phi[NAD_BATCH];
+	double t_lam[NAD_BATCH], t_phi[NAD_BATCH];
+	double a_lam[NAD_BATCH], a_phi[NAD_BATCH];
+	double d_lam[NAD_BATCH], d_phi[NAD_BATCH];
+	int try_left[NAD_BATCH], active[NAD_BATCH];
+	long base;
+	int i, m, nb;
+
+	for (base = 0; base < n; base += NAD_BATCH) {
+		double *in_lam = lam + base, *in_phi = phi + base;
+
+		nb = n - base < NAD_BATCH ? (int)(n - base) : NAD_BATCH;
+
+		/* normalize input to ll origin */
+		for (i = 0; i < nb; ++i) {
+			if (in_lam[i] == HUGE_VAL) {
+				tb_lam[i] = tb_phi[i] = 0.;
+				continue;
+			}
+			tb_lam[i] = adjlon(in_lam[i] - ct->ll.lam - PI) + PI;
+			tb_phi[i] = in_phi[i] - ct->ll.phi;
+		}
+		nad_intr_batch(ct, 2, nb, tb_lam, tb_phi, t_lam, t_phi);
+
+		if (!inverse) {
+			for (i = 0; i < nb; ++i) {
+				if (in_lam[i] == HUGE_VAL)
+					continue;
+				if (t_lam[i] == HUGE_VAL)
+					in_lam[i] = in_phi[i] = HUGE_VAL;
+				else {
+					in_lam[i] -= t_lam[i];
+					in_phi[i] += t_phi[i];
+				}
+			}
+			continue;
+		}
+
+		m = 0;
+		for (i = 0; i < nb; ++i) {
+			try_left[i] = MAX_TRY;
+			active[i] = in_lam[i] != HUGE_VAL && t_lam[i] != HUGE_VAL;
+			if (active[i]) {
+				t_lam[i] = tb_lam[i] + t_lam[i];
+				t_phi[i] = tb_phi[i] - t_phi[i];
+				++m;
+			}
+		}
+
+		while (m > 0) {
+			int k;
+
+			/* interpolate the points still iterating, packed together */
+			for (i = k = 0; i < nb; ++i)
+				if (active[i]) {
+					a_lam[k] = t_lam[i];
+					a_phi[k++] = t_phi[i];
+				}
+			nad_intr_batch(ct, 2, m, a_lam, a_phi, d_lam, d_phi);
+
+			for (i = k = 0; i < nb; ++i) {
+				double dif_lam, dif_phi;
+
+				if (!active[i])
+					continue;
+				if (d_lam[k] == HUGE_VAL) {
+					/* first approximation, see nad_cvt() */
+					if( getenv( "PROJ_DEBUG" ) != NULL )
+						fprintf( stderr, 
+								 "Inverse grid shift iteration failed, presumably at grid edge.\n"
+								 "Using first approximation.\n" );
+					active[i] = 0;
+					++k;
+					continue;
+				}
+				t_lam[i] -= dif_lam = t_lam[i] - d_lam[k] - tb_lam[i];
+				t_phi[i] -= dif_phi = t_phi[i] + d_phi[k] - tb_phi[i];
+				++k;
+				active[i] = try_left[i]-- && fabs(dif_lam) > TOL
+					&& fabs(dif_phi) > TOL;
+			}
+
+			for (i = m = 0; i < nb; ++i)
+				m += active[i];
+		}
+
+		for (i = 0; i < nb; ++i) {
+			if (in_lam[i] == HUGE_VAL)
+				continue;
+			if (t_lam[i] == HUGE_VAL)
+				in_lam[i] = in_phi[i] = HUGE_VAL;
+			else if (try_left[i] < 0) {
+				if( getenv( "PROJ_DEBUG" ) != NULL )
+					fprintf( stderr, 
+							 "Inverse grid shift iterator failed to converge.\n" );
+				in_lam[i] = in_phi[i] = HUGE_VAL;
+			} else {
+				in_lam[i] = adjlon(t_lam[i] + ct->ll.lam);
+				in_phi[i] = t_phi[i] + ct->ll.phi;
+			}
+		}
+	}
+}
@@ -34,6 +34,14 @@
 #include <errno.h>
 #include <string.h>
 
+#if defined(__SSSE3__)
+#  include <tmmintrin.h>
+#  define NAD_SWAP_SSSE3
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define NAD_SWAP_NEON
+#endif
+
 #ifdef _WIN32_WCE
 /* assert.h includes all Windows API headers and causes 'LP' name clash.
  * Here assert we disable assert() for Windows CE.
@@ -45,34 +53,94 @@
 #endif /* _WIN32_WCE */
 
 /************************************************************************/
-/*                             swap_words()                             */
+/*                           nad_swap_words()                           */
 /*                                                                      */
-/*      Convert the byte order of the given word(s) in place.           */
+/*      Convert the byte order of the given word(s) in place.  Shared   */
+/*      by the loaders of all grid formats.  Words of 2, 4 and 8 bytes  */
+/*      are swapped 16 bytes at a time with a byte shuffle where the    */
+/*      target has one (SSSE3 or NEON).                                 */
 /************************************************************************/
 
 static int  byte_order_test = 1;
 #define IS_LSB	(((unsigned char *) (&byte_order_test))[0] == 1)
 
-static void swap_words( void *data_in, int word_size, int word_count )
+void nad_swap_words( void *data_in, int word_size, long word_count )
 
 {
-    int	word;
     unsigned char *data = (unsigned char *) data_in;
+    size_t i = 0, size = (size_t) word_size * word_count;
+
+#if defined(NAD_SWAP_SSSE3)
+    if( word_size == 2 || word_size == 4 || word_size == 8 )
+    {
+        static const unsigned char shuffles[3][16] = {
+            { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+            { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+            { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 } };
+        __m128i shuffle = 
+            _mm_loadu_si128( (const __m128i *) shuffles[word_size / 4] );
+
+        for( ; i + 16 <= size; i += 16 )
+            _mm_storeu_si128( (__m128i *) (data + i),
+                              _mm_shuffle_epi8( 
+                                  _mm_loadu_si128( (__m128i *) (data + i) ),
+                                  shuffle ) );
+    }
+#elif defined(NAD_SWAP_NEON)
+    if( word_size == 2 )
+        for( ; i + 16 <= size; i += 16 )
+            vst1q_u8( data + i, vrev16q_u8( vld1q_u8( data + i ) ) );
+    else if( word_size == 4 )
+        for( ; i + 16 <= size; i += 16 )
+            vst1q_u8( data + i, vrev32q_u8( vld1q_u8( data + i ) ) );
+    else if( word_size == 8 )
+        for( ; i + 16 <= size; i += 16 )
+            vst1q_u8( data + i, vrev64q_u8( vld1q_u8( data + i ) ) );
+#endif
+
+    /* the same with constant word sizes, which compilers vectorize */
+    if( word_size == 4 )
+    {
+        for( ; i < size; i += 4 )
+        {
+            unsigned char t0 = data[i], t1 = data[i+1];
+
+            data[i] = data[i+3];
+            data[i+1] = data[i+2];
+            data[i+2] = t1;
+            data[i+3] = t0;
+        }
+    }
+    else if( word_size == 8 )
+    {
+        for( ; i < size; i += 8 )
+        {
+            unsigned char t0 = data[i], t1 = data[i+1];
+            unsigned char t2 = data[i+2], t3 = data[i+3];
+
+            data[i] = data[i+7];
+            data[i+1] = data[i+6];
+            data[i+2] = data[i+5];
+            data[i+3] = data[i+4];
+            data[i+4] = t3;
+            data[i+5] = t2;
+            data[i+6] = t1;
+            data[i+7] = t0;
+        }
+    }
 
-    for( word = 0; word < word_count; word++ )
+    for( ; i < size; i += word_size )
     {
-        int	i;
+        int	j;
         
-        for( i = 0; i < word_size/2; i++ )
+        for( j = 0; j < word_size/2; j++ )
         {
             int	t;
             
-            t = data[i];
-            data[i] = data[word_size-i-1];
-            data[word_size-i-1] = t;
+            t = data[i+j];
+            data[i+j] = data[i+word_size-j-1];
+            data[i+word_size-j-1] = t;
         }
-        
-        data += word_size;
     }
 }
 
@@ -183,7 +251,7 @@ int nad_ctable2_load( projCtx ctx, struct CTABLE *ct, FILE *fid )
 
     if( !IS_LSB )
     {
-        swap_words( ct->cvs, 4, a_size * 2 );
+        nad_swap_words( ct->cvs, 4, a_size * 2 );
     }
 
     return 1;
@@ -209,8 +277,8 @@ struct CTABLE *nad_ctable2_init( projCtx ctx, FILE * fid )
 
     if( !IS_LSB )
     {
-        swap_words( header +  96, 8, 4 );
-        swap_words( header + 128, 4, 2 );
+        nad_swap_words( header +  96, 8, 4 );
+        nad_swap_words( header + 128, 4, 2 );
     }
 
     if( strncmp(header,"CTABLE V2",9) != 0 )
@@ -60,3 +60,89 @@ nad_intr(LP t, struct CTABLE *ct) {
 			  m01 * f01->phi + m11 * f11->phi;
 	return val;
 }
+/* Batch form of nad_intr() for n <= NAD_BATCH points, given relative to
+** the table origin.  Gives HUGE_VAL wherever nad_intr() would.  bands is
+** 2 for tables of FLP and 1 for tables of single floats (vertical grids),
+** for which only val_lam is set.  The loops are kept free of branches and
+** calls so that the compiler can run them in vector lanes, and the corner
+** values are fetched only once for runs of points in the same cell.
+*/
+	void
+nad_intr_batch(struct CTABLE *ct, int bands, int n, const double *t_lam,
+		const double *t_phi, double *val_lam, double *val_phi) {
+	double frct_lam[NAD_BATCH], frct_phi[NAD_BATCH];
+	double f00_lam[NAD_BATCH], f10_lam[NAD_BATCH],
+		   f01_lam[NAD_BATCH], f11_lam[NAD_BATCH];
+	double f00_phi[NAD_BATCH], f10_phi[NAD_BATCH],
+		   f01_phi[NAD_BATCH], f11_phi[NAD_BATCH];
+	long index[NAD_BATCH];
+	char ok[NAD_BATCH];
+	const double lim_lam = ct->lim.lam, lim_phi = ct->lim.phi;
+	int i;
+
+	/* cell indices, with the same edge handling as nad_intr() */
+	for (i = 0; i < n; ++i) {
+		double x = t_lam[i] / ct->del.lam, y = t_phi[i] / ct->del.phi;
+		double ix = floor(x), iy = floor(y);
+		double fx = x - ix, fy = y - iy;
+		int lo_x = ix == -1. && fx > 0.99999999999;
+		int hi_x = ix + 1. == lim_lam && fx < 1e-11;
+		int lo_y = iy == -1. && fy > 0.99999999999;
+		int hi_y = iy + 1. == lim_phi && fy < 1e-11;
+
+		ix = lo_x ? 0. : hi_x ? ix - 1. : ix;
+		fx = lo_x ? 0. : hi_x ? 1. : fx;
+		iy = lo_y ? 0. : hi_y ? iy - 1. : iy;
+		fy = lo_y ? 0. : hi_y ? 1. : fy;
+		ok[i] = ix >= 0. && ix + 1. < lim_lam && iy >= 0. && iy + 1. < lim_phi;
+		index[i] = ok[i] ? (long)iy * ct->lim.lam + (long)ix : 0;
+		frct_lam[i] = fx;
+		frct_phi[i] = fy;
+	}
+
+	/* fetch the corners */
+	for (i = 0; i < n; ++i) {
+		long j = index[i];
+
+		if (i > 0 && j == index[i - 1]) {
+			f00_lam[i] = f00_lam[i - 1]; f10_lam[i] = f10_lam[i - 1];
+			f01_lam[i] = f01_lam[i - 1]; f11_lam[i] = f11_lam[i - 1];
+			f00_phi[i] = f00_phi[i - 1]; f10_phi[i] = f10_phi[i - 1];
+			f01_phi[i] = f01_phi[i - 1]; f11_phi[i] = f11_phi[i - 1];
+		} else if (bands == 1) {
+			const float *cv = (const float *)ct->cvs;
+
+			f00_lam[i] = cv[j];
+			f10_lam[i] = cv[j + 1];
+			f01_lam[i] = cv[j + ct->lim.lam];
+			f11_lam[i] = cv[j + ct->lim.lam + 1];
+			f00_phi[i] = f10_phi[i] = f01_phi[i] = f11_phi[i] = 0.;
+		} else {
+			const FLP *cv = ct->cvs;
+
+			f00_lam[i] = cv[j].lam; f00_phi[i] = cv[j].phi;
+			f10_lam[i] = cv[j + 1].lam; f10_phi[i] = cv[j + 1].phi;
+			j += ct->lim.lam;
+			f01_lam[i] = cv[j].lam; f01_phi[i] = cv[j].phi;
+			f11_lam[i] = cv[j + 1].lam; f11_phi[i] = cv[j + 1].phi;
+		}
+	}
+
+	/* blend, in the same order of operations as nad_intr() */
+	for (i = 0; i < n; ++i) {
+		double m00, m10, m01, m11, rphi;
+
+		m11 = m10 = frct_lam[i];
+		m00 = m01 = 1. - frct_lam[i];
+		m11 *= frct_phi[i];
+		m01 *= frct_phi[i];
+		rphi = 1. - frct_phi[i];
+		m00 *= rphi;
+		m10 *= rphi;
+		val_lam[i] = ok[i] ? m00 * f00_lam[i] + m10 * f10_lam[i] +
+			m01 * f01_lam[i] + m11 * f11_lam[i] : HUGE_VAL;
+		if (bands == 2)
+			val_phi[i] = ok[i] ? m00 * f00_phi[i] + m10 * f10_phi[i] +
+				m01 * f01_phi[i] + m11 * f11_phi[i] : HUGE_VAL;
+	}
+}
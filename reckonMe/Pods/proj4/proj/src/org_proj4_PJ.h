@@ -105,6 +105,14 @@ JNIEXPORT jdouble JNICALL Java_org_proj4_PJ_getLinearUnitToMetre
 JNIEXPORT void JNICALL Java_org_proj4_PJ_transform
   (JNIEnv *, jobject, jobject, jint, jdoubleArray, jint, jint);
 
+/*
+ * Class:     org_proj4_PJ
+ * Method:    transformDirect
+ * Signature: (Lorg/proj4/PJ;ILjava/nio/ByteBuffer;II)V
+ */
+JNIEXPORT void JNICALL Java_org_proj4_PJ_transformDirect
+  (JNIEnv *, jobject, jobject, jint, jobject, jint, jint);
+
 /*
  * Class:     org_proj4_PJ
  * Method:    getLastError
@@ -71,13 +71,73 @@ int pj_apply_gridshift( projCtx ctx, const char *nadgrids, int inverse,
     return ret;
 }
 
+/************************************************************************/
+/*                          pj_prewarm_grids()                          */
+/*                                                                      */
+/*      Load the grids (or with ntv2 files, the subgrids) of a grid     */
+/*      list that cover the area from lam_min,phi_min to lam_max,       */
+/*      phi_max in radians, say the area a session will take place      */
+/*      in, so that transforms there don't have to wait for them.       */
+/*      Grids not covering the area are left unloaded.                  */
+/************************************************************************/
+
+int pj_prewarm_grids( projCtx ctx, const char *nadgrids, 
+                      double lam_min, double phi_min, 
+                      double lam_max, double phi_max )
+
+{
+    PJ_GRIDINFO **gridlist;
+    int           grid_count, i;
+    LP            ll, ur;
+    
+    gridlist = pj_gridlist_from_nadgrids( ctx, nadgrids, &grid_count );
+
+    if( gridlist == NULL || grid_count == 0 )
+        return ctx->last_errno;
+
+    ll.lam = lam_min;
+    ll.phi = phi_min;
+    ur.lam = lam_max;
+    ur.phi = phi_max;
+
+    ctx->last_errno = 0;
+    for( i = 0; i < grid_count; i++ )
+    {
+        if( !pj_gridinfo_prewarm( ctx, gridlist[i], ll, ur ) )
+        {
+            if( ctx->last_errno == 0 )
+                pj_ctx_set_errno( ctx, -38 );
+            break;
+        }
+    }
+
+    pj_dalloc( gridlist );
+
+    return ctx->last_errno;
+}
+
+/*
+** Building an index costs about two grid tests per grid and bucket.  A
+** temporary one gets at most one bucket per point and grid, so building it
+** costs no more than a short linear search per point.  With fewer than
+** PJ_GRIDINDEX_MIN_GRIDS grids (children included) the linear search is
+** short anyway.
+*/
+#define PJ_GRIDINDEX_MIN_GRIDS  8
+
+static int pj_apply_gridshift_indexed( projCtx ctx, 
+                                       PJ_GRIDINFO **tables, int grid_count,
+                                       PJ_GRIDINDEX *index, int inverse, 
+                                       long point_count, int point_offset,
+                                       double *x, double *y, double *z );
+
 /************************************************************************/
 /*                        pj_apply_gridshift_2()                        */
 /*                                                                      */
 /*      This implmentation takes uses the gridlist from a coordinate    */
 /*      system definition.  If the gridlist has not yet been            */
 /*      populated in the coordinate system definition we set it up      */
-/*      now.                                                            */
+/*      now, along with the index used to find grids quickly.           */
 /************************************************************************/
 
 int pj_apply_gridshift_2( PJ *defn, int inverse, 
@@ -95,17 +155,23 @@ int pj_apply_gridshift_2( PJ *defn, int inverse,
         if( defn->gridlist == NULL || defn->gridlist_count == 0 )
             return defn->ctx->last_errno;
     }
+
+    if( defn->gridindex == NULL )
+        defn->gridindex = pj_gridindex_create( defn->gridlist, 
+                                               defn->gridlist_count,
+                                               PJ_GRIDINDEX_MAX_BUCKETS );
      
-    return pj_apply_gridshift_3( pj_get_ctx( defn ),
-                                 defn->gridlist, defn->gridlist_count, inverse, 
-                                 point_count, point_offset, x, y, z );
+    return pj_apply_gridshift_indexed( pj_get_ctx( defn ),
+                                       defn->gridlist, defn->gridlist_count,
+                                       defn->gridindex, inverse, 
+                                       point_count, point_offset, x, y, z );
 }
 
-
 /************************************************************************/
 /*                        pj_apply_gridshift_3()                        */
 /*                                                                      */
-/*      This is the real workhorse, given a gridlist.                   */
+/*      Apply a gridlist without a prebuilt index.  Large batches get   */
+/*      a temporary one, with fewer buckets for fewer points.           */
 /************************************************************************/
 
 int pj_apply_gridshift_3( projCtx ctx, PJ_GRIDINFO **tables, int grid_count,
@@ -113,42 +179,219 @@ int pj_apply_gridshift_3( projCtx ctx, PJ_GRIDINFO **tables, int grid_count,
                           double *x, double *y, double *z )
 
 {
-    int  i;
+    PJ_GRIDINDEX *index = NULL;
+    int ret, i, grids = 0;
+    double buckets;
+
+    for( i = 0; i < grid_count; i++ )
+    {
+        PJ_GRIDINFO *gi;
+
+        for( gi = tables[i]; gi != NULL; 
+             gi = (gi == tables[i]) ? gi->child : gi->next )
+            grids++;
+    }
+
+    /* buckets along each axis */
+    buckets = sqrt( (double) point_count / MAX(grids,1) );
+
+    if( grids >= PJ_GRIDINDEX_MIN_GRIDS && buckets >= 2.0 )
+        index = pj_gridindex_create( tables, grid_count, 
+                                     (int) MIN( buckets, 
+                                                PJ_GRIDINDEX_MAX_BUCKETS ) );
+
+    ret = pj_apply_gridshift_indexed( ctx, tables, grid_count, index, inverse,
+                                      point_count, point_offset, x, y, z );
+
+    pj_gridindex_free( index );
+
+    return ret;
+}
+
+/************************************************************************/
+/*                        pj_gridshift_contains()                       */
+/*                                                                      */
+/*      Does the grid (grown by a small epsilon) contain the point?    */
+/************************************************************************/
+
+static int pj_gridshift_contains( PJ_GRIDINFO *gi, LP input )
+
+{
+    struct CTABLE *ct = gi->ct;
+    double epsilon = (fabs(ct->del.phi)+fabs(ct->del.lam))/10000.0;
+
+    return !( ct->ll.phi - epsilon > input.phi 
+              || ct->ll.lam - epsilon > input.lam
+              || (ct->ll.phi + (ct->lim.phi-1) * ct->del.phi + epsilon 
+                  < input.phi)
+              || (ct->ll.lam + (ct->lim.lam-1) * ct->del.lam + epsilon 
+                  < input.lam) );
+}
+
+/************************************************************************/
+/*                         pj_gridshift_point()                         */
+/*                                                                      */
+/*      Shift one point with the given grid, loading the grid shift     */
+/*      info if we don't have it.  Returns 0 if the grid fails to       */
+/*      load.                                                           */
+/************************************************************************/
+
+static int pj_gridshift_point( projCtx ctx, PJ_GRIDINFO *gi, int inverse,
+                               LP input, LP *output )
+
+{
     static int debug_count = 0;
+    struct CTABLE *ct = gi->ct;
 
-    if( tables == NULL || grid_count == 0 )
+    if( !pj_gridinfo_pin( ctx, gi, 0 ) )
     {
-        pj_ctx_set_errno( ctx, -38);
-        return -38;
+        pj_ctx_set_errno( ctx, -38 );
+        return 0;
     }
+            
+    *output = nad_cvt( input, inverse, ct );
+    pj_gridinfo_unpin( gi );
+    if( output->lam != HUGE_VAL && debug_count++ < 20 )
+        pj_log( ctx, PJ_LOG_DEBUG_MINOR,
+                "pj_apply_gridshift(): used %s", ct->id );
 
-    ctx->last_errno = 0;
+    return 1;
+}
 
-    for( i = 0; i < point_count; i++ )
+/* the bucket of the previous point, see pj_gridshift_bucket() */
+typedef struct {
+    int  bucket;
+    LP   ll, ur;
+} PJ_GRIDSHIFT_HIT;
+
+/************************************************************************/
+/*                         pj_gridshift_bucket()                        */
+/*                                                                      */
+/*      Find the index bucket of a point, unless it is still in the     */
+/*      bucket of the previous point.                                   */
+/************************************************************************/
+
+static int pj_gridshift_bucket( PJ_GRIDINDEX *index, PJ_GRIDSHIFT_HIT *hit,
+                                LP input )
+
+{
+    int ix, iy;
+
+    if( input.lam >= hit->ll.lam && input.lam < hit->ur.lam
+        && input.phi >= hit->ll.phi && input.phi < hit->ur.phi )
+        return hit->bucket;
+
+    hit->bucket = pj_gridindex_bucket( index, input );
+    if( hit->bucket < 0 )
     {
-        long io = i * point_offset;
-        LP   input, output;
-        int  itable;
+        hit->ll.lam = hit->ll.phi = HUGE_VAL;
+        hit->ur.lam = hit->ur.phi = -HUGE_VAL;
+        return -1;
+    }
 
-        input.phi = y[io];
-        input.lam = x[io];
-        output.phi = HUGE_VAL;
-        output.lam = HUGE_VAL;
+    ix = hit->bucket % index->lim.lam;
+    iy = hit->bucket / index->lim.lam;
+    hit->ll.lam = index->ll.lam + ix * index->del.lam;
+    hit->ll.phi = index->ll.phi + iy * index->del.phi;
+    hit->ur.lam = index->ll.lam + (ix+1) * index->del.lam;
+    hit->ur.phi = index->ll.phi + (iy+1) * index->del.phi;
+
+    return hit->bucket;
+}
+
+/************************************************************************/
+/*                         pj_gridshift_first()                         */
+/*                                                                      */
+/*      Return the first grid (or more refined child) that will be     */
+/*      tried for a point, or NULL if no grid matches it at all.        */
+/************************************************************************/
+
+static PJ_GRIDINFO *pj_gridshift_first( PJ_GRIDINFO **tables, int grid_count,
+                                        PJ_GRIDINDEX *index, 
+                                        PJ_GRIDSHIFT_HIT *hit, LP input )
+
+{
+    PJ_GRIDINDEX_ENTRY *entry, *end;
+    PJ_GRIDINFO *child;
+    int itable, bucket, ichild;
+
+    if( index == NULL )
+    {
+        for( itable = 0; itable < grid_count; itable++ )
+        {
+            if( !pj_gridshift_contains( tables[itable], input ) )
+                continue;
+
+            for( child = tables[itable]->child; child != NULL; 
+                 child = child->next )
+            {
+                if( pj_gridshift_contains( child, input ) )
+                    return child;
+            }
+
+            return tables[itable];
+        }
+
+        return NULL;
+    }
+
+    bucket = pj_gridshift_bucket( index, hit, input );
+    if( bucket < 0 )
+        return NULL;
+
+    if( index->resolved[bucket] != NULL )
+        return index->resolved[bucket];
+
+    entry = index->entries + index->start[bucket];
+    end = index->entries + index->start[bucket+1];
+    for( ; entry < end; entry += 1 + entry->child_count )
+    {
+        if( !pj_gridshift_contains( entry->gi, input ) )
+            continue;
+
+        for( ichild = 1; ichild <= entry->child_count; ichild++ )
+        {
+            if( pj_gridshift_contains( entry[ichild].gi, input ) )
+                return entry[ichild].gi;
+        }
+
+        return entry->gi;
+    }
+
+    return NULL;
+}
+
+/************************************************************************/
+/*                        pj_gridshift_search()                         */
+/*                                                                      */
+/*      Shift one point, trying every grid that matches it in turn      */
+/*      until one works.  Without an index every grid is tested.        */
+/*      With one, only the grids listed for the bucket holding the      */
+/*      point are tested, in the same order.  Returns 0 if a grid       */
+/*      fails to load.                                                  */
+/************************************************************************/
+
+static int pj_gridshift_search( projCtx ctx, 
+                                PJ_GRIDINFO **tables, int grid_count,
+                                PJ_GRIDINDEX *index, PJ_GRIDSHIFT_HIT *hit,
+                                int inverse, LP input, LP *output )
+
+{
+    PJ_GRIDINDEX_ENTRY *entry, *end;
+    int itable, bucket;
 
+    output->phi = HUGE_VAL;
+    output->lam = HUGE_VAL;
+
+    if( index == NULL )
+    {
         /* keep trying till we find a table that works */
         for( itable = 0; itable < grid_count; itable++ )
         {
             PJ_GRIDINFO *gi = tables[itable];
-            struct CTABLE *ct = gi->ct;
-            double epsilon = (fabs(ct->del.phi)+fabs(ct->del.lam))/10000.0;
 
             /* skip tables that don't match our point at all.  */
-            if( ct->ll.phi - epsilon > input.phi 
-                || ct->ll.lam - epsilon > input.lam
-                || (ct->ll.phi + (ct->lim.phi-1) * ct->del.phi + epsilon 
-                    < input.phi)
-                || (ct->ll.lam + (ct->lim.lam-1) * ct->del.lam + epsilon 
-                    < input.lam) )
+            if( !pj_gridshift_contains( gi, input ) )
                 continue;
 
             /* If we have child nodes, check to see if any of them apply. */
@@ -158,85 +401,185 @@ int pj_apply_gridshift_3( projCtx ctx, PJ_GRIDINFO **tables, int grid_count,
 
                 for( child = gi->child; child != NULL; child = child->next )
                 {
-                    struct CTABLE *ct1 = child->ct;
-                    double epsilon = 
-                        (fabs(ct1->del.phi)+fabs(ct1->del.lam))/10000.0;
-
-                    if( ct1->ll.phi - epsilon > input.phi 
-                        || ct1->ll.lam - epsilon > input.lam
-                        || (ct1->ll.phi+(ct1->lim.phi-1)*ct1->del.phi + epsilon 
-                            < input.phi)
-                        || (ct1->ll.lam+(ct1->lim.lam-1)*ct1->del.lam + epsilon 
-                            < input.lam) )
-                        continue;
-
-                    break;
+                    if( pj_gridshift_contains( child, input ) )
+                        break;
                 }
 
                 /* we found a more refined child node to use */
                 if( child != NULL )
-                {
                     gi = child;
-                    ct = child->ct;
-                }
             }
 
-            /* load the grid shift info if we don't have it. */
-            if( ct->cvs == NULL && !pj_gridinfo_load( ctx, gi ) )
-            {
-                pj_ctx_set_errno( ctx, -38 );
-                return -38;
-            }
-            
-            output = nad_cvt( input, inverse, ct );
-            if( output.lam != HUGE_VAL )
-            {
-                if( debug_count++ < 20 )
-                    pj_log( ctx, PJ_LOG_DEBUG_MINOR,
-                            "pj_apply_gridshift(): used %s", ct->id );
+            if( !pj_gridshift_point( ctx, gi, inverse, input, output ) )
+                return 0;
+
+            if( output->lam != HUGE_VAL )
                 break;
-            }
         }
 
-        if( output.lam == HUGE_VAL )
+        return 1;
+    }
+
+    bucket = pj_gridshift_bucket( index, hit, input );
+    if( bucket < 0 )
+        return 1;
+
+    entry = index->entries + index->start[bucket];
+    end = index->entries + index->start[bucket+1];
+
+    /* the first grid (or child) listed is known to apply */
+    if( index->resolved[bucket] != NULL )
+    {
+        if( !pj_gridshift_point( ctx, index->resolved[bucket], 
+                                 inverse, input, output ) )
+            return 0;
+
+        entry += 1 + entry->child_count;
+    }
+
+    /* otherwise keep trying till we find a table that works */
+    while( output->lam == HUGE_VAL && entry < end )
+    {
+        PJ_GRIDINFO *gi = entry->gi;
+        int ichild, child_count = entry->child_count;
+
+        if( pj_gridshift_contains( gi, input ) )
         {
-            if( ctx->debug_level >= PJ_LOG_DEBUG_MAJOR )
+            for( ichild = 1; ichild <= child_count; ichild++ )
             {
-                pj_log( ctx, PJ_LOG_DEBUG_MAJOR,
-                    "pj_apply_gridshift(): failed to find a grid shift table for\n"
-                    "                      location (%.7fdW,%.7fdN)",
-                    x[io] * RAD_TO_DEG, 
-                    y[io] * RAD_TO_DEG );
-                for( itable = 0; itable < grid_count; itable++ )
+                if( pj_gridshift_contains( entry[ichild].gi, input ) )
                 {
-                    PJ_GRIDINFO *gi = tables[itable];
-                    if( itable == 0 )
-                        pj_log( ctx, PJ_LOG_DEBUG_MAJOR,
-                                "   tried: %s", gi->gridname );
-                    else
-                        pj_log( ctx, PJ_LOG_DEBUG_MAJOR,
-                                ",%s", gi->gridname );
+                    gi = entry[ichild].gi;
+                    break;
                 }
             }
 
-            /* 
-             * We don't actually have any machinery currently to set the 
-             * following macro, so this is mostly kept here to make it clear 
-             * how we ought to operate if we wanted to make it super clear 
-             * that an error has occured when points are outside our available
-             * datum shift areas.  But if this is on, we will find that "low 
-             * value" points on the fringes of some datasets will completely 
-             * fail causing lots of problems when it is more or less ok to 
-             * just not apply a datum shift.  So rather than deal with
-             * that we just fallback to no shift. (see also bug #45).
-             */
+            if( !pj_gridshift_point( ctx, gi, inverse, input, output ) )
+                return 0;
+        }
+
+        entry += 1 + child_count;
+    }
+
+    return 1;
+}
+
+/************************************************************************/
+/*                        pj_gridshift_failed()                         */
+/*                                                                      */
+/*      Report a point for which no grid shift table worked.            */
+/************************************************************************/
+
+static void pj_gridshift_failed( projCtx ctx, 
+                                 PJ_GRIDINFO **tables, int grid_count,
+                                 double *x, double *y, long io )
+
+{
+    int itable;
+
+    if( ctx->debug_level >= PJ_LOG_DEBUG_MAJOR )
+    {
+        pj_log( ctx, PJ_LOG_DEBUG_MAJOR,
+            "pj_apply_gridshift(): failed to find a grid shift table for\n"
+            "                      location (%.7fdW,%.7fdN)",
+            x[io] * RAD_TO_DEG, 
+            y[io] * RAD_TO_DEG );
+        for( itable = 0; itable < grid_count; itable++ )
+        {
+            PJ_GRIDINFO *gi = tables[itable];
+            if( itable == 0 )
+                pj_log( ctx, PJ_LOG_DEBUG_MAJOR,
+                        "   tried: %s", gi->gridname );
+            else
+                pj_log( ctx, PJ_LOG_DEBUG_MAJOR,
+                        ",%s", gi->gridname );
+        }
+    }
+
+    /* 
+     * We don't actually have any machinery currently to set the 
+     * following macro, so this is mostly kept here to make it clear 
+     * how we ought to operate if we wanted to make it super clear 
+     * that an error has occured when points are outside our available
+     * datum shift areas.  But if this is on, we will find that "low 
+     * value" points on the fringes of some datasets will completely 
+     * fail causing lots of problems when it is more or less ok to 
+     * just not apply a datum shift.  So rather than deal with
+     * that we just fallback to no shift. (see also bug #45).
+     */
 #ifdef ERR_GRID_AREA_TRANSIENT_SEVERE
-            y[io] = HUGE_VAL;
-            x[io] = HUGE_VAL;
+    y[io] = HUGE_VAL;
+    x[io] = HUGE_VAL;
 #else
-            /* leave x/y unshifted. */
+    /* leave x/y unshifted. */
 #endif
+}
+
+/* points gathered for one call of nad_cvt_batch() */
+typedef struct {
+    PJ_GRIDINFO *gi;
+    int    count;
+    long   io[NAD_BATCH];
+    double lam[NAD_BATCH];
+    double phi[NAD_BATCH];
+} PJ_GRIDSHIFT_BATCH;
+
+/************************************************************************/
+/*                      pj_gridshift_flush_batch()                      */
+/*                                                                      */
+/*      Shift the gathered points with their grid in one go.  Points    */
+/*      the grid fails for go through pj_gridshift_search(), which      */
+/*      tries the same grid again and then the following ones, so      */
+/*      the result is the same as shifting them one at a time.          */
+/************************************************************************/
+
+static int pj_gridshift_flush_batch( projCtx ctx, 
+                                     PJ_GRIDINFO **tables, int grid_count,
+                                     PJ_GRIDINDEX *index, PJ_GRIDSHIFT_HIT *hit,
+                                     PJ_GRIDSHIFT_BATCH *batch, int inverse,
+                                     double *x, double *y )
+
+{
+    static int debug_count = 0;
+    struct CTABLE *ct;
+    int  i;
+
+    if( batch->count == 0 )
+        return 1;
+
+    ct = batch->gi->ct;
+    if( !pj_gridinfo_pin( ctx, batch->gi, 0 ) )
+    {
+        pj_ctx_set_errno( ctx, -38 );
+        return 0;
+    }
+
+    nad_cvt_batch( batch->lam, batch->phi, batch->count, inverse, ct );
+    pj_gridinfo_unpin( batch->gi );
+
+    for( i = 0; i < batch->count; i++ )
+    {
+        long io = batch->io[i];
+        LP   input, output;
+
+        if( batch->lam[i] != HUGE_VAL )
+        {
+            if( debug_count++ < 20 )
+                pj_log( ctx, PJ_LOG_DEBUG_MINOR,
+                        "pj_apply_gridshift(): used %s", ct->id );
+            x[io] = batch->lam[i];
+            y[io] = batch->phi[i];
+            continue;
         }
+
+        input.phi = y[io];
+        input.lam = x[io];
+        if( !pj_gridshift_search( ctx, tables, grid_count, index, hit, 
+                                  inverse, input, &output ) )
+            return 0;
+
+        if( output.lam == HUGE_VAL )
+            pj_gridshift_failed( ctx, tables, grid_count, x, y, io );
         else
         {
             y[io] = output.phi;
@@ -244,6 +587,77 @@ int pj_apply_gridshift_3( projCtx ctx, PJ_GRIDINFO **tables, int grid_count,
         }
     }
 
-    return 0;
+    batch->count = 0;
+
+    return 1;
 }
 
+/************************************************************************/
+/*                     pj_apply_gridshift_indexed()                     */
+/*                                                                      */
+/*      This is the real workhorse, given a gridlist and optionally     */
+/*      an index over it.  Successive points falling into the same      */
+/*      grid are gathered and shifted together by nad_cvt_batch().      */
+/************************************************************************/
+
+static int pj_apply_gridshift_indexed( projCtx ctx, 
+                                       PJ_GRIDINFO **tables, int grid_count,
+                                       PJ_GRIDINDEX *index, int inverse, 
+                                       long point_count, int point_offset,
+                                       double *x, double *y, double *z )
+
+{
+    PJ_GRIDSHIFT_BATCH batch;
+    PJ_GRIDSHIFT_HIT hit;
+    long i;
+
+    if( tables == NULL || grid_count == 0 )
+    {
+        pj_ctx_set_errno( ctx, -38);
+        return -38;
+    }
+
+    ctx->last_errno = 0;
+
+    hit.bucket = -1;
+    hit.ll.lam = hit.ll.phi = HUGE_VAL;
+    hit.ur.lam = hit.ur.phi = -HUGE_VAL;
+    batch.gi = NULL;
+    batch.count = 0;
+
+    for( i = 0; i < point_count; i++ )
+    {
+        long io = i * point_offset;
+        LP   input;
+        PJ_GRIDINFO *gi;
+
+        input.phi = y[io];
+        input.lam = x[io];
+
+        gi = pj_gridshift_first( tables, grid_count, index, &hit, input );
+        if( gi == NULL )
+        {
+            pj_gridshift_failed( ctx, tables, grid_count, x, y, io );
+            continue;
+        }
+
+        if( gi != batch.gi || batch.count == NAD_BATCH )
+        {
+            if( !pj_gridshift_flush_batch( ctx, tables, grid_count, index, 
+                                           &hit, &batch, inverse, x, y ) )
+                return -38;
+            batch.gi = gi;
+        }
+
+        batch.io[batch.count] = io;
+        batch.lam[batch.count] = input.lam;
+        batch.phi[batch.count] = input.phi;
+        batch.count++;
+    }
+
+    if( !pj_gridshift_flush_batch( ctx, tables, grid_count, index, 
+                                   &hit, &batch, inverse, x, y ) )
+        return -38;
+
+    return 0;
+}
@@ -34,6 +34,302 @@
 #include <string.h>
 #include <math.h>
 
+/************************************************************************/
+/*                       pj_vgridshift_contains()                       */
+/************************************************************************/
+
+static int pj_vgridshift_contains( PJ_GRIDINFO *gi, LP input )
+
+{
+    struct CTABLE *ct = gi->ct;
+
+    return !( ct->ll.phi > input.phi || ct->ll.lam > input.lam
+              || ct->ll.phi + (ct->lim.phi-1) * ct->del.phi < input.phi
+              || ct->ll.lam + (ct->lim.lam-1) * ct->del.lam < input.lam );
+}
+
+/************************************************************************/
+/*                        pj_vgridshift_refine()                        */
+/*                                                                      */
+/*      If the grid has child nodes, use the first that applies.        */
+/************************************************************************/
+
+static PJ_GRIDINFO *pj_vgridshift_refine( PJ_GRIDINFO *gi, LP input )
+
+{
+    PJ_GRIDINFO *child;
+
+    for( child = gi->child; child != NULL; child = child->next )
+    {
+        if( pj_vgridshift_contains( child, input ) )
+            return child;
+    }
+
+    return gi;
+}
+
+/************************************************************************/
+/*                     pj_vgridshift_tiled_values()                     */
+/*                                                                      */
+/*      Interpolate n points within a grid that is loaded in tiles.     */
+/*      The points are taken tile by tile, so that each tile is         */
+/*      looked up (and converted, the first time) once per batch.       */
+/************************************************************************/
+
+static int pj_vgridshift_tiled_values( projCtx ctx, PJ_GRIDINFO *gi, int n,
+                                       const double *lam, const double *phi,
+                                       double *value )
+
+{
+    struct CTABLE *ct = gi->ct;
+    double grid_lam[NAD_BATCH], grid_phi[NAD_BATCH], tile_value[NAD_BATCH];
+    int  tile[NAD_BATCH], index[NAD_BATCH];
+    int  i, first, count;
+
+    /* the tile of the cell each point interpolates in */
+    for( i = 0; i < n; i++ )
+    {
+        int column = (int) floor( (lam[i] - ct->ll.lam) / ct->del.lam );
+        int row = (int) floor( (phi[i] - ct->ll.phi) / ct->del.phi );
+
+        if( column > ct->lim.lam - 2 )
+            column = ct->lim.lam - 2;
+        if( column < 0 )
+            column = 0;
+        if( row > ct->lim.phi - 2 )
+            row = ct->lim.phi - 2;
+        if( row < 0 )
+            row = 0;
+
+        tile[i] = (row / PJ_GRID_TILE) * gi->tile_lim.lam 
+            + column / PJ_GRID_TILE;
+    }
+
+    for( first = 0; first < n; first++ )
+    {
+        struct CTABLE *t;
+
+        if( tile[first] < 0 )
+            continue;
+
+        t = pj_gridinfo_tile( ctx, gi, tile[first] );
+        if( t == NULL )
+            return 0;
+
+        /* gather the remaining points in this tile, marking them done */
+        count = 0;
+        for( i = first; i < n; i++ )
+        {
+            if( tile[i] != tile[first] )
+                continue;
+
+            index[count] = i;
+            grid_lam[count] = lam[i] - t->ll.lam;
+            grid_phi[count] = phi[i] - t->ll.phi;
+            count++;
+        }
+        for( i = 0; i < count; i++ )
+            tile[index[i]] = -1;
+
+        nad_intr_batch( t, 1, count, grid_lam, grid_phi, tile_value, NULL );
+
+        for( i = 0; i < count; i++ )
+            value[index[i]] = tile_value[i];
+    }
+
+    return 1;
+}
+
+/************************************************************************/
+/*                        pj_vgridshift_values()                        */
+/*                                                                      */
+/*      Interpolate n points within one grid, loading the grid if we    */
+/*      don't have it.  Big grids may be loaded in tiles, see           */
+/*      pj_gridinfo_load_tiled().  Nodata gives HUGE_VAL.               */
+/************************************************************************/
+
+static int pj_vgridshift_values( projCtx ctx, PJ_GRIDINFO *gi, int n,
+                                 const double *lam, const double *phi,
+                                 double *value )
+
+{
+    static int debug_count = 0;
+    struct CTABLE *ct = gi->ct;
+    double grid_lam[NAD_BATCH], grid_phi[NAD_BATCH];
+    int  i;
+
+    if( !pj_gridinfo_pin( ctx, gi, 1 ) )
+    {
+        pj_ctx_set_errno( ctx, -38 );
+        return 0;
+    }
+
+    if( PJ_LOAD_ACQUIRE(ct->cvs) == NULL )
+    {
+        if( !pj_vgridshift_tiled_values( ctx, gi, n, lam, phi, value ) )
+        {
+            pj_gridinfo_unpin( gi );
+            return 0;
+        }
+    }
+    else
+    {
+        /* Interpolation a location within the grid */
+        for( i = 0; i < n; i++ )
+        {
+            grid_lam[i] = lam[i] - ct->ll.lam;
+            grid_phi[i] = phi[i] - ct->ll.phi;
+        }
+
+        nad_intr_batch( ct, 1, n, grid_lam, grid_phi, value, NULL );
+    }
+
+    pj_gridinfo_unpin( gi );
+
+    for( i = 0; i < n; i++ )
+    {
+        if( value[i] > 1000 || value[i] < -1000 ) /* nodata? */
+            value[i] = HUGE_VAL;
+        else if( debug_count++ < 20 )
+            pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+                    "pj_apply_gridshift(): used %s", ct->id );
+    }
+
+    return 1;
+}
+
+/************************************************************************/
+/*                        pj_vgridshift_search()                        */
+/*                                                                      */
+/*      Find the shift for one point, trying every grid that matches    */
+/*      it in turn until one has data.                                  */
+/************************************************************************/
+
+static int pj_vgridshift_search( projCtx ctx, PJ_GRIDINFO **tables, 
+                                 int grid_count, LP input, double *value )
+
+{
+    int itable;
+
+    *value = HUGE_VAL;
+
+    /* keep trying till we find a table that works */
+    for( itable = 0; itable < grid_count && *value == HUGE_VAL; itable++ )
+    {
+        /* skip tables that don't match our point at all.  */
+        if( !pj_vgridshift_contains( tables[itable], input ) )
+            continue;
+
+        if( !pj_vgridshift_values( ctx, 
+                                   pj_vgridshift_refine( tables[itable], input ),
+                                   1, &input.lam, &input.phi, value ) )
+            return 0;
+    }
+
+    return 1;
+}
+
+/************************************************************************/
+/*                        pj_vgridshift_failed()                        */
+/************************************************************************/
+
+static int pj_vgridshift_failed( PJ *defn, PJ_GRIDINFO **tables, 
+                                 int grid_count, double *x, double *y, long io )
+
+{
+    char gridlist[3000];
+    int  itable;
+
+    pj_log( defn->ctx, PJ_LOG_DEBUG_MAJOR,
+            "pj_apply_vgridshift(): failed to find a grid shift table for\n"
+            "                       location (%.7fdW,%.7fdN)",
+            x[io] * RAD_TO_DEG, 
+            y[io] * RAD_TO_DEG );
+
+    gridlist[0] = '\0';
+    for( itable = 0; itable < grid_count; itable++ )
+    {
+        PJ_GRIDINFO *gi = tables[itable];
+        if( strlen(gridlist) + strlen(gi->gridname) > sizeof(gridlist)-100 )
+        {
+            strcat( gridlist, "..." );
+            break;
+        }
+
+        if( itable == 0 )
+            sprintf( gridlist, "   tried: %s", gi->gridname );
+        else
+            sprintf( gridlist+strlen(gridlist), ",%s", gi->gridname );
+    }
+    pj_log( defn->ctx, PJ_LOG_DEBUG_MAJOR,
+            "%s", gridlist );
+                
+    pj_ctx_set_errno( defn->ctx, PJD_ERR_GRID_AREA );
+    return PJD_ERR_GRID_AREA;
+}
+
+/* points gathered for one call of pj_vgridshift_values() */
+typedef struct {
+    PJ_GRIDINFO *gi;
+    int    count;
+    long   io[NAD_BATCH];
+    double lam[NAD_BATCH];
+    double phi[NAD_BATCH];
+} PJ_VGRIDSHIFT_BATCH;
+
+/************************************************************************/
+/*                     pj_vgridshift_flush_batch()                      */
+/*                                                                      */
+/*      Shift the gathered points with their grid in one go.  Points    */
+/*      for which the grid has no data go through                       */
+/*      pj_vgridshift_search(), as when shifting them one at a time.    */
+/************************************************************************/
+
+static int pj_vgridshift_flush_batch( PJ *defn, PJ_GRIDINFO **tables, 
+                                      int grid_count, 
+                                      PJ_VGRIDSHIFT_BATCH *batch, int inverse,
+                                      double *x, double *y, double *z )
+
+{
+    double value[NAD_BATCH];
+    int  i, count = batch->count;
+
+    batch->count = 0;
+    if( count == 0 )
+        return 0;
+
+    if( !pj_vgridshift_values( pj_get_ctx(defn), batch->gi, count, 
+                               batch->lam, batch->phi, value ) )
+        return -38;
+
+    for( i = 0; i < count; i++ )
+    {
+        long io = batch->io[i];
+
+        if( value[i] == HUGE_VAL )
+        {
+            LP input;
+
+            input.lam = batch->lam[i];
+            input.phi = batch->phi[i];
+            if( !pj_vgridshift_search( pj_get_ctx(defn), tables, grid_count,
+                                       input, value + i ) )
+                return -38;
+
+            if( value[i] == HUGE_VAL )
+                return pj_vgridshift_failed( defn, tables, grid_count, 
+                                             x, y, io );
+        }
+
+        if( inverse )
+            z[io] -= value[i];
+        else
+            z[io] += value[i];
+    }
+
+    return 0;
+}
+
 /************************************************************************/
 /*                        pj_apply_vgridshift()                         */
 /*                                                                      */
@@ -41,6 +337,9 @@
 /*      system definition.  If the gridlist has not yet been            */
 /*      populated in the coordinate system definition we set it up      */
 /*      now.                                                            */
+/*                                                                      */
+/*      Successive points falling into the same grid are gathered       */
+/*      and interpolated together by nad_intr_batch().                  */
 /************************************************************************/
 
 int pj_apply_vgridshift( PJ *defn, const char *listname,
@@ -51,9 +350,10 @@ int pj_apply_vgridshift( PJ *defn, const char *listname,
                          double *x, double *y, double *z )
 
 {
-    int  i;
-    static int debug_count = 0;
+    long i;
+    int  ret;
     PJ_GRIDINFO **tables;
+    PJ_VGRIDSHIFT_BATCH batch;
 
     if( *gridlist_p == NULL )
     {
@@ -75,134 +375,48 @@ int pj_apply_vgridshift( PJ *defn, const char *listname,
     tables = *gridlist_p;
     defn->ctx->last_errno = 0;
 
+    batch.gi = NULL;
+    batch.count = 0;
+
     for( i = 0; i < point_count; i++ )
     {
         long io = i * point_offset;
         LP   input;
         int  itable;
-        double value = HUGE_VAL;
+        PJ_GRIDINFO *gi = NULL;
 
         input.phi = y[io];
         input.lam = x[io];
 
-        /* keep trying till we find a table that works */
+        /* the first table that matches our point */
         for( itable = 0; itable < *gridlist_count_p; itable++ )
         {
-            PJ_GRIDINFO *gi = tables[itable];
-            struct CTABLE *ct = gi->ct;
-            double grid_x, grid_y;
-            int    grid_ix, grid_iy;
-            float  *cvs;
-
-            /* skip tables that don't match our point at all.  */
-            if( ct->ll.phi > input.phi || ct->ll.lam > input.lam
-                || ct->ll.phi + (ct->lim.phi-1) * ct->del.phi < input.phi
-                || ct->ll.lam + (ct->lim.lam-1) * ct->del.lam < input.lam )
-                continue;
-
-            /* If we have child nodes, check to see if any of them apply. */
-            if( gi->child != NULL )
-            {
-                PJ_GRIDINFO *child;
-
-                for( child = gi->child; child != NULL; child = child->next )
-                {
-                    struct CTABLE *ct1 = child->ct;
-
-                    if( ct1->ll.phi > input.phi || ct1->ll.lam > input.lam
-                      || ct1->ll.phi+(ct1->lim.phi-1)*ct1->del.phi < input.phi
-                      || ct1->ll.lam+(ct1->lim.lam-1)*ct1->del.lam < input.lam)
-                        continue;
-
-                    break;
-                }
-
-                /* we found a more refined child node to use */
-                if( child != NULL )
-                {
-                    gi = child;
-                    ct = child->ct;
-                }
-            }
-
-            /* load the grid shift info if we don't have it. */
-            if( ct->cvs == NULL && !pj_gridinfo_load( pj_get_ctx(defn), gi ) )
-            {
-                pj_ctx_set_errno( defn->ctx, -38 );
-                return -38;
-            }
-
-            /* Interpolation a location within the grid */
-            grid_x = (input.lam - ct->ll.lam) / ct->del.lam;
-            grid_y = (input.phi - ct->ll.phi) / ct->del.phi;
-            grid_ix = (int) floor(grid_x);
-            grid_iy = (int) floor(grid_y);
-            grid_x -= grid_ix;
-            grid_y -= grid_iy;
-
-            cvs = (float *) ct->cvs;
-            value = cvs[grid_ix + grid_iy * ct->lim.lam] 
-                * (1.0-grid_x) * (1.0-grid_y)
-                + cvs[grid_ix + 1 + grid_iy * ct->lim.lam] 
-                * (grid_x) * (1.0-grid_y)
-                + cvs[grid_ix + (grid_iy+1) * ct->lim.lam] 
-                * (1.0-grid_x) * (grid_y)
-                + cvs[grid_ix + 1 + (grid_iy+1) * ct->lim.lam] 
-                * (grid_x) * (grid_y);
-
-            if( value > 1000 || value < -1000 ) /* nodata? */
-                value = HUGE_VAL;
-            else
-            {
-                if( inverse )
-                    z[io] -= value;
-                else
-                    z[io] += value;
-            }
-                
-            if( value != HUGE_VAL )
+            if( pj_vgridshift_contains( tables[itable], input ) )
             {
-                if( debug_count++ < 20 )
-                    pj_log( defn->ctx, PJ_LOG_DEBUG_MINOR, 
-                            "pj_apply_gridshift(): used %s",
-                            ct->id );
+                gi = pj_vgridshift_refine( tables[itable], input );
                 break;
             }
         }
 
-        if( value == HUGE_VAL )
+        if( gi != batch.gi || batch.count == NAD_BATCH || gi == NULL )
         {
-            char gridlist[3000];
+            ret = pj_vgridshift_flush_batch( defn, tables, *gridlist_count_p,
+                                             &batch, inverse, x, y, z );
+            if( ret != 0 )
+                return ret;
+            batch.gi = gi;
+        }
 
-            pj_log( defn->ctx, PJ_LOG_DEBUG_MAJOR,
-                    "pj_apply_vgridshift(): failed to find a grid shift table for\n"
-                    "                       location (%.7fdW,%.7fdN)",
-                    x[io] * RAD_TO_DEG, 
-                    y[io] * RAD_TO_DEG );
+        if( gi == NULL )
+            return pj_vgridshift_failed( defn, tables, *gridlist_count_p,
+                                         x, y, io );
 
-            gridlist[0] = '\0';
-            for( itable = 0; itable < *gridlist_count_p; itable++ )
-            {
-                PJ_GRIDINFO *gi = tables[itable];
-                if( strlen(gridlist) + strlen(gi->gridname) > sizeof(gridlist)-100 )
-                {
-                    strcat( gridlist, "..." );
-                    break;
-                }
-
-                if( itable == 0 )
-                    sprintf( gridlist, "   tried: %s", gi->gridname );
-                else
-                    sprintf( gridlist+strlen(gridlist), ",%s", gi->gridname );
-            }
-            pj_log( defn->ctx, PJ_LOG_DEBUG_MAJOR,
-                    "%s", gridlist );
-                
-            pj_ctx_set_errno( defn->ctx, PJD_ERR_GRID_AREA );
-            return PJD_ERR_GRID_AREA;
-        }
+        batch.io[batch.count] = io;
+        batch.lam[batch.count] = input.lam;
+        batch.phi[batch.count] = input.phi;
+        batch.count++;
     }
 
-    return 0;
+    return pj_vgridshift_flush_batch( defn, tables, *gridlist_count_p,
+                                      &batch, inverse, x, y, z );
 }
-
@@ -64,11 +64,14 @@ void pj_set_ctx( projPJ pj, projCtx ctx )
 projCtx pj_get_default_ctx()
 
 {
+    /* fast path once the default context has been published */
+    if( PJ_LOAD_ACQUIRE(default_context_initialized) )
+        return &default_context;
+
     pj_acquire_lock();
 
     if( !default_context_initialized )
     {
-        default_context_initialized = 1;
         default_context.last_errno = 0;
         default_context.debug_level = PJ_LOG_NONE;
         default_context.logger = pj_stderr_logger;
@@ -81,6 +84,8 @@ projCtx pj_get_default_ctx()
             else
                 default_context.debug_level = PJ_LOG_DEBUG_MINOR;
         }
+
+        PJ_STORE_RELEASE( default_context_initialized, 1 );
     }
 
     pj_release_lock();
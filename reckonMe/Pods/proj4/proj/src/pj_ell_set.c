@@ -89,6 +89,7 @@ pj_ell_set(projCtx ctx, paralist *pl, double *a, double *es) {
 		}
 bomb:
 		if (start) { /* clean up temporary extension of list */
+			pj_param_index_free(pl); /* it refers to the extension */
 			pj_dalloc(start->next->next);
 			pj_dalloc(start->next);
 			start->next = 0;
@@ -45,37 +45,437 @@
 # include <assert.h>
 #endif /* _WIN32_WCE */
 
+#if !defined(_WIN32) && !defined(_WIN32_WCE)
+#  define PJ_GRID_MMAP
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+/* grids with data loaded, most recently loaded first, and their total */
+/* data size; all protected by the lock, see pj_gridinfo_charge() */
+static PJ_GRIDINFO *resident_grids = NULL;
+static size_t grid_memory_used = 0;
+static size_t grid_memory_limit = 0; /* 0 for no limit */
+
+static long grid_clock = 0; /* counts pj_gridinfo_pin() calls */
+
+static int  byte_order_test = 1;
+#define IS_LSB	(((unsigned char *) (&byte_order_test))[0] == 1)
+
+/* bytes of ntv1 and ntv2 grid rows read and converted at once */
+#define GRID_LOAD_BLOCK 65536
+
 /************************************************************************/
-/*                             swap_words()                             */
+/*                          pj_gridinfo_map()                           */
 /*                                                                      */
-/*      Convert the byte order of the given word(s) in place.           */
+/*      Map size bytes of the open file starting at offset into         */
+/*      memory and return the address of the first byte.  The          */
+/*      mapping is recorded on the gridinfo so that it can be undone    */
+/*      by pj_gridinfo_free().  Returns NULL if the platform or the     */
+/*      file does not allow it, in which case the caller should fall    */
+/*      back to reading the data.                                       */
 /************************************************************************/
 
-static int  byte_order_test = 1;
-#define IS_LSB	(((unsigned char *) (&byte_order_test))[0] == 1)
+static void *pj_gridinfo_map( projCtx ctx, PJ_GRIDINFO *gi, FILE *fid,
+                              long offset, size_t size )
+
+{
+#ifdef PJ_GRID_MMAP
+    struct stat st;
+    long   page_size = sysconf( _SC_PAGESIZE );
+    long   map_offset;
+    size_t map_size;
+    void   *base;
+
+    if( gi->map_base != NULL || size == 0 || page_size <= 0 )
+        return NULL;
+
+    /* never map past the end of the file, touching it would SIGBUS */
+    if( fstat( fileno(fid), &st ) != 0 
+        || (double) st.st_size < (double) offset + (double) size )
+        return NULL;
+
+    map_offset = offset - offset % page_size;
+    map_size = size + (size_t) (offset - map_offset);
+
+    base = mmap( NULL, map_size, PROT_READ, MAP_PRIVATE, 
+                 fileno(fid), (off_t) map_offset );
+    if( base == MAP_FAILED )
+    {
+        pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+                "pj_gridinfo_map(%s): mmap() failed, reading instead.",
+                gi->gridname );
+        return NULL;
+    }
+
+    gi->map_base = base;
+    gi->map_size = map_size;
+
+    pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+            "pj_gridinfo_map(%s): mapped %ld bytes at offset %ld.",
+            gi->gridname, (long) size, offset );
+
+    return ((char *) base) + (offset - map_offset);
+#else
+    return NULL;
+#endif
+}
+
+/************************************************************************/
+/*                         pj_gridinfo_unmap()                          */
+/************************************************************************/
+
+static void pj_gridinfo_unmap( PJ_GRIDINFO *gi )
+
+{
+#ifdef PJ_GRID_MMAP
+    if( gi->map_base == NULL )
+        return;
+
+    munmap( gi->map_base, gi->map_size );
+    gi->map_base = NULL;
+    gi->map_size = 0;
+    gi->tile_data = NULL;
+#endif
+}
+
+#ifdef PJ_GRID_MMAP
+
+/************************************************************************/
+/*                          Converted grid cache.                       */
+/*                                                                      */
+/*      Formats whose on-disk layout differs from the in-memory         */
+/*      CTABLE (ntv1, ntv2 and gtx) are converted once and written      */
+/*      to a native byte order cache file in the directory named by     */
+/*      the PROJ_GRID_CACHE environment variable.  Later loads map      */
+/*      the cache file instead of converting the grid again.  Each     */
+/*      subgrid has its own cache file, keyed by its offset in the      */
+/*      source file, so only the subgrids actually used are paged in.   */
+/************************************************************************/
+
+#define GRID_CACHE_MAGIC "PROJ.4 GRIDCACHE"
+
+struct pj_grid_cache_header {
+    char   magic[16];
+    double source_size;   /* size and modification time of the grid */
+    double source_mtime;  /* file the cache was converted from */
+    int    grid_offset;
+    int    lim_lam;
+    int    lim_phi;
+    int    node_size;     /* bytes per grid node in the cache */
+    char   reserved[16];
+};
+
+/************************************************************************/
+/*                       pj_gridinfo_cache_name()                       */
+/*                                                                      */
+/*      Compute the cache filename for a grid, and the header that a    */
+/*      valid cache for the grid in its current state must have.        */
+/************************************************************************/
+
+static int pj_gridinfo_cache_name( PJ_GRIDINFO *gi, FILE *fid, int node_size,
+                                   char *cache_name, 
+                                   struct pj_grid_cache_header *header )
+
+{
+    const char *cache_dir = getenv( "PROJ_GRID_CACHE" );
+    const char *basename;
+    struct stat st;
+
+    if( cache_dir == NULL || *cache_dir == '\0' )
+        return 0;
+
+    if( fstat( fileno(fid), &st ) != 0 )
+        return 0;
+
+    basename = strrchr( gi->gridname, DIR_CHAR );
+    basename = (basename == NULL) ? gi->gridname : basename + 1;
+
+    if( strlen(cache_dir) + strlen(basename) + 32 > MAX_PATH_FILENAME )
+        return 0;
+
+    sprintf( cache_name, "%s%c%s.%d.cache", 
+             cache_dir, DIR_CHAR, basename, gi->grid_offset );
+
+    memset( header, 0, sizeof(struct pj_grid_cache_header) );
+    memcpy( header->magic, GRID_CACHE_MAGIC, sizeof(header->magic) );
+    header->source_size = (double) st.st_size;
+    header->source_mtime = (double) st.st_mtime;
+    header->grid_offset = gi->grid_offset;
+    header->lim_lam = gi->ct->lim.lam;
+    header->lim_phi = gi->ct->lim.phi;
+    header->node_size = node_size;
+
+    return 1;
+}
 
-static void swap_words( unsigned char *data, int word_size, int word_count )
+/************************************************************************/
+/*                       pj_gridinfo_load_cache()                       */
+/*                                                                      */
+/*      Try to map the converted cache of a grid.  fid is the open     */
+/*      source grid file, used to validate the cache.                   */
+/************************************************************************/
+
+static int pj_gridinfo_load_cache( projCtx ctx, PJ_GRIDINFO *gi, FILE *fid,
+                                   int node_size )
 
 {
-    int	word;
+    char cache_name[MAX_PATH_FILENAME+1];
+    struct pj_grid_cache_header expected, header;
+    FILE *cache_fid;
+    void *data;
+
+    if( !pj_gridinfo_cache_name( gi, fid, node_size, cache_name, &expected ) )
+        return 0;
 
-    for( word = 0; word < word_count; word++ )
+    cache_fid = fopen( cache_name, "rb" );
+    if( cache_fid == NULL )
+        return 0;
+
+    if( fread( &header, sizeof(header), 1, cache_fid ) != 1 
+        || memcmp( &header, &expected, sizeof(header) ) != 0 )
     {
-        int	i;
-        
-        for( i = 0; i < word_size/2; i++ )
+        pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+                "Ignoring stale grid cache %s.", cache_name );
+        fclose( cache_fid );
+        return 0;
+    }
+
+    data = pj_gridinfo_map( ctx, gi, cache_fid, sizeof(header),
+                            (size_t) node_size 
+                            * gi->ct->lim.lam * gi->ct->lim.phi );
+    fclose( cache_fid );
+
+    if( data == NULL )
+        return 0;
+
+    pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+            "Using grid cache %s for %s.", cache_name, gi->ct->id );
+
+    PJ_STORE_RELEASE( gi->ct->cvs, (FLP *) data );
+
+    return 1;
+}
+
+/************************************************************************/
+/*                       pj_gridinfo_save_cache()                       */
+/*                                                                      */
+/*      Write the freshly converted grid to the cache.  The file is     */
+/*      written under a temporary name and renamed into place so        */
+/*      that other processes never map a partial cache.  Failure is     */
+/*      not an error, the grid is simply converted again next time.     */
+/************************************************************************/
+
+static void pj_gridinfo_save_cache( projCtx ctx, PJ_GRIDINFO *gi, FILE *fid,
+                                    const void *grid, int node_size )
+
+{
+    char cache_name[MAX_PATH_FILENAME+1];
+    char temp_name[MAX_PATH_FILENAME+32];
+    struct pj_grid_cache_header header;
+    size_t words = (size_t) gi->ct->lim.lam * gi->ct->lim.phi;
+    FILE *cache_fid;
+    int  ok;
+
+    if( !pj_gridinfo_cache_name( gi, fid, node_size, cache_name, &header ) )
+        return;
+
+    sprintf( temp_name, "%s.%ld", cache_name, (long) getpid() );
+
+    cache_fid = fopen( temp_name, "wb" );
+    if( cache_fid == NULL )
+    {
+        pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+                "Unable to create grid cache %s.", temp_name );
+        return;
+    }
+
+    ok = fwrite( &header, sizeof(header), 1, cache_fid ) == 1
+        && fwrite( grid, node_size, words, cache_fid ) == words;
+    ok = (fclose( cache_fid ) == 0) && ok;
+
+    if( !ok || rename( temp_name, cache_name ) != 0 )
+    {
+        pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+                "Unable to write grid cache %s.", cache_name );
+        unlink( temp_name );
+        return;
+    }
+
+    pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+            "Wrote grid cache %s for %s.", cache_name, gi->ct->id );
+}
+
+#else
+
+#define pj_gridinfo_load_cache( ctx, gi, fid, node_size ) 0
+#define pj_gridinfo_save_cache( ctx, gi, fid, grid, node_size )
+
+#endif /* def PJ_GRID_MMAP */
+
+/************************************************************************/
+/*                         pj_gridinfo_in_map()                         */
+/************************************************************************/
+
+static int pj_gridinfo_in_map( PJ_GRIDINFO *gi, const void *data )
+
+{
+    const char *base = (const char *) gi->map_base;
+
+    return base != NULL && (const char *) data >= base 
+        && (const char *) data < base + gi->map_size;
+}
+
+/************************************************************************/
+/*                        pj_gridinfo_charge()                          */
+/*                                                                      */
+/*      Count size more bytes of data as loaded for a grid, and evict   */
+/*      other grids if that takes us over the memory limit.  Called     */
+/*      with the lock held.                                             */
+/************************************************************************/
+
+static void pj_gridinfo_trim( projCtx ctx );
+
+static void pj_gridinfo_charge( projCtx ctx, PJ_GRIDINFO *gi, size_t size )
+
+{
+    if( gi->data_size == 0 )
+    {
+        gi->resident_prev = NULL;
+        gi->resident_next = resident_grids;
+        if( resident_grids != NULL )
+            resident_grids->resident_prev = gi;
+        resident_grids = gi;
+    }
+
+    gi->data_size += size;
+    grid_memory_used += size;
+
+    pj_gridinfo_trim( ctx );
+}
+
+/************************************************************************/
+/*                      pj_gridinfo_release_data()                      */
+/*                                                                      */
+/*      Free the given data of a grid, and forget about it.  Called     */
+/*      with the lock held once nobody can be using the data anymore.   */
+/************************************************************************/
+
+static void pj_gridinfo_release_data( PJ_GRIDINFO *gi, FLP *cvs, 
+                                      struct CTABLE **tiles )
+
+{
+    if( tiles != NULL )
+    {
+        int i;
+
+        for( i = 0; i < gi->tile_lim.lam * gi->tile_lim.phi; i++ )
+            pj_dalloc( tiles[i] );
+        pj_dalloc( tiles );
+    }
+
+    if( cvs != NULL && !pj_gridinfo_in_map( gi, cvs ) )
+        pj_dalloc( cvs );
+
+    if( gi->ct != NULL )
+        PJ_STORE_RELEASE( gi->ct->cvs, NULL );
+    PJ_STORE_RELEASE( gi->tiles, NULL );
+    pj_gridinfo_unmap( gi );
+
+    if( gi->data_size == 0 )
+        return;
+
+    if( gi->resident_prev != NULL )
+        gi->resident_prev->resident_next = gi->resident_next;
+    else
+        resident_grids = gi->resident_next;
+    if( gi->resident_next != NULL )
+        gi->resident_next->resident_prev = gi->resident_prev;
+
+    grid_memory_used -= gi->data_size;
+    gi->data_size = 0;
+}
+
+/************************************************************************/
+/*                         pj_gridinfo_evict()                          */
+/*                                                                      */
+/*      Unload the data of a grid, unless it is pinned.  The grid is    */
+/*      marked as being evicted before the pins are checked, so a       */
+/*      concurrent pj_gridinfo_pin() either sees the mark and waits     */
+/*      for the lock, or has its pin seen here (both sides use          */
+/*      sequentially consistent operations).  Called with the lock      */
+/*      held.                                                           */
+/************************************************************************/
+
+static int pj_gridinfo_evict( PJ_GRIDINFO *gi )
+
+{
+    PJ_STORE_SEQ( gi->evicting, 1 );
+
+    if( PJ_LOAD_SEQ(gi->pins) == 0 )
+        pj_gridinfo_release_data( gi, gi->ct->cvs, gi->tiles );
+
+    PJ_STORE_RELEASE( gi->evicting, 0 );
+
+    return gi->data_size == 0;
+}
+
+/************************************************************************/
+/*                          pj_gridinfo_trim()                          */
+/*                                                                      */
+/*      Evict the least recently used grids that are not pinned         */
+/*      until the loaded data fits the memory limit again.              */
+/************************************************************************/
+
+static void pj_gridinfo_trim( projCtx ctx )
+
+{
+    while( grid_memory_limit > 0 && grid_memory_used > grid_memory_limit )
+    {
+        PJ_GRIDINFO *gi, *victim = NULL;
+
+        for( gi = resident_grids; gi != NULL; gi = gi->resident_next )
         {
-            int	t;
-            
-            t = data[i];
-            data[i] = data[word_size-i-1];
-            data[word_size-i-1] = t;
+            if( PJ_LOAD_SEQ(gi->pins) == 0 
+                && (victim == NULL || PJ_LOAD_ACQUIRE(gi->last_used) 
+                    < PJ_LOAD_ACQUIRE(victim->last_used)) )
+                victim = gi;
         }
-        
-        data += word_size;
+
+        if( victim == NULL )
+            break;
+
+        pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+                "Evicting %s (%s), %ld bytes.", 
+                victim->gridname, victim->ct->id, (long) victim->data_size );
+
+        if( !pj_gridinfo_evict( victim ) )
+            break;
     }
 }
 
+/************************************************************************/
+/*                      pj_set_grid_memory_limit()                      */
+/*                                                                      */
+/*      Limit the data of all loaded grids to max_bytes, evicting the   */
+/*      least recently used grids as needed.  Grids in use by a         */
+/*      transform are kept however, so the limit may be exceeded        */
+/*      while they are.  Zero means no limit, the default.              */
+/************************************************************************/
+
+void pj_set_grid_memory_limit( size_t max_bytes )
+
+{
+    pj_acquire_lock();
+
+    grid_memory_limit = max_bytes;
+    pj_gridinfo_trim( pj_get_default_ctx() );
+
+    pj_release_lock();
+}
+
 /************************************************************************/
 /*                          pj_gridinfo_free()                          */
 /************************************************************************/
@@ -97,6 +497,11 @@ void pj_gridinfo_free( projCtx ctx, PJ_GRIDINFO *gi )
         }
     }
 
+    pj_acquire_lock();
+    pj_gridinfo_release_data( gi, gi->ct != NULL ? gi->ct->cvs : NULL, 
+                              gi->tiles );
+    pj_release_lock();
+
     if( gi->ct != NULL )
         nad_free( gi->ct );
     
@@ -108,18 +513,22 @@ void pj_gridinfo_free( projCtx ctx, PJ_GRIDINFO *gi )
 }
 
 /************************************************************************/
-/*                          pj_gridinfo_load()                          */
+/*                        pj_gridinfo_load_data()                       */
 /*                                                                      */
-/*      This function is intended to implement delayed loading of       */
-/*      the data contents of a grid file.  The header and related       */
-/*      stuff are loaded by pj_gridinfo_init().                         */
+/*      Load the data contents of a grid file, called with the lock     */
+/*      held.  ct->cvs is only set, with release semantics, once the    */
+/*      data is complete.                                               */
+/*                                                                      */
+/*      Where the file layout matches the in-memory layout (ctable,     */
+/*      and ctable2 on LSB hosts) the data is memory mapped rather      */
+/*      than read, so pages are only brought in as cells are used.      */
+/*      Other formats are converted, and mapped from the converted      */
+/*      cache on later loads if PROJ_GRID_CACHE is set.                 */
 /************************************************************************/
 
-int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
+static int pj_gridinfo_load_data( projCtx ctx, PJ_GRIDINFO *gi )
 
 {
-    if( gi == NULL || gi->ct == NULL )
-        return 0;
 
 /* -------------------------------------------------------------------- */
 /*      Original platform specific CTable format.                       */
@@ -127,6 +536,7 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
     if( strcmp(gi->format,"ctable") == 0 )
     {
         FILE *fid;
+        struct CTABLE ct;
         int result;
 
         fid = pj_open_lib( ctx, gi->filename, "rb" );
@@ -137,7 +547,18 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
             return 0;
         }
 
-        result = nad_ctable_load( ctx, gi->ct, fid );
+        ct = *gi->ct;
+        ct.cvs = (FLP *) 
+            pj_gridinfo_map( ctx, gi, fid, sizeof(struct CTABLE), 
+                             sizeof(FLP) * gi->ct->lim.lam * gi->ct->lim.phi );
+
+        if( ct.cvs != NULL )
+            result = 1;
+        else
+            result = nad_ctable_load( ctx, &ct, fid );
+
+        if( result )
+            PJ_STORE_RELEASE( gi->ct->cvs, ct.cvs );
 
         fclose( fid );
 
@@ -150,6 +571,7 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
     else if( strcmp(gi->format,"ctable2") == 0 )
     {
         FILE *fid;
+        struct CTABLE ct;
         int result;
 
         fid = pj_open_lib( ctx, gi->filename, "rb" );
@@ -160,7 +582,20 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
             return 0;
         }
 
-        result = nad_ctable2_load( ctx, gi->ct, fid );
+        /* ctable2 is stored LSB, so usable in place on LSB hosts */
+        ct = *gi->ct;
+        if( IS_LSB )
+            ct.cvs = (FLP *) 
+                pj_gridinfo_map( ctx, gi, fid, 160, 
+                                 sizeof(FLP) * gi->ct->lim.lam * gi->ct->lim.phi );
+
+        if( ct.cvs != NULL )
+            result = 1;
+        else
+            result = nad_ctable2_load( ctx, &ct, fid );
+
+        if( result )
+            PJ_STORE_RELEASE( gi->ct->cvs, ct.cvs );
 
         fclose( fid );
 
@@ -177,7 +612,8 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
     else if( strcmp(gi->format,"ntv1") == 0 )
     {
         double	*row_buf;
-        int	row;
+        int	row, rows, block_rows;
+        FLP     *grid;
         FILE *fid;
 
         fid = pj_open_lib( ctx, gi->filename, "rb" );
@@ -188,49 +624,67 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
             return 0;
         }
 
+        if( pj_gridinfo_load_cache( ctx, gi, fid, sizeof(FLP) ) )
+        {
+            fclose( fid );
+            return 1;
+        }
+
         fseek( fid, gi->grid_offset, SEEK_SET );
 
-        row_buf = (double *) pj_malloc(gi->ct->lim.lam * sizeof(double) * 2);
-        gi->ct->cvs = (FLP *) pj_malloc(gi->ct->lim.lam*gi->ct->lim.phi*sizeof(FLP));
-        if( row_buf == NULL || gi->ct->cvs == NULL )
+        block_rows = GRID_LOAD_BLOCK / (gi->ct->lim.lam * sizeof(double) * 2);
+        if( block_rows < 1 )
+            block_rows = 1;
+
+        row_buf = (double *) 
+            pj_malloc(gi->ct->lim.lam * sizeof(double) * 2 * block_rows);
+        grid = (FLP *) pj_malloc(gi->ct->lim.lam*gi->ct->lim.phi*sizeof(FLP));
+        if( row_buf == NULL || grid == NULL )
         {
             pj_ctx_set_errno( ctx, -38 );
             return 0;
         }
         
-        for( row = 0; row < gi->ct->lim.phi; row++ )
+        for( row = 0; row < gi->ct->lim.phi; row += rows )
         {
-            int	    i;
+            int	    i, r;
             FLP     *cvs;
             double  *diff_seconds;
 
-            if( fread( row_buf, sizeof(double), gi->ct->lim.lam * 2, fid ) 
-                != 2 * gi->ct->lim.lam )
+            rows = MIN( block_rows, gi->ct->lim.phi - row );
+
+            if( fread( row_buf, sizeof(double), gi->ct->lim.lam * 2 * rows, 
+                       fid ) != 2 * gi->ct->lim.lam * rows )
             {
                 pj_dalloc( row_buf );
-                pj_dalloc( gi->ct->cvs );
+                pj_dalloc( grid );
                 pj_ctx_set_errno( ctx, -38 );
                 return 0;
             }
 
             if( IS_LSB )
-                swap_words( (unsigned char *) row_buf, 8, gi->ct->lim.lam*2 );
+                nad_swap_words( row_buf, 8, gi->ct->lim.lam * 2 * rows );
 
             /* convert seconds to radians */
             diff_seconds = row_buf;
 
-            for( i = 0; i < gi->ct->lim.lam; i++ )
+            for( r = row; r < row + rows; r++ )
             {
-                cvs = gi->ct->cvs + (row) * gi->ct->lim.lam
-                    + (gi->ct->lim.lam - i - 1);
+                cvs = grid + (r + 1) * gi->ct->lim.lam - 1;
 
-                cvs->phi = *(diff_seconds++) * ((PI/180.0) / 3600.0);
-                cvs->lam = *(diff_seconds++) * ((PI/180.0) / 3600.0);
+                for( i = 0; i < gi->ct->lim.lam; i++, cvs-- )
+                {
+                    cvs->phi = *(diff_seconds++) * ((PI/180.0) / 3600.0);
+                    cvs->lam = *(diff_seconds++) * ((PI/180.0) / 3600.0);
+                }
             }
         }
 
         pj_dalloc( row_buf );
 
+        pj_gridinfo_save_cache( ctx, gi, fid, grid, sizeof(FLP) );
+        PJ_STORE_RELEASE( gi->ct->cvs, grid );
+
         fclose( fid );
 
         return 1;
@@ -246,7 +700,8 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
     else if( strcmp(gi->format,"ntv2") == 0 )
     {
         float	*row_buf;
-        int	row;
+        int	row, rows, block_rows;
+        FLP     *grid;
         FILE *fid;
 
         pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
@@ -260,52 +715,68 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
             return 0;
         }
 
+        if( pj_gridinfo_load_cache( ctx, gi, fid, sizeof(FLP) ) )
+        {
+            fclose( fid );
+            return 1;
+        }
+
         fseek( fid, gi->grid_offset, SEEK_SET );
 
-        row_buf = (float *) pj_malloc(gi->ct->lim.lam * sizeof(float) * 4);
-        gi->ct->cvs = (FLP *) pj_malloc(gi->ct->lim.lam*gi->ct->lim.phi*sizeof(FLP));
-        if( row_buf == NULL || gi->ct->cvs == NULL )
+        block_rows = GRID_LOAD_BLOCK / (gi->ct->lim.lam * sizeof(float) * 4);
+        if( block_rows < 1 )
+            block_rows = 1;
+
+        row_buf = (float *) 
+            pj_malloc(gi->ct->lim.lam * sizeof(float) * 4 * block_rows);
+        grid = (FLP *) pj_malloc(gi->ct->lim.lam*gi->ct->lim.phi*sizeof(FLP));
+        if( row_buf == NULL || grid == NULL )
         {
             pj_ctx_set_errno( ctx, -38 );
             return 0;
         }
         
-        for( row = 0; row < gi->ct->lim.phi; row++ )
+        for( row = 0; row < gi->ct->lim.phi; row += rows )
         {
-            int	    i;
+            int	    i, r;
             FLP     *cvs;
             float   *diff_seconds;
 
-            if( fread( row_buf, sizeof(float), gi->ct->lim.lam*4, fid ) 
-                != 4 * gi->ct->lim.lam )
+            rows = MIN( block_rows, gi->ct->lim.phi - row );
+
+            if( fread( row_buf, sizeof(float), gi->ct->lim.lam * 4 * rows, 
+                       fid ) != 4 * gi->ct->lim.lam * rows )
             {
                 pj_dalloc( row_buf );
-                pj_dalloc( gi->ct->cvs );
-                gi->ct->cvs = NULL;
+                pj_dalloc( grid );
                 pj_ctx_set_errno( ctx, -38 );
                 return 0;
             }
 
             if( !IS_LSB )
-                swap_words( (unsigned char *) row_buf, 4, 
-                            gi->ct->lim.lam*4 );
+                nad_swap_words( row_buf, 4, gi->ct->lim.lam * 4 * rows );
 
             /* convert seconds to radians */
             diff_seconds = row_buf;
 
-            for( i = 0; i < gi->ct->lim.lam; i++ )
+            for( r = row; r < row + rows; r++ )
             {
-                cvs = gi->ct->cvs + (row) * gi->ct->lim.lam
-                    + (gi->ct->lim.lam - i - 1);
-
-                cvs->phi = *(diff_seconds++) * ((PI/180.0) / 3600.0);
-                cvs->lam = *(diff_seconds++) * ((PI/180.0) / 3600.0);
-                diff_seconds += 2; /* skip accuracy values */
+                cvs = grid + (r + 1) * gi->ct->lim.lam - 1;
+
+                for( i = 0; i < gi->ct->lim.lam; i++, cvs-- )
+                {
+                    cvs->phi = *(diff_seconds++) * ((PI/180.0) / 3600.0);
+                    cvs->lam = *(diff_seconds++) * ((PI/180.0) / 3600.0);
+                    diff_seconds += 2; /* skip accuracy values */
+                }
             }
         }
 
         pj_dalloc( row_buf );
 
+        pj_gridinfo_save_cache( ctx, gi, fid, grid, sizeof(FLP) );
+        PJ_STORE_RELEASE( gi->ct->cvs, grid );
+
         fclose( fid );
 
         return 1;
@@ -317,6 +788,7 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
     else if( strcmp(gi->format,"gtx") == 0 )
     {
         int   words = gi->ct->lim.lam * gi->ct->lim.phi;
+        float *grid;
         FILE *fid;
 
         fid = pj_open_lib( ctx, gi->filename, "rb" );
@@ -327,24 +799,32 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
             return 0;
         }
 
+        if( pj_gridinfo_load_cache( ctx, gi, fid, sizeof(float) ) )
+        {
+            fclose( fid );
+            return 1;
+        }
+
         fseek( fid, gi->grid_offset, SEEK_SET );
 
-        gi->ct->cvs = (FLP *) pj_malloc(words*sizeof(float));
-        if( gi->ct->cvs == NULL )
+        grid = (float *) pj_malloc(words*sizeof(float));
+        if( grid == NULL )
         {
             pj_ctx_set_errno( ctx, -38 );
             return 0;
         }
         
-        if( fread( gi->ct->cvs, sizeof(float), words, fid ) != words )
+        if( fread( grid, sizeof(float), words, fid ) != words )
         {
-            pj_dalloc( gi->ct->cvs );
-            gi->ct->cvs = NULL;
+            pj_dalloc( grid );
             return 0;
         }
 
         if( IS_LSB )
-            swap_words( (unsigned char *) gi->ct->cvs, 4, words );
+            nad_swap_words( grid, 4, words );
+
+        pj_gridinfo_save_cache( ctx, gi, fid, grid, sizeof(float) );
+        PJ_STORE_RELEASE( gi->ct->cvs, (FLP *) grid );
 
         fclose( fid );
         return 1;
@@ -356,6 +836,348 @@ int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
     }
 }
 
+/************************************************************************/
+/*                       pj_gridinfo_data_size()                        */
+/*                                                                      */
+/*      The size of the data of a grid loaded as a whole.               */
+/************************************************************************/
+
+static size_t pj_gridinfo_data_size( PJ_GRIDINFO *gi )
+
+{
+    if( pj_gridinfo_in_map( gi, gi->ct->cvs ) )
+        return gi->map_size;
+    else if( strcmp(gi->format,"gtx") == 0 )
+        return sizeof(float) * gi->ct->lim.lam * gi->ct->lim.phi;
+    else
+        return sizeof(FLP) * gi->ct->lim.lam * gi->ct->lim.phi;
+}
+
+/************************************************************************/
+/*                          pj_gridinfo_load()                          */
+/*                                                                      */
+/*      This function is intended to implement delayed loading of       */
+/*      the data contents of a grid file.  The header and related       */
+/*      stuff are loaded by pj_gridinfo_init().                         */
+/*                                                                      */
+/*      Grids that are already loaded are recognised without taking     */
+/*      the lock, so concurrent transforms only serialize while a       */
+/*      grid is actually being read.                                    */
+/*                                                                      */
+/*      Loading may evict other grids to stay within the memory         */
+/*      limit, so transforms use pj_gridinfo_pin() rather than this.    */
+/************************************************************************/
+
+int pj_gridinfo_load( projCtx ctx, PJ_GRIDINFO *gi )
+
+{
+    int result;
+
+    if( gi == NULL || gi->ct == NULL )
+        return 0;
+
+    if( PJ_LOAD_ACQUIRE(gi->ct->cvs) != NULL )
+        return 1;
+
+    pj_acquire_lock();
+
+    if( gi->ct->cvs != NULL )
+        result = 1;
+    else if( (result = pj_gridinfo_load_data( ctx, gi )) )
+        pj_gridinfo_charge( ctx, gi, pj_gridinfo_data_size( gi ) );
+
+    pj_release_lock();
+
+    return result;
+}
+
+/************************************************************************/
+/*                        pj_gridinfo_init_tiles()                      */
+/*                                                                      */
+/*      Map the data of a big gtx grid so that it can be converted      */
+/*      tile by tile as points fall into it, rather than as a whole.    */
+/*      A converted cache of the grid is preferred when there is one.   */
+/*      Returns FALSE if the grid is to be loaded whole instead.        */
+/*      Called with the lock held.                                      */
+/************************************************************************/
+
+#define PJ_GRID_TILE_MIN_BYTES (1024*1024)
+
+static int pj_gridinfo_init_tiles( projCtx ctx, PJ_GRIDINFO *gi )
+
+{
+#ifdef PJ_GRID_MMAP
+    struct CTABLE *ct = gi->ct;
+    size_t size = (size_t) ct->lim.lam * ct->lim.phi * sizeof(float);
+    struct CTABLE **tiles;
+    ILP   tile_lim;
+    void  *data;
+    FILE  *fid;
+
+    if( strcmp(gi->format,"gtx") != 0 || ct->lim.lam < 2 || ct->lim.phi < 2 
+        || size < PJ_GRID_TILE_MIN_BYTES )
+        return 0;
+
+    fid = pj_open_lib( ctx, gi->filename, "rb" );
+    if( fid == NULL )
+        return 0;
+
+    if( pj_gridinfo_load_cache( ctx, gi, fid, sizeof(float) ) )
+    {
+        fclose( fid );
+        pj_gridinfo_charge( ctx, gi, pj_gridinfo_data_size( gi ) );
+        return 1;
+    }
+
+    tile_lim.lam = (ct->lim.lam - 2) / PJ_GRID_TILE + 1;
+    tile_lim.phi = (ct->lim.phi - 2) / PJ_GRID_TILE + 1;
+
+    tiles = (struct CTABLE **) 
+        pj_malloc( sizeof(struct CTABLE *) * tile_lim.lam * tile_lim.phi );
+    if( tiles == NULL )
+    {
+        fclose( fid );
+        return 0;
+    }
+    memset( tiles, 0, sizeof(struct CTABLE *) * tile_lim.lam * tile_lim.phi );
+
+    data = pj_gridinfo_map( ctx, gi, fid, gi->grid_offset, size );
+    fclose( fid );
+
+    if( data == NULL )
+    {
+        pj_dalloc( tiles );
+        return 0;
+    }
+
+    pj_log( ctx, PJ_LOG_DEBUG_MINOR, 
+            "Using %s in %dx%d tiles.", 
+            gi->gridname, tile_lim.lam, tile_lim.phi );
+
+    gi->tile_data = (const unsigned char *) data;
+    gi->tile_lim = tile_lim;
+    PJ_STORE_RELEASE( gi->tiles, tiles );
+    pj_gridinfo_charge( ctx, gi, 
+                        sizeof(struct CTABLE *) * tile_lim.lam * tile_lim.phi );
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/************************************************************************/
+/*                        pj_gridinfo_load_tiled()                      */
+/*                                                                      */
+/*      pj_gridinfo_load() for callers which can work on the tiles      */
+/*      from pj_gridinfo_tile() if gi->tiles is set after it returns,   */
+/*      and on gi->ct->cvs otherwise.  Big gtx grids are then only      */
+/*      mapped, and the parts that are used are converted lazily.       */
+/************************************************************************/
+
+int pj_gridinfo_load_tiled( projCtx ctx, PJ_GRIDINFO *gi )
+
+{
+    int result;
+
+    if( gi == NULL || gi->ct == NULL )
+        return 0;
+
+    if( PJ_LOAD_ACQUIRE(gi->ct->cvs) != NULL 
+        || PJ_LOAD_ACQUIRE(gi->tiles) != NULL )
+        return 1;
+
+    pj_acquire_lock();
+
+    if( gi->ct->cvs != NULL || gi->tiles != NULL )
+        result = 1;
+    else if( pj_gridinfo_init_tiles( ctx, gi ) )
+        result = 1;
+    else if( (result = pj_gridinfo_load_data( ctx, gi )) )
+        pj_gridinfo_charge( ctx, gi, pj_gridinfo_data_size( gi ) );
+
+    pj_release_lock();
+
+    return result;
+}
+
+/************************************************************************/
+/*                          pj_gridinfo_tile()                          */
+/*                                                                      */
+/*      Return tile number tile (row * tile_lim.lam + column) of a      */
+/*      tiled grid as a CTABLE of its own, converting it on first       */
+/*      use.  A tile spans PJ_GRID_TILE cells in each direction, fewer  */
+/*      at the upper edges of the grid, plus the nodes on its upper     */
+/*      edges so that all its cells interpolate within it.              */
+/************************************************************************/
+
+struct CTABLE *pj_gridinfo_tile( projCtx ctx, PJ_GRIDINFO *gi, int tile )
+
+{
+    struct CTABLE *ct = gi->ct, *t;
+
+    if( (t = PJ_LOAD_ACQUIRE(gi->tiles[tile])) != NULL )
+        return t;
+
+    pj_acquire_lock();
+
+    if( (t = gi->tiles[tile]) == NULL && gi->tile_data != NULL )
+    {
+        int col0 = (tile % gi->tile_lim.lam) * PJ_GRID_TILE;
+        int row0 = (tile / gi->tile_lim.lam) * PJ_GRID_TILE;
+        int columns = ct->lim.lam - col0, rows = ct->lim.phi - row0;
+
+        if( columns > PJ_GRID_TILE + 1 )
+            columns = PJ_GRID_TILE + 1;
+        if( rows > PJ_GRID_TILE + 1 )
+            rows = PJ_GRID_TILE + 1;
+
+        t = (struct CTABLE *) pj_malloc( sizeof(struct CTABLE) 
+                                         + sizeof(float) * columns * rows );
+        if( t != NULL )
+        {
+            float *cvs = (float *) (t + 1);
+            int   row;
+
+            memcpy( t->id, ct->id, MAX_TAB_ID );
+            t->ll.lam = ct->ll.lam + col0 * ct->del.lam;
+            t->ll.phi = ct->ll.phi + row0 * ct->del.phi;
+            t->del = ct->del;
+            t->lim.lam = columns;
+            t->lim.phi = rows;
+            t->cvs = (FLP *) cvs;
+
+            for( row = 0; row < rows; row++ )
+                memcpy( cvs + row * columns, 
+                        gi->tile_data + sizeof(float) 
+                        * ((size_t) (row0 + row) * ct->lim.lam + col0),
+                        sizeof(float) * columns );
+
+            if( IS_LSB )
+                nad_swap_words( cvs, 4, columns * rows );
+
+            PJ_STORE_RELEASE( gi->tiles[tile], t );
+            pj_gridinfo_charge( ctx, gi, sizeof(struct CTABLE) 
+                                + sizeof(float) * columns * rows );
+        }
+    }
+
+    pj_release_lock();
+
+    if( t == NULL )
+        pj_ctx_set_errno( ctx, -38 );
+
+    return t;
+}
+
+/************************************************************************/
+/*                          pj_gridinfo_pin()                           */
+/*                                                                      */
+/*      Load the data of a grid if needed, and keep it from being       */
+/*      evicted until the matching pj_gridinfo_unpin().  With tiled     */
+/*      set the grid may be loaded as by pj_gridinfo_load_tiled().      */
+/*      Returns FALSE, without a pin, if the grid cannot be loaded.     */
+/************************************************************************/
+
+int pj_gridinfo_pin( projCtx ctx, PJ_GRIDINFO *gi, int tiled )
+
+{
+    if( gi == NULL || gi->ct == NULL )
+        return 0;
+
+    PJ_ATOMIC_ADD( gi->pins, 1 );
+
+    /* wait out an eviction that may not have seen our pin */
+    while( PJ_LOAD_SEQ(gi->evicting) )
+    {
+        PJ_ATOMIC_ADD( gi->pins, -1 );
+        pj_acquire_lock();
+        pj_release_lock();
+        PJ_ATOMIC_ADD( gi->pins, 1 );
+    }
+
+    PJ_STORE_RELEASE( gi->last_used, PJ_ATOMIC_ADD( grid_clock, 1 ) );
+
+    if( tiled ? pj_gridinfo_load_tiled( ctx, gi ) : pj_gridinfo_load( ctx, gi ) )
+        return 1;
+
+    PJ_ATOMIC_ADD( gi->pins, -1 );
+    return 0;
+}
+
+/************************************************************************/
+/*                         pj_gridinfo_unpin()                          */
+/************************************************************************/
+
+void pj_gridinfo_unpin( PJ_GRIDINFO *gi )
+
+{
+    PJ_ATOMIC_ADD( gi->pins, -1 );
+}
+
+/************************************************************************/
+/*                        pj_gridinfo_prewarm()                         */
+/*                                                                      */
+/*      Load the parts of a grid and its children that lie within the   */
+/*      area from ll to ur: the whole grid, or the tiles of a tiled     */
+/*      one.  Grids outside the area are not touched.                   */
+/************************************************************************/
+
+int pj_gridinfo_prewarm( projCtx ctx, PJ_GRIDINFO *gi, LP ll, LP ur )
+
+{
+    struct CTABLE *ct = gi->ct;
+    PJ_GRIDINFO *child;
+
+    if( ct == NULL 
+        || ur.lam < ct->ll.lam || ur.phi < ct->ll.phi
+        || ll.lam > ct->ll.lam + (ct->lim.lam-1) * ct->del.lam
+        || ll.phi > ct->ll.phi + (ct->lim.phi-1) * ct->del.phi )
+        return 1;
+
+    if( !pj_gridinfo_pin( ctx, gi, 1 ) )
+        return 0;
+
+    if( PJ_LOAD_ACQUIRE(ct->cvs) == NULL )
+    {
+        int col, row, col0, row0, col1, row1;
+
+        /* cells covering the area, clamped to the grid */
+        col0 = (int) floor( (ll.lam - ct->ll.lam) / ct->del.lam );
+        row0 = (int) floor( (ll.phi - ct->ll.phi) / ct->del.phi );
+        col1 = (int) floor( (ur.lam - ct->ll.lam) / ct->del.lam );
+        row1 = (int) floor( (ur.phi - ct->ll.phi) / ct->del.phi );
+
+        col0 = MAX( 0, col0 ) / PJ_GRID_TILE;
+        row0 = MAX( 0, row0 ) / PJ_GRID_TILE;
+        col1 = MIN( ct->lim.lam - 2, col1 ) / PJ_GRID_TILE;
+        row1 = MIN( ct->lim.phi - 2, row1 ) / PJ_GRID_TILE;
+
+        for( row = row0; row <= row1; row++ )
+        {
+            for( col = col0; col <= col1; col++ )
+            {
+                if( pj_gridinfo_tile( ctx, gi, 
+                                      row * gi->tile_lim.lam + col ) == NULL )
+                {
+                    pj_gridinfo_unpin( gi );
+                    return 0;
+                }
+            }
+        }
+    }
+
+    pj_gridinfo_unpin( gi );
+
+    for( child = gi->child; child != NULL; child = child->next )
+    {
+        if( !pj_gridinfo_prewarm( ctx, child, ll, ur ) )
+            return 0;
+    }
+
+    return 1;
+}
+
 /************************************************************************/
 /*                       pj_gridinfo_init_ntv2()                        */
 /*                                                                      */
@@ -392,13 +1214,13 @@ static int pj_gridinfo_init_ntv2( projCtx ctx, FILE *fid, PJ_GRIDINFO *gilist )
 /* -------------------------------------------------------------------- */
     if( !IS_LSB )
     {
-        swap_words( header+8, 4, 1 );
-        swap_words( header+8+16, 4, 1 );
-        swap_words( header+8+32, 4, 1 );
-        swap_words( header+8+7*16, 8, 1 );
-        swap_words( header+8+8*16, 8, 1 );
-        swap_words( header+8+9*16, 8, 1 );
-        swap_words( header+8+10*16, 8, 1 );
+        nad_swap_words( header+8, 4, 1 );
+        nad_swap_words( header+8+16, 4, 1 );
+        nad_swap_words( header+8+32, 4, 1 );
+        nad_swap_words( header+8+7*16, 8, 1 );
+        nad_swap_words( header+8+8*16, 8, 1 );
+        nad_swap_words( header+8+9*16, 8, 1 );
+        nad_swap_words( header+8+10*16, 8, 1 );
     }
 
 /* -------------------------------------------------------------------- */
@@ -436,13 +1258,13 @@ static int pj_gridinfo_init_ntv2( projCtx ctx, FILE *fid, PJ_GRIDINFO *gilist )
 /* -------------------------------------------------------------------- */
         if( !IS_LSB )
         {
-            swap_words( header+8+16*4, 8, 1 );
-            swap_words( header+8+16*5, 8, 1 );
-            swap_words( header+8+16*6, 8, 1 );
-            swap_words( header+8+16*7, 8, 1 );
-            swap_words( header+8+16*8, 8, 1 );
-            swap_words( header+8+16*9, 8, 1 );
-            swap_words( header+8+16*10, 4, 1 );
+            nad_swap_words( header+8+16*4, 8, 1 );
+            nad_swap_words( header+8+16*5, 8, 1 );
+            nad_swap_words( header+8+16*6, 8, 1 );
+            nad_swap_words( header+8+16*7, 8, 1 );
+            nad_swap_words( header+8+16*8, 8, 1 );
+            nad_swap_words( header+8+16*9, 8, 1 );
+            nad_swap_words( header+8+16*10, 4, 1 );
         }
         
 /* -------------------------------------------------------------------- */
@@ -599,13 +1421,13 @@ static int pj_gridinfo_init_ntv1( projCtx ctx, FILE * fid, PJ_GRIDINFO *gi )
 /* -------------------------------------------------------------------- */
     if( IS_LSB )
     {
-        swap_words( header+8, 4, 1 );
-        swap_words( header+24, 8, 1 );
-        swap_words( header+40, 8, 1 );
-        swap_words( header+56, 8, 1 );
-        swap_words( header+72, 8, 1 );
-        swap_words( header+88, 8, 1 );
-        swap_words( header+104, 8, 1 );
+        nad_swap_words( header+8, 4, 1 );
+        nad_swap_words( header+24, 8, 1 );
+        nad_swap_words( header+40, 8, 1 );
+        nad_swap_words( header+56, 8, 1 );
+        nad_swap_words( header+72, 8, 1 );
+        nad_swap_words( header+88, 8, 1 );
+        nad_swap_words( header+104, 8, 1 );
     }
 
     if( *((int *) (header+8)) != 12 )
@@ -687,8 +1509,8 @@ static int pj_gridinfo_init_gtx( projCtx ctx, FILE * fid, PJ_GRIDINFO *gi )
 /* -------------------------------------------------------------------- */
     if( IS_LSB )
     {
-        swap_words( header+0, 8, 4 );
-        swap_words( header+32, 4, 2 );
+        nad_swap_words( header+0, 8, 4 );
+        nad_swap_words( header+32, 4, 2 );
     }
 
     memcpy( &yorigin, header+0, 8 );
@@ -44,12 +44,18 @@
 # include <assert.h>
 #endif /* _WIN32_WCE */
 
+/* 
+** Loaded grids.  The list is append only (until pj_deallocate_grids())
+** and new grids are published with a release store of the link, so it
+** can be searched without the lock.
+*/
 static PJ_GRIDINFO *grid_list = NULL;
 
 /************************************************************************/
 /*                        pj_deallocate_grids()                         */
 /*                                                                      */
-/*      Deallocate all loaded grids.                                    */
+/*      Deallocate all loaded grids.  No other thread may be using      */
+/*      grids while this is called.                                     */
 /************************************************************************/
 
 void pj_deallocate_grids()
@@ -87,7 +93,8 @@ static int pj_gridlist_merge_gridfile( projCtx ctx,
 /*      matching grids as with NTv2 we can get many grids from one      */
 /*      file (one shared gridname).                                     */
 /* -------------------------------------------------------------------- */
-    for( this_grid = grid_list; this_grid != NULL; this_grid = this_grid->next)
+    for( this_grid = PJ_LOAD_ACQUIRE(grid_list); this_grid != NULL; 
+         this_grid = PJ_LOAD_ACQUIRE(this_grid->next) )
     {
         if( strcmp(this_grid->gridname,gridname) == 0 )
         {
@@ -127,21 +134,39 @@ static int pj_gridlist_merge_gridfile( projCtx ctx,
         return 1;
 
 /* -------------------------------------------------------------------- */
-/*      Try to load the named grid.                                     */
+/*      Try to load the named grid.  Another thread may have loaded     */
+/*      it since we looked, so check the grids added after our tail     */
+/*      again once we hold the lock.                                    */
 /* -------------------------------------------------------------------- */
-    this_grid = pj_gridinfo_init( ctx, gridname );
+    pj_acquire_lock();
 
-    if( this_grid == NULL )
+    for( this_grid = (tail != NULL) ? tail->next : grid_list; 
+         this_grid != NULL; this_grid = this_grid->next )
     {
-        /* we should get at least a stub grid with a missing "ct" member */
-        assert( FALSE );
-        return 0;
+        if( strcmp(this_grid->gridname,gridname) == 0 )
+            break;
+        tail = this_grid;
     }
+
+    if( this_grid == NULL )
+    {
+        this_grid = pj_gridinfo_init( ctx, gridname );
+
+        if( this_grid == NULL )
+        {
+            /* we should get at least a stub grid with a missing "ct" member */
+            pj_release_lock();
+            assert( FALSE );
+            return 0;
+        }
     
-    if( tail != NULL )
-        tail->next = this_grid;
-    else
-        grid_list = this_grid;
+        if( tail != NULL )
+            PJ_STORE_RELEASE( tail->next, this_grid );
+        else
+            PJ_STORE_RELEASE( grid_list, this_grid );
+    }
+
+    pj_release_lock();
 
 /* -------------------------------------------------------------------- */
 /*      Recurse to add the grid now that it is loaded.                  */
@@ -171,8 +196,6 @@ PJ_GRIDINFO **pj_gridlist_from_nadgrids( projCtx ctx, const char *nadgrids,
     pj_errno = 0;
     *grid_count = 0;
 
-    pj_acquire_lock();
-
 /* -------------------------------------------------------------------- */
 /*      Loop processing names out of nadgrids one at a time.            */
 /* -------------------------------------------------------------------- */
@@ -195,7 +218,6 @@ PJ_GRIDINFO **pj_gridlist_from_nadgrids( projCtx ctx, const char *nadgrids,
         if( end_char >= sizeof(name) )
         {
             pj_ctx_set_errno( ctx, -38 );
-            pj_release_lock();
             return NULL;
         }
         
@@ -211,14 +233,295 @@ PJ_GRIDINFO **pj_gridlist_from_nadgrids( projCtx ctx, const char *nadgrids,
             && required )
         {
             pj_ctx_set_errno( ctx, -38 );
-            pj_release_lock();
             return NULL;
         }
         else
             pj_errno = 0;
     }
 
-    pj_release_lock();
-
     return gridlist;
 }
+
+/************************************************************************/
+/*                        pj_gridindex_extent()                         */
+/*                                                                      */
+/*      Extent of a grid as used by pj_apply_gridshift_3(), that is     */
+/*      grown by a small epsilon.                                       */
+/************************************************************************/
+
+static void pj_gridindex_extent( PJ_GRIDINFO *gi, LP *ll, LP *ur )
+
+{
+    struct CTABLE *ct = gi->ct;
+    double epsilon = (fabs(ct->del.phi)+fabs(ct->del.lam))/10000.0;
+
+    ll->phi = ct->ll.phi - epsilon;
+    ll->lam = ct->ll.lam - epsilon;
+    ur->phi = ct->ll.phi + (ct->lim.phi-1) * ct->del.phi + epsilon;
+    ur->lam = ct->ll.lam + (ct->lim.lam-1) * ct->del.lam + epsilon;
+}
+
+/************************************************************************/
+/*                         pj_gridindex_touch()                         */
+/*                                                                      */
+/*      Does the grid touch the bucket?  Sets *covers if it contains    */
+/*      all of the bucket.                                              */
+/************************************************************************/
+
+static int pj_gridindex_touch( PJ_GRIDINDEX *index, PJ_GRIDINFO *gi, 
+                               int ix, int iy, int *covers )
+
+{
+    LP ll, ur, b_ll, b_ur;
+
+    pj_gridindex_extent( gi, &ll, &ur );
+
+    b_ll.lam = index->ll.lam + ix * index->del.lam - index->slack;
+    b_ll.phi = index->ll.phi + iy * index->del.phi - index->slack;
+    b_ur.lam = index->ll.lam + (ix+1) * index->del.lam + index->slack;
+    b_ur.phi = index->ll.phi + (iy+1) * index->del.phi + index->slack;
+
+    if( covers != NULL )
+        *covers = ll.lam <= b_ll.lam && ll.phi <= b_ll.phi 
+            && ur.lam >= b_ur.lam && ur.phi >= b_ur.phi;
+
+    return ll.lam <= b_ur.lam && ll.phi <= b_ur.phi 
+        && ur.lam >= b_ll.lam && ur.phi >= b_ll.phi;
+}
+
+/************************************************************************/
+/*                      pj_gridindex_add_bucket()                       */
+/*                                                                      */
+/*      Append the entries of one bucket, or just count them when      */
+/*      entries is NULL.  Returns the number of entries.                */
+/************************************************************************/
+
+static int pj_gridindex_add_bucket( PJ_GRIDINDEX *index, 
+                                    PJ_GRIDINFO **gridlist, int gridlist_count,
+                                    int ix, int iy, 
+                                    PJ_GRIDINDEX_ENTRY *entries,
+                                    PJ_GRIDINFO **resolved )
+
+{
+    int i, count = 0;
+
+    if( resolved != NULL )
+        *resolved = NULL;
+
+    for( i = 0; i < gridlist_count; i++ )
+    {
+        PJ_GRIDINFO *child;
+        int parent = count, covers, child_covers, first = (count == 0);
+
+        if( !pj_gridindex_touch( index, gridlist[i], ix, iy, &covers ) )
+            continue;
+
+        if( entries != NULL )
+        {
+            entries[count].gi = gridlist[i];
+            entries[count].child_count = 0;
+        }
+        count++;
+
+        for( child = gridlist[i]->child; child != NULL; child = child->next )
+        {
+            if( !pj_gridindex_touch( index, child, ix, iy, &child_covers ) )
+                continue;
+
+            if( entries != NULL )
+            {
+                entries[count].gi = child;
+                entries[count].child_count = -1;
+                entries[parent].child_count++;
+            }
+
+            /* the first grid and its first child decide the whole bucket */
+            if( first && covers && resolved != NULL 
+                && count == parent + 1 && child_covers )
+                *resolved = child;
+            count++;
+        }
+
+        if( first && covers && resolved != NULL && count == parent + 1 )
+            *resolved = gridlist[i];
+    }
+
+    return count;
+}
+
+/************************************************************************/
+/*                        pj_gridindex_create()                         */
+/*                                                                      */
+/*      Build a coarse bucket index over a gridlist, so that the        */
+/*      grids (and child grids) which may apply to a point can be       */
+/*      found without testing every grid.  Each bucket lists the        */
+/*      grids touching it in gridlist order, each followed by those     */
+/*      of its children touching it.  Buckets lying wholly inside the   */
+/*      first grid to touch them (and its first child, if any child     */
+/*      touches them) are resolved to that grid up front.  There are    */
+/*      at most max_buckets buckets along each axis.                    */
+/************************************************************************/
+
+PJ_GRIDINDEX *pj_gridindex_create( PJ_GRIDINFO **gridlist, int gridlist_count,
+                                   int max_buckets )
+
+{
+    PJ_GRIDINDEX *index;
+    LP    min_size;
+    int   i, ix, iy, bucket, count;
+
+    if( gridlist == NULL || gridlist_count == 0 )
+        return NULL;
+
+    index = (PJ_GRIDINDEX *) pj_malloc(sizeof(PJ_GRIDINDEX));
+    if( index == NULL )
+        return NULL;
+    memset( index, 0, sizeof(PJ_GRIDINDEX) );
+
+/* -------------------------------------------------------------------- */
+/*      Work out the area covered, and the size of the smallest grid    */
+/*      which sets the bucket size, up to a maximum bucket count.       */
+/* -------------------------------------------------------------------- */
+    min_size.lam = min_size.phi = HUGE_VAL;
+
+    for( i = 0; i < gridlist_count; i++ )
+    {
+        PJ_GRIDINFO *gi = gridlist[i];
+        LP ll, ur;
+
+        for( ; gi != NULL; gi = (gi == gridlist[i]) ? gi->child : gi->next )
+        {
+            pj_gridindex_extent( gi, &ll, &ur );
+
+            if( ur.lam - ll.lam < min_size.lam )
+                min_size.lam = ur.lam - ll.lam;
+            if( ur.phi - ll.phi < min_size.phi )
+                min_size.phi = ur.phi - ll.phi;
+
+            if( gi != gridlist[i] )
+                continue;
+
+            if( i == 0 || ll.lam < index->extent_ll.lam )
+                index->extent_ll.lam = ll.lam;
+            if( i == 0 || ll.phi < index->extent_ll.phi )
+                index->extent_ll.phi = ll.phi;
+            if( i == 0 || ur.lam > index->extent_ur.lam )
+                index->extent_ur.lam = ur.lam;
+            if( i == 0 || ur.phi > index->extent_ur.phi )
+                index->extent_ur.phi = ur.phi;
+        }
+    }
+
+    index->ll = index->extent_ll;
+    index->del.lam = MAX( min_size.lam / 2, 
+                          (index->extent_ur.lam - index->extent_ll.lam) 
+                          / max_buckets );
+    index->del.phi = MAX( min_size.phi / 2, 
+                          (index->extent_ur.phi - index->extent_ll.phi) 
+                          / max_buckets );
+    if( !(index->del.lam > 0.0) )
+        index->del.lam = 1.0;
+    if( !(index->del.phi > 0.0) )
+        index->del.phi = 1.0;
+
+    index->lim.lam = (int) ceil((index->extent_ur.lam - index->extent_ll.lam)
+                                / index->del.lam);
+    index->lim.phi = (int) ceil((index->extent_ur.phi - index->extent_ll.phi)
+                                / index->del.phi);
+    index->lim.lam = MIN( MAX( index->lim.lam, 1 ), max_buckets );
+    index->lim.phi = MIN( MAX( index->lim.phi, 1 ), max_buckets );
+    index->slack = MIN( index->del.lam, index->del.phi ) * 1e-9;
+
+/* -------------------------------------------------------------------- */
+/*      Count the entries, then fill them in.                           */
+/* -------------------------------------------------------------------- */
+    index->start = (int *) 
+        pj_malloc(sizeof(int) * (index->lim.lam * index->lim.phi + 1));
+    index->resolved = (PJ_GRIDINFO **) 
+        pj_malloc(sizeof(PJ_GRIDINFO *) * index->lim.lam * index->lim.phi);
+    if( index->start == NULL || index->resolved == NULL )
+    {
+        pj_gridindex_free( index );
+        return NULL;
+    }
+
+    count = 0;
+    for( iy = 0; iy < index->lim.phi; iy++ )
+    {
+        for( ix = 0; ix < index->lim.lam; ix++ )
+        {
+            bucket = iy * index->lim.lam + ix;
+            index->start[bucket] = count;
+            count += pj_gridindex_add_bucket( index, gridlist, gridlist_count,
+                                              ix, iy, NULL, NULL );
+        }
+    }
+    index->start[index->lim.lam * index->lim.phi] = count;
+
+    index->entries = (PJ_GRIDINDEX_ENTRY *) 
+        pj_malloc(sizeof(PJ_GRIDINDEX_ENTRY) * MAX(count,1));
+    if( index->entries == NULL )
+    {
+        pj_gridindex_free( index );
+        return NULL;
+    }
+
+    for( iy = 0; iy < index->lim.phi; iy++ )
+    {
+        for( ix = 0; ix < index->lim.lam; ix++ )
+        {
+            bucket = iy * index->lim.lam + ix;
+            pj_gridindex_add_bucket( index, gridlist, gridlist_count, ix, iy,
+                                     index->entries + index->start[bucket],
+                                     index->resolved + bucket );
+        }
+    }
+
+    return index;
+}
+
+/************************************************************************/
+/*                        pj_gridindex_bucket()                         */
+/*                                                                      */
+/*      Return the bucket holding a point, or -1 if no grid of the      */
+/*      index can apply to it.                                          */
+/************************************************************************/
+
+int pj_gridindex_bucket( PJ_GRIDINDEX *index, LP input )
+
+{
+    int ix, iy;
+
+    /* written so that NaNs fall outside too */
+    if( !(input.lam >= index->extent_ll.lam 
+          && input.lam <= index->extent_ur.lam
+          && input.phi >= index->extent_ll.phi 
+          && input.phi <= index->extent_ur.phi) )
+        return -1;
+
+    ix = (int) ((input.lam - index->ll.lam) / index->del.lam);
+    iy = (int) ((input.phi - index->ll.phi) / index->del.phi);
+
+    if( ix >= index->lim.lam )
+        ix = index->lim.lam - 1;
+    if( iy >= index->lim.phi )
+        iy = index->lim.phi - 1;
+
+    return iy * index->lim.lam + ix;
+}
+
+/************************************************************************/
+/*                         pj_gridindex_free()                          */
+/************************************************************************/
+
+void pj_gridindex_free( PJ_GRIDINDEX *index )
+
+{
+    if( index == NULL )
+        return;
+
+    pj_dalloc( index->start );
+    pj_dalloc( index->entries );
+    pj_dalloc( index->resolved );
+    pj_dalloc( index );
+}
@@ -170,7 +170,7 @@ pj_init_plus_ctx( projCtx ctx, const char *definition )
 {
 #define MAX_ARG 200
     char	*argv[MAX_ARG];
-    char	*defn_copy;
+    char	*defn_copy, *key = NULL;
     int		argc = 0, i, blank_count = 0;
     PJ	    *result;
     
@@ -222,9 +222,44 @@ pj_init_plus_ctx( projCtx ctx, const char *definition )
     /* trim trailing spaces from the last param */
     defn_copy[i - blank_count] = '\0';
 
-    /* perform actual initialization */
-    result = pj_init_ctx( ctx, argc, argv );
+    /* build the normalized cache key, "+a +b ..." */
+    {
+        size_t key_len = 1;
+
+        for( i = 0; i < argc; i++ )
+            key_len += strlen(argv[i]) + 2;
+
+        if( (key = (char *) pj_malloc( key_len )) != NULL )
+        {
+            key[0] = '\0';
+            for( i = 0; i < argc; i++ )
+            {
+                if( i > 0 )
+                    strcat( key, " " );
+                strcat( key, "+" );
+                strcat( key, argv[i] );
+            }
+        }
+    }
+
+    /* reuse a cached definition if we have one */
+    result = key != NULL ? pj_search_pjcache( ctx, key ) : NULL;
+
+    if( result == NULL )
+    {
+        /* perform actual initialization */
+        result = pj_init_ctx( ctx, argc, argv );
 
+        if( result != NULL && key != NULL )
+        {
+            PJ *master = pj_insert_pjcache( key, result );
+
+            if( master != NULL )
+                result = pj_clone_pj( ctx, master );
+        }
+    }
+
+    pj_dalloc( key );
     pj_dalloc( defn_copy );
 
     return result;
@@ -302,6 +337,7 @@ pj_init_ctx(projCtx ctx, int argc, char **argv) {
 
     PIN->gridlist = NULL;
     PIN->gridlist_count = 0;
+    PIN->gridindex = NULL;
 
     PIN->vgridlist_geoid = NULL;
     PIN->vgridlist_geoid_count = 0;
@@ -461,12 +497,11 @@ pj_init_ctx(projCtx ctx, int argc, char **argv) {
         if (PIN)
             pj_free(PIN);
         else
-            for ( ; start; start = curr) {
-                curr = start->next;
-                pj_dalloc(start);
-            }
+            pj_free_paralist(start);
         PIN = 0;
     }
+    else
+        pj_param_index(PIN->params);
 
     if( strcmp(old_locale,"C") != 0 )
         setlocale(LC_NUMERIC,old_locale);
@@ -488,17 +523,18 @@ pj_init_ctx(projCtx ctx, int argc, char **argv) {
 void
 pj_free(PJ *P) {
     if (P) {
-        paralist *t = P->params, *n;
-
         /* free parameter list elements */
-        for (t = P->params; t; t = n) {
-            n = t->next;
-            pj_dalloc(t);
-        }
+        pj_free_paralist(P->params);
 
         /* free array of grid pointers if we have one */
         if( P->gridlist != NULL )
             pj_dalloc( P->gridlist );
+
+        if( P->gridindex != NULL )
+            pj_gridindex_free( P->gridindex );
+
+        if( P->vgridlist_geoid != NULL )
+            pj_dalloc( P->vgridlist_geoid );
         
         /* free projection parameters */
         P->pfree(P);
@@ -29,13 +29,36 @@
 
 #include <projects.h>
 #include <string.h>
+#include <errno.h>
 
 PJ_CVSID("$Id: pj_transform.c 1504 2009-01-06 02:11:57Z warmerdam $");
 
-static int cache_count = 0;
-static int cache_alloc = 0;
-static char **cache_key = NULL;
-static paralist **cache_paralist = NULL;
+/*
+** Both caches are read without taking the lock.  Entries are only ever
+** appended: the writer fills the next slot under the lock and then
+** publishes the new count.  When the arrays have to grow a new table is
+** published and the old one is kept on the retired list until
+** pj_clear_initcache(), as readers may still be walking it.
+*/
+typedef struct pj_cache_table {
+    int    count;
+    int    alloc;
+    char   **key;
+    void   **value;
+    struct pj_cache_table *retired;
+} PJ_CACHE_TABLE;
+
+/* init file definitions, paralist per "file:key" */
+static PJ_CACHE_TABLE *init_cache = NULL;
+
+/* 
+** Fully initialized PJ objects keyed by normalized "+proj=..." definition.
+** The cached masters are never handed out directly, callers get shallow
+** clones from pj_clone_pj() that share the projection specific setup.
+*/
+#define PJ_CACHE_MAX 64
+
+static PJ_CACHE_TABLE *pj_cache = NULL;
 
 /************************************************************************/
 /*                            pj_clone_paralist()                       */
@@ -54,6 +77,7 @@ paralist *pj_clone_paralist( const paralist *list)
 
       newitem->used = 0;
       newitem->next = 0;
+      newitem->index = NULL;
       strcpy( newitem->param, list->param );
       
       if( list_copy == NULL )
@@ -68,68 +92,257 @@ paralist *pj_clone_paralist( const paralist *list)
 }
 
 /************************************************************************/
-/*                            pj_clear_initcache()                      */
+/*                            pj_free_clone()                           */
 /*                                                                      */
-/*      Clear out all memory held in the init file cache.               */
+/*      pfree() for objects made by pj_clone_pj().  Only the shell      */
+/*      belongs to the clone, the projection specific allocations       */
+/*      belong to the cached master.                                    */
 /************************************************************************/
 
-void pj_clear_initcache()
+static void pj_free_clone( PJ *P )
+{
+    pj_dalloc( P );
+}
+
+/************************************************************************/
+/*                          pj_can_clone_pj()                           */
+/*                                                                      */
+/*      Projections that hold sub-projections share the parameter       */
+/*      list and context with them, so they can't be cloned shallowly.  */
+/************************************************************************/
+
+int pj_can_clone_pj( PJ *P )
+
+{
+    const char *name = pj_param(P->ctx, P->params, "sproj").s;
+
+    return name != NULL
+        && strcmp(name,"ob_tran") != 0
+        && strcmp(name,"goode") != 0
+        && strcmp(name,"igh") != 0;
+}
+
+/************************************************************************/
+/*                            pj_clone_pj()                             */
+/*                                                                      */
+/*      Make a cheap copy of an initialized PJ bound to ctx.  The      */
+/*      clone gets its own parameter list and grid state, but shares    */
+/*      read-only projection setup (en, apa, ...) with the source,      */
+/*      which must therefore outlive it.                                */
+/************************************************************************/
+
+PJ *pj_clone_pj( projCtx ctx, PJ *src )
+
 {
-    if( cache_alloc > 0 )
+    PJ *P;
+
+    if( src == NULL || src->alloc_size < sizeof(PJ) )
+        return NULL;
+
+    if( (P = (PJ *) pj_malloc( src->alloc_size )) == NULL )
     {
-        int i;
+        pj_ctx_set_errno( ctx, ENOMEM );
+        return NULL;
+    }
 
-        pj_acquire_lock();
+    memcpy( P, src, src->alloc_size );
+    P->ctx = ctx;
+    P->params = pj_clone_paralist( src->params );
+    pj_param_index( P->params );
+    P->gridlist = NULL;
+    P->gridlist_count = 0;
+    P->gridindex = NULL;
+    P->vgridlist_geoid = NULL;
+    P->vgridlist_geoid_count = 0;
+    P->pfree = pj_free_clone;
+
+    return P;
+}
 
-        for( i = 0; i < cache_count; i++ )
+/************************************************************************/
+/*                            pj_cache_find()                           */
+/*                                                                      */
+/*      Lock free lookup of key in a cache table.                       */
+/************************************************************************/
+
+static void *pj_cache_find( PJ_CACHE_TABLE **p_table, const char *key )
+
+{
+    PJ_CACHE_TABLE *table = PJ_LOAD_ACQUIRE(*p_table);
+    int i, count;
+
+    if( table == NULL )
+        return NULL;
+
+    count = PJ_LOAD_ACQUIRE(table->count);
+
+    for( i = 0; i < count; i++ )
+    {
+        if( strcmp(key,table->key[i]) == 0 )
+            return table->value[i];
+    }
+
+    return NULL;
+}
+
+/************************************************************************/
+/*                            pj_cache_add()                            */
+/*                                                                      */
+/*      Append an entry to a cache table, growing it if required.       */
+/*      The caller holds the lock.  Returns 0 if the entry could not    */
+/*      be added, or the table already holds max_count (if > 0)         */
+/*      entries.                                                        */
+/************************************************************************/
+
+static int pj_cache_add( PJ_CACHE_TABLE **p_table, const char *key, 
+                         void *value, int max_count )
+
+{
+    PJ_CACHE_TABLE *table = *p_table;
+    char *key_copy;
+
+    if( table != NULL && max_count > 0 && table->count >= max_count )
+        return 0;
+
+/* -------------------------------------------------------------------- */
+/*      Grow into a new table, retiring the old one.                    */
+/* -------------------------------------------------------------------- */
+    if( table == NULL || table->count == table->alloc )
+    {
+        PJ_CACHE_TABLE *grown;
+        int alloc = (table == NULL) ? 15 : table->alloc * 2 + 15;
+
+        grown = (PJ_CACHE_TABLE *) pj_malloc(sizeof(PJ_CACHE_TABLE));
+        if( grown == NULL )
+            return 0;
+
+        grown->key = (char **) pj_malloc(sizeof(char*) * alloc);
+        grown->value = (void **) pj_malloc(sizeof(void*) * alloc);
+        if( grown->key == NULL || grown->value == NULL )
         {
-            paralist *n, *t = cache_paralist[i];
-		
-            pj_dalloc( cache_key[i] );
-
-            /* free parameter list elements */
-            for (; t != NULL; t = n) {
-                n = t->next;
-                pj_dalloc(t);
-            }
+            pj_dalloc( grown->key );
+            pj_dalloc( grown->value );
+            pj_dalloc( grown );
+            return 0;
         }
 
-        pj_dalloc( cache_key );
-        pj_dalloc( cache_paralist );
-        cache_count = 0;
-        cache_alloc= 0;
-        cache_key = NULL;
-        cache_paralist = NULL;
+        grown->alloc = alloc;
+        grown->count = 0;
+        grown->retired = table;
+        if( table != NULL )
+        {
+            grown->count = table->count;
+            memcpy( grown->key, table->key, sizeof(char*) * table->count );
+            memcpy( grown->value, table->value, sizeof(void*) * table->count );
+        }
 
-        pj_release_lock();
+        PJ_STORE_RELEASE( *p_table, grown );
+        table = grown;
     }
+
+/* -------------------------------------------------------------------- */
+/*      Fill the next slot, then publish it.                            */
+/* -------------------------------------------------------------------- */
+    key_copy = (char *) pj_malloc(strlen(key)+1);
+    if( key_copy == NULL )
+        return 0;
+    strcpy( key_copy, key );
+
+    table->key[table->count] = key_copy;
+    table->value[table->count] = value;
+    PJ_STORE_RELEASE( table->count, table->count + 1 );
+
+    return 1;
 }
 
 /************************************************************************/
-/*                            pj_search_initcache()                     */
+/*                            pj_cache_free()                           */
 /*                                                                      */
-/*      Search for a matching definition in the init cache.             */
+/*      Free a cache table, its entries and the retired tables.  The    */
+/*      caller holds the lock.                                          */
 /************************************************************************/
 
-paralist *pj_search_initcache( const char *filekey )
+static void pj_cache_free( PJ_CACHE_TABLE **p_table, 
+                           void (*free_value)(void *) )
 
 {
+    PJ_CACHE_TABLE *table = *p_table, *retired;
     int i;
-    paralist *result = NULL;
 
-    pj_acquire_lock();
+    if( table == NULL )
+        return;
+
+    PJ_STORE_RELEASE( *p_table, (PJ_CACHE_TABLE *) NULL );
+
+    for( i = 0; i < table->count; i++ )
+    {
+        pj_dalloc( table->key[i] );
+        free_value( table->value[i] );
+    }
 
-    for( i = 0; result == NULL && i < cache_count; i++)
+    for( ; table != NULL; table = retired )
     {
-        if( strcmp(filekey,cache_key[i]) == 0 )
-	{
-            result = pj_clone_paralist( cache_paralist[i] );
-	}
+        retired = table->retired;
+        pj_dalloc( table->key );
+        pj_dalloc( table->value );
+        pj_dalloc( table );
     }
+}
+
+/************************************************************************/
+/*                       pj_cache_free_paralist()                       */
+/************************************************************************/
+
+static void pj_cache_free_paralist( void *value )
+
+{
+    pj_free_paralist( (paralist *) value );
+}
+
+/************************************************************************/
+/*                          pj_cache_free_pj()                          */
+/************************************************************************/
+
+static void pj_cache_free_pj( void *value )
+
+{
+    pj_free( (PJ *) value );
+}
+
+/************************************************************************/
+/*                            pj_clear_initcache()                      */
+/*                                                                      */
+/*      Clear out all memory held in the init file cache and the PJ    */
+/*      cache.  No other thread may be using the caches, and no clone   */
+/*      handed out by pj_search_pjcache() may still be in use when      */
+/*      this is called.                                                 */
+/************************************************************************/
+
+void pj_clear_initcache()
+{
+    pj_acquire_lock();
+
+    pj_cache_free( &init_cache, pj_cache_free_paralist );
+    pj_cache_free( &pj_cache, pj_cache_free_pj );
 
     pj_release_lock();
+}
 
-    return result;
+/************************************************************************/
+/*                            pj_search_initcache()                     */
+/*                                                                      */
+/*      Search for a matching definition in the init cache.             */
+/************************************************************************/
+
+paralist *pj_search_initcache( const char *filekey )
+
+{
+    paralist *list = (paralist *) pj_cache_find( &init_cache, filekey );
+
+    if( list == NULL )
+        return NULL;
+
+    return pj_clone_paralist( list );
 }
 
 /************************************************************************/
@@ -141,41 +354,78 @@ paralist *pj_search_initcache( const char *filekey )
 void pj_insert_initcache( const char *filekey, const paralist *list )
 
 {
+    paralist *list_copy = pj_clone_paralist( list );
+
+    pj_acquire_lock();
+
+    if( !pj_cache_add( &init_cache, filekey, list_copy, 0 ) )
+        pj_cache_free_paralist( list_copy );
+
+    pj_release_lock();
+}
+
+/************************************************************************/
+/*                            pj_search_pjcache()                       */
+/*                                                                      */
+/*      Return a clone bound to ctx of the cached PJ for key, or       */
+/*      NULL if there is none.                                          */
+/************************************************************************/
+
+PJ *pj_search_pjcache( projCtx ctx, const char *key )
+
+{
+    PJ *master = (PJ *) pj_cache_find( &pj_cache, key );
+
+    if( master == NULL )
+        return NULL;
+
+    return pj_clone_pj( ctx, master );
+}
+
+/************************************************************************/
+/*                            pj_insert_pjcache()                       */
+/*                                                                      */
+/*      Offer a freshly initialized PJ to the cache.  On success the   */
+/*      cache takes ownership and the master to clone from is           */
+/*      returned; this may be an existing entry for the same key, in    */
+/*      which case P is freed.  NULL means P was not cached and still   */
+/*      belongs to the caller.                                          */
+/************************************************************************/
+
+PJ *pj_insert_pjcache( const char *key, PJ *P )
+
+{
+    projCtx default_ctx = pj_get_default_ctx();
+    PJ *result;
+
+    if( P == NULL )
+        return NULL;
+
+    if( !pj_can_clone_pj( P ) )
+        return NULL;
+
     pj_acquire_lock();
 
-    /* 
-    ** Grow list if required.
-    */
-    if( cache_count == cache_alloc )
-    {
-        char **cache_key_new;
-        paralist **cache_paralist_new;
-
-        cache_alloc = cache_alloc * 2 + 15;
-
-        cache_key_new = (char **) pj_malloc(sizeof(char*) * cache_alloc);
-        memcpy( cache_key_new, cache_key, sizeof(char*) * cache_count);
-        pj_dalloc( cache_key );
-        cache_key = cache_key_new;
-
-        cache_paralist_new = (paralist **) 
-            pj_malloc(sizeof(paralist*) * cache_alloc);
-        memcpy( cache_paralist_new, cache_paralist, 
-                sizeof(paralist*) * cache_count );
-        pj_dalloc( cache_paralist );
-        cache_paralist = cache_paralist_new;
-    }
+    result = (PJ *) pj_cache_find( &pj_cache, key );
 
-    /*
-    ** Duplicate the filekey and paralist, and insert in cache.
-    */
-    cache_key[cache_count] = (char *) pj_malloc(strlen(filekey)+1);
-    strcpy( cache_key[cache_count], filekey );
+    if( result == NULL )
+    {
+        /* the master must not refer to the caller's context, it is */
+        /* rebound before being published, and back if it is not.    */
+        projCtx caller_ctx = P->ctx;
 
-    cache_paralist[cache_count] = pj_clone_paralist( list );
+        P->ctx = default_ctx;
 
-    cache_count++;
+        if( pj_cache_add( &pj_cache, key, P, PJ_CACHE_MAX ) )
+            result = P;
+        else
+            P->ctx = caller_ctx;
+    }
 
     pj_release_lock();
-}
 
+    if( result != NULL && result != P )
+        pj_free( P );
+
+    return result;
+}
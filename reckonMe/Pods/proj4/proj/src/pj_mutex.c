@@ -43,8 +43,13 @@ PJ_CVSID("$Id: pj_transform.c 1504 2009-01-06 02:11:57Z warmerdam $");
 #  undef  MUTEX_pthread
 #endif
 
+/* elsewhere default to pthreads where we know they are available */
 #if !defined(MUTEX_stub) && !defined(MUTEX_pthread) && !defined(MUTEX_win32)
-#  define MUTEX_stub
+#  if defined(__unix__) || defined(__APPLE__)
+#    define MUTEX_pthread
+#  else
+#    define MUTEX_stub
+#  endif
 #endif
 
 static void pj_init_lock();
@@ -96,16 +101,20 @@ void pj_cleanup_lock()
 
 #include "pthread.h"
 
-static pthread_mutex_t pj_core_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pj_core_lock;
+static pthread_once_t pj_core_lock_once = PTHREAD_ONCE_INIT;
 
 /************************************************************************/
 /*                          pj_acquire_lock()                           */
 /*                                                                      */
-/*      Acquire the PROJ.4 lock.                                        */
+/*      Acquire the PROJ.4 lock.  The lock is only taken on the         */
+/*      slow paths (loading grids, growing the caches), readers of      */
+/*      already published data don't need it.                          */
 /************************************************************************/
 
 void pj_acquire_lock()
 {
+    pthread_once( &pj_core_lock_once, pj_init_lock );
     pthread_mutex_lock( &pj_core_lock);
 }
 
@@ -127,6 +136,25 @@ void pj_cleanup_lock()
 {
 }
 
+/************************************************************************/
+/*                            pj_init_lock()                            */
+/*                                                                      */
+/*      The lock is recursive as the slow paths may nest, for           */
+/*      instance loading a grid while holding the lock calls            */
+/*      pj_get_default_ctx().                                           */
+/************************************************************************/
+
+static void pj_init_lock()
+
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+    pthread_mutex_init( &pj_core_lock, &attr );
+    pthread_mutexattr_destroy( &attr );
+}
+
 #endif // def MUTEX_pthread
 
 /************************************************************************/
@@ -9,6 +9,7 @@ pj_mkparam(char *str) {
 	if((newitem = (paralist *)pj_malloc(sizeof(paralist) + strlen(str))) != NULL) {
 		newitem->used = 0;
 		newitem->next = 0;
+		newitem->index = 0;
 		if (*str == '+')
 			++str;
 		(void)strcpy(newitem->param, str);
@@ -16,6 +17,169 @@ pj_mkparam(char *str) {
 	return newitem;
 }
 
+/************************************************************************/
+/*                           pj_free_paralist()                         */
+/*                                                                      */
+/*      Free a parameter list along with the lookup tables hung off     */
+/*      its elements.                                                   */
+/************************************************************************/
+
+void pj_free_paralist(paralist *pl) {
+	paralist *n;
+
+	for (; pl; pl = n) {
+		n = pl->next;
+		pj_param_index_free(pl);
+		pj_dalloc(pl);
+	}
+}
+
+/* -------------------------------------------------------------------- */
+/*      Parameter lookup table.  The first pj_param() call on a list    */
+/*      hashes the names of all its elements into an open addressing   */
+/*      table hung off the list head, later calls pick up elements      */
+/*      appended since.  Like the linear search, a name maps to its     */
+/*      first occurrence.  Code removing elements from a list has to    */
+/*      drop the table with pj_param_index_free().                      */
+/* -------------------------------------------------------------------- */
+
+struct PJ_PARAM_INDEX {
+	paralist *tail;		/* last element in the table */
+	int count;		/* distinct names in the table */
+	int size;		/* number of slots, a power of two */
+	paralist *slot[1];
+};
+
+#define PARAM_INDEX_MIN_SIZE 32
+
+	static unsigned /* FNV-1a hash of a parameter name */
+param_hash(const char *name, unsigned l) {
+	unsigned h = 2166136261u;
+
+	while (l--)
+		h = (h ^ (unsigned char) *name++) * 16777619u;
+	return h;
+}
+
+	static unsigned /* length of the name part of a list element */
+param_name_length(const char *param) {
+	const char *s = param;
+
+	while (*s && *s != '=')
+		++s;
+	return (unsigned) (s - param);
+}
+
+	static paralist ** /* slot holding the name or the empty one to take it */
+param_index_slot(struct PJ_PARAM_INDEX *index, const char *name, unsigned l) {
+	unsigned i = param_hash(name, l) & (index->size - 1);
+	paralist **slot;
+
+	for (;;) {
+		slot = index->slot + i;
+		if (!*slot || (!strncmp((*slot)->param, name, l) &&
+		  (!(*slot)->param[l] || (*slot)->param[l] == '=')))
+			return slot;
+		i = (i + 1) & (index->size - 1);
+	}
+}
+
+	static struct PJ_PARAM_INDEX *
+param_index_alloc(int size) {
+	struct PJ_PARAM_INDEX *index;
+
+	index = (struct PJ_PARAM_INDEX *) pj_malloc(sizeof(struct PJ_PARAM_INDEX)
+	  + (size - 1) * sizeof(paralist *));
+	if (index) {
+		index->tail = NULL;
+		index->count = 0;
+		index->size = size;
+		memset(index->slot, 0, size * sizeof(paralist *));
+	}
+	return index;
+}
+
+	static int /* add an element unless its name is in already */
+param_index_add(struct PJ_PARAM_INDEX **index, paralist *item) {
+	struct PJ_PARAM_INDEX *t = *index;
+	paralist **slot;
+
+	slot = param_index_slot(t, item->param, param_name_length(item->param));
+	if (*slot)
+		return 1;
+
+	/* keep the load factor at or below one half */
+	if (2 * (t->count + 1) > t->size) {
+		struct PJ_PARAM_INDEX *grown;
+		int i;
+
+		if (!(grown = param_index_alloc(2 * t->size)))
+			return 0;
+		grown->tail = t->tail;
+		grown->count = t->count;
+		for (i = 0; i < t->size; ++i)
+			if (t->slot[i])
+				*param_index_slot(grown, t->slot[i]->param,
+				  param_name_length(t->slot[i]->param)) = t->slot[i];
+		pj_dalloc(t);
+		*index = t = grown;
+		slot = param_index_slot(t, item->param, param_name_length(item->param));
+	}
+	*slot = item;
+	++t->count;
+	return 1;
+}
+
+	static struct PJ_PARAM_INDEX * /* table for the list, NULL if out of memory */
+param_index_update(paralist *pl) {
+	paralist *item;
+
+	if (!pl->index) {
+		if (!(pl->index = param_index_alloc(PARAM_INDEX_MIN_SIZE)))
+			return NULL;
+		if (!param_index_add(&pl->index, pl)) {
+			pj_param_index_free(pl);
+			return NULL;
+		}
+		pl->index->tail = pl;
+	}
+	for (item = pl->index->tail->next; item; item = item->next) {
+		if (!param_index_add(&pl->index, item)) {
+			pj_param_index_free(pl);
+			return NULL;
+		}
+		pl->index->tail = item;
+	}
+	return pl->index;
+}
+
+/************************************************************************/
+/*                            pj_param_index()                          */
+/*                                                                      */
+/*      Bring the lookup table of a complete list up to date.  This is  */
+/*      done for the lists of objects handed out to the application,    */
+/*      so that threads sharing an object never build its table         */
+/*      concurrently in pj_param().                                     */
+/************************************************************************/
+
+void pj_param_index(paralist *pl) {
+
+	if (pl)
+		param_index_update(pl);
+}
+
+/************************************************************************/
+/*                         pj_param_index_free()                        */
+/************************************************************************/
+
+void pj_param_index_free(paralist *pl) {
+
+	if (pl && pl->index) {
+		pj_dalloc(pl->index);
+		pl->index = NULL;
+	}
+}
+
 /************************************************************************/
 /*                              pj_param()                              */
 /*                                                                      */
@@ -39,16 +203,19 @@ pj_param(projCtx ctx, paralist *pl, const char *opt) {
 	int type;
 	unsigned l;
 	PVALUE value;
+	struct PJ_PARAM_INDEX *index;
 
 	if( ctx == NULL )
 		ctx = pj_get_default_ctx();
 
 	type = *opt++;
-	/* simple linear lookup */
 	l = strlen(opt);
-	while (pl && !(!strncmp(pl->param, opt, l) &&
-	  (!pl->param[l] || pl->param[l] == '=')))
-		pl = pl->next;
+	if (pl && (index = param_index_update(pl)) != NULL)
+		pl = *param_index_slot(index, opt, l);
+	else /* simple linear lookup */
+		while (pl && !(!strncmp(pl->param, opt, l) &&
+		  (!pl->param[l] || pl->param[l] == '=')))
+			pl = pl->next;
 	if (type == 't')
 		value.i = pl != 0;
 	else if (pl) {
@@ -32,8 +32,15 @@
 #include <projects.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
 #include "geocent.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#  define PJ_TRANSFORM_THREADS
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
 PJ_CVSID("$Id: pj_transform.c 2000 2011-05-10 17:06:33Z warmerdam $");
 
 static int pj_adjust_axis( projCtx ctx, const char *axis, int denormalize_flag,
@@ -48,6 +55,9 @@ static int pj_adjust_axis( projCtx ctx, const char *axis, int denormalize_flag,
 #define SRS_WGS84_ESQUARED 0.0066943799901413165
 #endif
 
+/* fewer contiguous points than this aren't worth the block kernels */
+#define GEOCENT_MIN_BATCH 8
+
 #define Dx_BF (defn->datum_params[0])
 #define Dy_BF (defn->datum_params[1])
 #define Dz_BF (defn->datum_params[2])
@@ -369,30 +379,222 @@ int pj_transform( PJ *srcdefn, PJ *dstdefn, long point_count, int point_offset,
     return 0;
 }
 
+/* points per chunk of pj_transform_mt(), three coordinates fit in L1 */
+#define PJ_TRANSFORM_CHUNK        1024
+#define PJ_TRANSFORM_MAX_THREADS  32
+
+typedef struct {
+    PJ      *srcdefn;
+    PJ      *dstdefn;
+    long    point_count;
+    int     point_offset;
+    double  *x, *y, *z;
+    long    chunk_count;
+    long    next_chunk;     /* next chunk to be claimed */
+    long    failed_chunk;   /* first chunk with a hard error */
+    int     err;            /* and its error */
+#ifdef PJ_TRANSFORM_THREADS
+    pthread_mutex_t lock;
+#endif
+} PJ_TRANSFORM_JOB;
+
 /************************************************************************/
-/*                     pj_geodetic_to_geocentric()                      */
+/*                        pj_transform_worker()                         */
+/*                                                                      */
+/*      Claim chunks of a job and run them through pj_transform()       */
+/*      until none are left.  Each worker uses its own context and      */
+/*      its own clones of the definitions, as pj_transform() writes     */
+/*      errors and lazily loaded grid lists to them.                    */
 /************************************************************************/
 
-int pj_geodetic_to_geocentric( double a, double es, 
-                               long point_count, int point_offset,
-                               double *x, double *y, double *z )
+static void *pj_transform_worker( void *arg )
+
+{
+    PJ_TRANSFORM_JOB *job = (PJ_TRANSFORM_JOB *) arg;
+    projCtx_t ctx = *job->srcdefn->ctx;
+    PJ *srcdefn, *dstdefn;
+
+    ctx.last_errno = 0;
+    srcdefn = pj_clone_pj( &ctx, job->srcdefn );
+    dstdefn = pj_clone_pj( &ctx, job->dstdefn );
+
+    for( ;; )
+    {
+        long chunk, failed_chunk, first, count, io;
+        int err;
+
+#ifdef PJ_TRANSFORM_THREADS
+        pthread_mutex_lock( &job->lock );
+#endif
+        chunk = job->next_chunk++;
+        failed_chunk = job->failed_chunk;
+#ifdef PJ_TRANSFORM_THREADS
+        pthread_mutex_unlock( &job->lock );
+#endif
+
+        /* stop at the end, or after an earlier chunk failed */
+        if( chunk >= job->chunk_count || chunk > failed_chunk )
+            break;
+
+        first = chunk * PJ_TRANSFORM_CHUNK;
+        count = MIN(PJ_TRANSFORM_CHUNK, job->point_count - first);
+        io = first * job->point_offset;
+
+        if( srcdefn == NULL || dstdefn == NULL )
+            err = ENOMEM;
+        else
+            err = pj_transform( srcdefn, dstdefn, count, job->point_offset,
+                                job->x + io, job->y + io, 
+                                job->z != NULL ? job->z + io : NULL );
+
+        if( err != 0 )
+        {
+#ifdef PJ_TRANSFORM_THREADS
+            pthread_mutex_lock( &job->lock );
+#endif
+            if( chunk < job->failed_chunk )
+            {
+                job->failed_chunk = chunk;
+                job->err = err;
+            }
+#ifdef PJ_TRANSFORM_THREADS
+            pthread_mutex_unlock( &job->lock );
+#endif
+        }
+    }
+
+    pj_free( srcdefn );
+    pj_free( dstdefn );
+
+    return NULL;
+}
+
+/************************************************************************/
+/*                          pj_transform_mt()                           */
+/*                                                                      */
+/*      pj_transform() for large point arrays.  The points are split    */
+/*      into cache sized chunks, each of which goes through all the     */
+/*      stages of pj_transform() before the next is started, and the    */
+/*      chunks are shared out over thread_count threads (0 for one      */
+/*      per CPU) by letting each thread claim the next free chunk.      */
+/*                                                                      */
+/*      The return value and the definitions' context errno are as      */
+/*      for pj_transform() on the first chunk that failed.  Unlike      */
+/*      pj_transform() points after the failing chunk may already       */
+/*      have been transformed.                                          */
+/************************************************************************/
+
+int pj_transform_mt( PJ *srcdefn, PJ *dstdefn, 
+                     long point_count, int point_offset,
+                     double *x, double *y, double *z, int thread_count )
+
+{
+    PJ_TRANSFORM_JOB job;
+
+    if( point_offset == 0 )
+        point_offset = 1;
+
+    if( point_count <= PJ_TRANSFORM_CHUNK
+        || !pj_can_clone_pj( srcdefn ) || !pj_can_clone_pj( dstdefn ) )
+        return pj_transform( srcdefn, dstdefn, point_count, point_offset,
+                             x, y, z );
+
+    memset( &job, 0, sizeof(job) );
+    job.srcdefn = srcdefn;
+    job.dstdefn = dstdefn;
+    job.point_count = point_count;
+    job.point_offset = point_offset;
+    job.x = x;
+    job.y = y;
+    job.z = z;
+    job.chunk_count = (point_count + PJ_TRANSFORM_CHUNK - 1) / PJ_TRANSFORM_CHUNK;
+    job.failed_chunk = job.chunk_count;
+
+#ifdef PJ_TRANSFORM_THREADS
+    {
+        pthread_t threads[PJ_TRANSFORM_MAX_THREADS];
+        int i, started = 0;
+
+        if( thread_count <= 0 )
+            thread_count = (int) sysconf( _SC_NPROCESSORS_ONLN );
+        thread_count = MAX(thread_count, 1);
+        thread_count = MIN(thread_count, PJ_TRANSFORM_MAX_THREADS);
+        if( thread_count > job.chunk_count )
+            thread_count = (int) job.chunk_count;
+
+        pthread_mutex_init( &job.lock, NULL );
+
+        /* the calling thread is one of the workers */
+        for( i = 1; i < thread_count; i++ )
+        {
+            if( pthread_create( threads + started, NULL, 
+                                pj_transform_worker, &job ) == 0 )
+                started++;
+        }
+
+        pj_transform_worker( &job );
+
+        for( i = 0; i < started; i++ )
+            pthread_join( threads[i], NULL );
+
+        pthread_mutex_destroy( &job.lock );
+    }
+#else
+    pj_transform_worker( &job );
+#endif
+
+    srcdefn->ctx->last_errno = job.err;
+    dstdefn->ctx->last_errno = job.err;
+
+    return job.err;
+}
+
+/************************************************************************/
+/*                        pj_geocentric_info()                          */
+/*                                                                      */
+/*      Set up the geocentric conversion constants for an ellipsoid.    */
+/************************************************************************/
+
+static int pj_geocentric_info( double a, double es, GeocentricInfo *gi )
 
 {
     double b;
-    int    i;
-    GeocentricInfo gi;
-    int ret_errno = 0;
 
     if( es == 0.0 )
         b = a;
     else
         b = a * sqrt(1-es);
 
-    if( pj_Set_Geocentric_Parameters( &gi, a, b ) != 0 )
+    if( pj_Set_Geocentric_Parameters( gi, a, b ) != 0 )
     {
         return PJD_ERR_GEOCENTRIC;
     }
 
+    return 0;
+}
+
+/************************************************************************/
+/*                   pj_geodetic_to_geocentric_gi()                     */
+/************************************************************************/
+
+static int pj_geodetic_to_geocentric_gi( GeocentricInfo *gi,
+                                         long point_count, int point_offset,
+                                         double *x, double *y, double *z )
+
+{
+    int    i;
+    int ret_errno = 0;
+
+    /* contiguous points go through the block kernel */
+    if( point_offset == 1 && point_count >= GEOCENT_MIN_BATCH )
+    {
+        if( pj_Convert_Geodetic_To_Geocentric_Batch( gi, point_count, 
+                                                     y, x, z, x, y, z ) != 0 )
+            ret_errno = -14;
+
+        return ret_errno;
+    }
+
     for( i = 0; i < point_count; i++ )
     {
         long io = i * point_offset;
@@ -400,7 +602,7 @@ int pj_geodetic_to_geocentric( double a, double es,
         if( x[io] == HUGE_VAL  )
             continue;
 
-        if( pj_Convert_Geodetic_To_Geocentric( &gi, y[io], x[io], z[io], 
+        if( pj_Convert_Geodetic_To_Geocentric( gi, y[io], x[io], z[io], 
                                                x+io, y+io, z+io ) != 0 )
         {
             ret_errno = -14;
@@ -416,23 +618,37 @@ int pj_geodetic_to_geocentric( double a, double es,
 /*                     pj_geodetic_to_geocentric()                      */
 /************************************************************************/
 
-int pj_geocentric_to_geodetic( double a, double es, 
+int pj_geodetic_to_geocentric( double a, double es, 
                                long point_count, int point_offset,
                                double *x, double *y, double *z )
 
 {
-    double b;
-    int    i;
     GeocentricInfo gi;
 
-    if( es == 0.0 )
-        b = a;
-    else
-        b = a * sqrt(1-es);
+    if( pj_geocentric_info( a, es, &gi ) != 0 )
+        return PJD_ERR_GEOCENTRIC;
+
+    return pj_geodetic_to_geocentric_gi( &gi, point_count, point_offset, 
+                                         x, y, z );
+}
+
+/************************************************************************/
+/*                   pj_geocentric_to_geodetic_gi()                     */
+/************************************************************************/
+
+static int pj_geocentric_to_geodetic_gi( GeocentricInfo *gi,
+                                         long point_count, int point_offset,
+                                         double *x, double *y, double *z )
 
-    if( pj_Set_Geocentric_Parameters( &gi, a, b ) != 0 )
+{
+    int    i;
+
+    /* contiguous points go through the block kernel */
+    if( point_offset == 1 && point_count >= GEOCENT_MIN_BATCH )
     {
-        return PJD_ERR_GEOCENTRIC;
+        pj_Convert_Geocentric_To_Geodetic_Batch( gi, point_count, x, y, z,
+                                                 y, x, z );
+        return 0;
     }
 
     for( i = 0; i < point_count; i++ )
@@ -442,13 +658,31 @@ int pj_geocentric_to_geodetic( double a, double es,
         if( x[io] == HUGE_VAL )
             continue;
 
-        pj_Convert_Geocentric_To_Geodetic( &gi, x[io], y[io], z[io], 
+        pj_Convert_Geocentric_To_Geodetic( gi, x[io], y[io], z[io], 
                                            y+io, x+io, z+io );
     }
 
     return 0;
 }
 
+/************************************************************************/
+/*                     pj_geodetic_to_geocentric()                      */
+/************************************************************************/
+
+int pj_geocentric_to_geodetic( double a, double es, 
+                               long point_count, int point_offset,
+                               double *x, double *y, double *z )
+
+{
+    GeocentricInfo gi;
+
+    if( pj_geocentric_info( a, es, &gi ) != 0 )
+        return PJD_ERR_GEOCENTRIC;
+
+    return pj_geocentric_to_geodetic_gi( &gi, point_count, point_offset, 
+                                         x, y, z );
+}
+
 /************************************************************************/
 /*                         pj_compare_datums()                          */
 /*                                                                      */
@@ -592,20 +826,97 @@ int pj_geocentric_from_wgs84( PJ *defn,
 }
 
 /************************************************************************/
-/*                         pj_datum_transform()                         */
+/*                           PJ_DATUM_PLAN                              */
 /*                                                                      */
-/*      The input should be long/lat/z coordinates in radians in the    */
-/*      source datum, and the output should be long/lat/z               */
-/*      coordinates in radians in the destination datum.                */
+/*      Everything pj_datum_transform() derives from a pair of          */
+/*      definitions, so it can be worked out once and reused for        */
+/*      many calls.  The 3 and 7 parameter shifts of both datums are    */
+/*      composed into a single affine transform of geocentric           */
+/*      coordinates.                                                    */
 /************************************************************************/
 
-int pj_datum_transform( PJ *srcdefn, PJ *dstdefn, 
-                        long point_count, int point_offset,
-                        double *x, double *y, double *z )
+struct PJ_DATUM_PLAN {
+    PJ      *srcdefn;
+    PJ      *dstdefn;
+    int     noop;           /* unknown or identical datums */
+    int     geocentric;     /* go through geocentric coordinates */
+    int     src_error;      /* PJD_ERR_GEOCENTRIC if src_gi is unusable */
+    int     dst_error;
+    GeocentricInfo src_gi;
+    GeocentricInfo dst_gi;
+    int     helmert;        /* 0 none, 1 shift only, 2 rotation and scale */
+    double  rot[3][3];      /* src geocentric to dst geocentric */
+    double  shift[3];
+    double  *z_temp;        /* zero heights when the caller has no z */
+    long    z_temp_size;
+};
+
+/************************************************************************/
+/*                         pj_datum_helmert()                           */
+/*                                                                      */
+/*      Affine form of pj_geocentric_to_wgs84() (inverse = 0) or        */
+/*      pj_geocentric_from_wgs84() (inverse = 1), the identity for      */
+/*      other datum types.                                              */
+/************************************************************************/
+
+static void pj_datum_helmert( PJ *defn, int inverse, 
+                              double rot[3][3], double shift[3] )
 
 {
-    double      src_a, src_es, dst_a, dst_es;
-    int         z_is_temp = FALSE;
+    int i, j;
+
+    for( i = 0; i < 3; i++ )
+    {
+        for( j = 0; j < 3; j++ )
+            rot[i][j] = (i == j) ? 1.0 : 0.0;
+        shift[i] = 0.0;
+    }
+
+    if( defn->datum_type != PJD_3PARAM && defn->datum_type != PJD_7PARAM )
+        return;
+
+    if( defn->datum_type == PJD_7PARAM && !inverse )
+    {
+        rot[0][0] =  M_BF;       rot[0][1] = -M_BF*Rz_BF; rot[0][2] =  M_BF*Ry_BF;
+        rot[1][0] =  M_BF*Rz_BF; rot[1][1] =  M_BF;       rot[1][2] = -M_BF*Rx_BF;
+        rot[2][0] = -M_BF*Ry_BF; rot[2][1] =  M_BF*Rx_BF; rot[2][2] =  M_BF;
+    }
+    else if( defn->datum_type == PJD_7PARAM )
+    {
+        double m = 1.0 / M_BF;
+
+        rot[0][0] =  m;          rot[0][1] =  m*Rz_BF;    rot[0][2] = -m*Ry_BF;
+        rot[1][0] = -m*Rz_BF;    rot[1][1] =  m;          rot[1][2] =  m*Rx_BF;
+        rot[2][0] =  m*Ry_BF;    rot[2][1] = -m*Rx_BF;    rot[2][2] =  m;
+    }
+
+    if( !inverse )
+    {
+        shift[0] = Dx_BF;
+        shift[1] = Dy_BF;
+        shift[2] = Dz_BF;
+    }
+    else
+    {
+        for( i = 0; i < 3; i++ )
+            shift[i] = -(rot[i][0] * Dx_BF + rot[i][1] * Dy_BF 
+                         + rot[i][2] * Dz_BF);
+    }
+}
+
+/************************************************************************/
+/*                         pj_datum_plan_init()                         */
+/************************************************************************/
+
+static void pj_datum_plan_init( PJ_DATUM_PLAN *plan, 
+                                PJ *srcdefn, PJ *dstdefn )
+
+{
+    double src_a, src_es, dst_a, dst_es;
+
+    memset( plan, 0, sizeof(PJ_DATUM_PLAN) );
+    plan->srcdefn = srcdefn;
+    plan->dstdefn = dstdefn;
 
 /* -------------------------------------------------------------------- */
 /*      We cannot do any meaningful datum transformation if either      */
@@ -615,13 +926,19 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
 /* -------------------------------------------------------------------- */
     if( srcdefn->datum_type == PJD_UNKNOWN
         || dstdefn->datum_type == PJD_UNKNOWN )
-        return 0;
+    {
+        plan->noop = TRUE;
+        return;
+    }
 
 /* -------------------------------------------------------------------- */
 /*      Short cut if the datums are identical.                          */
 /* -------------------------------------------------------------------- */
     if( pj_compare_datums( srcdefn, dstdefn ) )
-        return 0;
+    {
+        plan->noop = TRUE;
+        return;
+    }
 
     src_a = srcdefn->a_orig;
     src_es = srcdefn->es_orig;
@@ -629,28 +946,9 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
     dst_a = dstdefn->a_orig;
     dst_es = dstdefn->es_orig;
 
-/* -------------------------------------------------------------------- */
-/*      Create a temporary Z array if one is not provided.              */
-/* -------------------------------------------------------------------- */
-    if( z == NULL )
-    {
-        int	bytes = sizeof(double) * point_count * point_offset;
-        z = (double *) pj_malloc(bytes);
-        memset( z, 0, bytes );
-        z_is_temp = TRUE;
-    }
-
-#define CHECK_RETURN(defn) {if( defn->ctx->last_errno != 0 && (defn->ctx->last_errno > 0 || transient_error[-defn->ctx->last_errno] == 0) ) { if( z_is_temp ) pj_dalloc(z); return defn->ctx->last_errno; }}
-
-/* -------------------------------------------------------------------- */
-/*	If this datum requires grid shifts, then apply it to geodetic   */
-/*      coordinates.                                                    */
-/* -------------------------------------------------------------------- */
+    /* grid shifts take us to or from WGS84 */
     if( srcdefn->datum_type == PJD_GRIDSHIFT )
     {
-        pj_apply_gridshift_2( srcdefn, 0, point_count, point_offset, x, y, z );
-        CHECK_RETURN(srcdefn);
-
         src_a = SRS_WGS84_SEMIMAJOR;
         src_es = SRS_WGS84_ESQUARED;
     }
@@ -661,46 +959,199 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
         dst_es = SRS_WGS84_ESQUARED;
     }
 
-/* ==================================================================== */
+/* -------------------------------------------------------------------- */
 /*      Do we need to go through geocentric coordinates?                */
-/* ==================================================================== */
+/* -------------------------------------------------------------------- */
     if( src_es != dst_es || src_a != dst_a
         || srcdefn->datum_type == PJD_3PARAM 
         || srcdefn->datum_type == PJD_7PARAM
         || dstdefn->datum_type == PJD_3PARAM 
         || dstdefn->datum_type == PJD_7PARAM)
     {
+        double src_rot[3][3], src_shift[3], dst_rot[3][3], dst_shift[3];
+        int i, j;
+
+        plan->geocentric = TRUE;
+        plan->src_error = pj_geocentric_info( src_a, src_es, &plan->src_gi );
+        plan->dst_error = pj_geocentric_info( dst_a, dst_es, &plan->dst_gi );
+
+/* -------------------------------------------------------------------- */
+/*      Compose src -> WGS84 -> dst.                                    */
+/* -------------------------------------------------------------------- */
+        pj_datum_helmert( srcdefn, 0, src_rot, src_shift );
+        pj_datum_helmert( dstdefn, 1, dst_rot, dst_shift );
+
+        for( i = 0; i < 3; i++ )
+        {
+            for( j = 0; j < 3; j++ )
+                plan->rot[i][j] = dst_rot[i][0] * src_rot[0][j]
+                    + dst_rot[i][1] * src_rot[1][j]
+                    + dst_rot[i][2] * src_rot[2][j];
+
+            plan->shift[i] = dst_rot[i][0] * src_shift[0]
+                + dst_rot[i][1] * src_shift[1]
+                + dst_rot[i][2] * src_shift[2] + dst_shift[i];
+        }
+
+        if( srcdefn->datum_type == PJD_7PARAM 
+            || dstdefn->datum_type == PJD_7PARAM )
+            plan->helmert = 2;
+        else if( srcdefn->datum_type == PJD_3PARAM 
+                 || dstdefn->datum_type == PJD_3PARAM )
+            plan->helmert = 1;
+    }
+}
+
+/************************************************************************/
+/*                        pj_datum_plan_create()                        */
+/*                                                                      */
+/*      Work out the datum transformation between two definitions      */
+/*      once, for use with pj_datum_plan_transform().  Both             */
+/*      definitions must outlive the plan.                              */
+/************************************************************************/
+
+PJ_DATUM_PLAN *pj_datum_plan_create( PJ *srcdefn, PJ *dstdefn )
+
+{
+    PJ_DATUM_PLAN *plan;
+
+    plan = (PJ_DATUM_PLAN *) pj_malloc(sizeof(PJ_DATUM_PLAN));
+    if( plan == NULL )
+    {
+        pj_ctx_set_errno( srcdefn->ctx, ENOMEM );
+        return NULL;
+    }
+
+    pj_datum_plan_init( plan, srcdefn, dstdefn );
+
+    return plan;
+}
+
+/************************************************************************/
+/*                         pj_datum_plan_free()                         */
+/************************************************************************/
+
+void pj_datum_plan_free( PJ_DATUM_PLAN *plan )
+
+{
+    if( plan != NULL )
+    {
+        pj_dalloc( plan->z_temp );
+        pj_dalloc( plan );
+    }
+}
+
+/************************************************************************/
+/*                      pj_datum_plan_transform()                       */
+/*                                                                      */
+/*      pj_datum_transform() using a prepared plan.  The temporary      */
+/*      Z array is kept with the plan, so repeated calls don't          */
+/*      allocate.                                                       */
+/************************************************************************/
+
+int pj_datum_plan_transform( PJ_DATUM_PLAN *plan, 
+                             long point_count, int point_offset,
+                             double *x, double *y, double *z )
+
+{
+    PJ *srcdefn = plan->srcdefn, *dstdefn = plan->dstdefn;
+
+    if( plan->noop )
+        return 0;
+
+/* -------------------------------------------------------------------- */
+/*      Use the plan's Z array if one is not provided.                  */
+/* -------------------------------------------------------------------- */
+    if( z == NULL )
+    {
+        long size = point_count * point_offset;
+
+        if( size > plan->z_temp_size )
+        {
+            pj_dalloc( plan->z_temp );
+            plan->z_temp = (double *) pj_malloc(sizeof(double) * size);
+            plan->z_temp_size = (plan->z_temp != NULL) ? size : 0;
+            if( plan->z_temp == NULL )
+            {
+                pj_ctx_set_errno( srcdefn->ctx, ENOMEM );
+                return ENOMEM;
+            }
+        }
+
+        z = plan->z_temp;
+        memset( z, 0, sizeof(double) * size );
+    }
+
+#define CHECK_RETURN(defn) {if( defn->ctx->last_errno != 0 && (defn->ctx->last_errno > 0 || transient_error[-defn->ctx->last_errno] == 0) ) { return defn->ctx->last_errno; }}
+
+/* -------------------------------------------------------------------- */
+/*	If this datum requires grid shifts, then apply it to geodetic   */
+/*      coordinates.                                                    */
+/* -------------------------------------------------------------------- */
+    if( srcdefn->datum_type == PJD_GRIDSHIFT )
+    {
+        pj_apply_gridshift_2( srcdefn, 0, point_count, point_offset, x, y, z );
+        CHECK_RETURN(srcdefn);
+    }
+
+    if( plan->geocentric )
+    {
+        int i;
+
 /* -------------------------------------------------------------------- */
 /*      Convert to geocentric coordinates.                              */
 /* -------------------------------------------------------------------- */
-        srcdefn->ctx->last_errno = 
-            pj_geodetic_to_geocentric( src_a, src_es,
-                                       point_count, point_offset, x, y, z );
+        srcdefn->ctx->last_errno = plan->src_error ? plan->src_error :
+            pj_geodetic_to_geocentric_gi( &plan->src_gi,
+                                          point_count, point_offset, x, y, z );
         CHECK_RETURN(srcdefn);
 
 /* -------------------------------------------------------------------- */
 /*      Convert between datums.                                         */
 /* -------------------------------------------------------------------- */
-        if( srcdefn->datum_type == PJD_3PARAM 
-            || srcdefn->datum_type == PJD_7PARAM )
+        if( plan->helmert == 1 )
         {
-            pj_geocentric_to_wgs84( srcdefn, point_count, point_offset,x,y,z);
-            CHECK_RETURN(srcdefn);
-        }
+            for( i = 0; i < point_count; i++ )
+            {
+                long io = i * point_offset;
 
-        if( dstdefn->datum_type == PJD_3PARAM 
-            || dstdefn->datum_type == PJD_7PARAM )
+                if( x[io] == HUGE_VAL )
+                    continue;
+
+                x[io] = x[io] + plan->shift[0];
+                y[io] = y[io] + plan->shift[1];
+                z[io] = z[io] + plan->shift[2];
+            }
+        }
+        else if( plan->helmert == 2 )
         {
-            pj_geocentric_from_wgs84( dstdefn, point_count,point_offset,x,y,z);
-            CHECK_RETURN(dstdefn);
+            for( i = 0; i < point_count; i++ )
+            {
+                long io = i * point_offset;
+                double x_out, y_out, z_out;
+
+                if( x[io] == HUGE_VAL )
+                    continue;
+
+                x_out = plan->rot[0][0]*x[io] + plan->rot[0][1]*y[io] 
+                    + plan->rot[0][2]*z[io] + plan->shift[0];
+                y_out = plan->rot[1][0]*x[io] + plan->rot[1][1]*y[io] 
+                    + plan->rot[1][2]*z[io] + plan->shift[1];
+                z_out = plan->rot[2][0]*x[io] + plan->rot[2][1]*y[io] 
+                    + plan->rot[2][2]*z[io] + plan->shift[2];
+
+                x[io] = x_out;
+                y[io] = y_out;
+                z[io] = z_out;
+            }
         }
 
 /* -------------------------------------------------------------------- */
 /*      Convert back to geodetic coordinates.                           */
 /* -------------------------------------------------------------------- */
-        dstdefn->ctx->last_errno = 
-            pj_geocentric_to_geodetic( dst_a, dst_es,
-                                       point_count, point_offset, x, y, z );
+        dstdefn->ctx->last_errno = plan->dst_error ? plan->dst_error :
+            pj_geocentric_to_geodetic_gi( &plan->dst_gi,
+                                          point_count, point_offset, x, y, z );
         CHECK_RETURN(dstdefn);
     }
 
@@ -713,12 +1164,33 @@ int pj_datum_transform( PJ *srcdefn, PJ *dstdefn,
         CHECK_RETURN(dstdefn);
     }
 
-    if( z_is_temp )
-        pj_dalloc( z );
-
     return 0;
 }
 
+/************************************************************************/
+/*                         pj_datum_transform()                         */
+/*                                                                      */
+/*      The input should be long/lat/z coordinates in radians in the    */
+/*      source datum, and the output should be long/lat/z               */
+/*      coordinates in radians in the destination datum.                */
+/************************************************************************/
+
+int pj_datum_transform( PJ *srcdefn, PJ *dstdefn, 
+                        long point_count, int point_offset,
+                        double *x, double *y, double *z )
+
+{
+    PJ_DATUM_PLAN plan;
+    int result;
+
+    pj_datum_plan_init( &plan, srcdefn, dstdefn );
+    result = pj_datum_plan_transform( &plan, point_count, point_offset, 
+                                      x, y, z );
+    pj_dalloc( plan.z_temp );
+
+    return result;
+}
+
 /************************************************************************/
 /*                           pj_adjust_axis()                           */
 /*                                                                      */
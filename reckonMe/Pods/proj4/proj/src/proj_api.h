@@ -56,9 +56,11 @@ extern int pj_errno;	/* global error return code */
     #define projXY projUV
     #define projLP projUV
     typedef void *projCtx;
+    typedef void *projDatumPlan;
 #else
     typedef PJ *projPJ;
     typedef projCtx_t *projCtx;
+    typedef struct PJ_DATUM_PLAN *projDatumPlan;
 #   define projXY	XY
 #   define projLP       LP
 #endif
@@ -70,8 +72,15 @@ projLP pj_inv(projXY, projPJ);
 
 int pj_transform( projPJ src, projPJ dst, long point_count, int point_offset,
                   double *x, double *y, double *z );
+int pj_transform_mt( projPJ src, projPJ dst, long point_count, int point_offset,
+                     double *x, double *y, double *z, int thread_count );
 int pj_datum_transform( projPJ src, projPJ dst, long point_count, int point_offset,
                         double *x, double *y, double *z );
+projDatumPlan pj_datum_plan_create( projPJ src, projPJ dst );
+int pj_datum_plan_transform( projDatumPlan plan, 
+                             long point_count, int point_offset,
+                             double *x, double *y, double *z );
+void pj_datum_plan_free( projDatumPlan plan );
 int pj_geocentric_to_geodetic( double a, double es,
                                long point_count, int point_offset,
                                double *x, double *y, double *z );
@@ -83,6 +92,10 @@ int pj_apply_gridshift( projCtx, const char *, int,
                         long point_count, int point_offset,
                         double *x, double *y, double *z );
 void pj_deallocate_grids(void);
+int pj_prewarm_grids( projCtx, const char *, 
+                     double lam_min, double phi_min, 
+                     double lam_max, double phi_max );
+void pj_set_grid_memory_limit( size_t );
 void pj_clear_initcache(void);
 int pj_is_latlong(projPJ);
 int pj_is_geocent(projPJ);
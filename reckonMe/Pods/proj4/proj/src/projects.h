@@ -133,6 +133,29 @@ typedef struct {
     void    *app_data;
 } projCtx_t;
 
+/*
+** Publication of lazily built shared data (loaded grids, the grid list,
+** the init caches).  Writers fill the object completely under
+** pj_acquire_lock() and then store the pointer (or count) with release
+** semantics, so readers can use an acquire load without taking the lock.
+** Data that may be taken back again (evicted grids) additionally needs
+** the sequentially consistent operations, see pj_gridinfo_pin().
+*/
+#if defined(__clang__) || (defined(__GNUC__) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#  define PJ_LOAD_ACQUIRE(var)       __atomic_load_n( &(var), __ATOMIC_ACQUIRE )
+#  define PJ_STORE_RELEASE(var, val) __atomic_store_n( &(var), (val), __ATOMIC_RELEASE )
+#  define PJ_LOAD_SEQ(var)           __atomic_load_n( &(var), __ATOMIC_SEQ_CST )
+#  define PJ_STORE_SEQ(var, val)     __atomic_store_n( &(var), (val), __ATOMIC_SEQ_CST )
+#  define PJ_ATOMIC_ADD(var, val)    __atomic_add_fetch( &(var), (val), __ATOMIC_SEQ_CST )
+#else
+#  define PJ_LOAD_ACQUIRE(var)       (var)
+#  define PJ_STORE_RELEASE(var, val) ((var) = (val))
+#  define PJ_LOAD_SEQ(var)           (var)
+#  define PJ_STORE_SEQ(var, val)     ((var) = (val))
+#  define PJ_ATOMIC_ADD(var, val)    ((var) += (val))
+#endif
+
 /* datum_type values */
 #define PJD_UNKNOWN   0
 #define PJD_3PARAM    1   
@@ -211,11 +234,14 @@ struct FACTORS {
     /* parameter list struct */
 typedef struct ARG_list {
 	struct ARG_list *next;
+	struct PJ_PARAM_INDEX *index; /* lookup table, see pj_param.c */
 	char used;
 	char param[1]; } paralist;
 	/* base projection data structure */
 
 
+typedef struct PJ_DATUM_PLAN PJ_DATUM_PLAN;
+
 typedef struct PJconsts {
     projCtx_t *ctx;
 	XY  (*fwd)(LP, struct PJconsts *);
@@ -223,6 +249,7 @@ typedef struct PJconsts {
 	void (*spc)(LP, struct PJconsts *, struct FACTORS *);
 	void (*pfree)(struct PJconsts *);
 	const char *descr;
+	size_t alloc_size;  /* size of the projection's PJ, for pj_clone_pj() */
 	paralist *params;   /* parameter list */
 	int over;   /* over-range flag */
 	int geoc;   /* geocentric latitude flag */
@@ -246,6 +273,7 @@ typedef struct PJconsts {
         double  datum_params[7];
         struct _pj_gi **gridlist;
         int     gridlist_count;
+        struct _pj_gridindex *gridindex; /* bucket index over gridlist */
 
         int     has_geoid_vgrids;
         struct _pj_gi **vgridlist_geoid;
@@ -310,6 +338,7 @@ extern struct PJ_PRIME_MERIDIANS pj_prime_meridians[];
 	C_NAMESPACE PJ *pj_##name(PJ *P) { if (!P) { \
 	if( (P = (PJ*) pj_malloc(sizeof(PJ))) != NULL) { \
         memset( P, 0, sizeof(PJ) ); \
+	P->alloc_size = sizeof(PJ); \
 	P->pfree = freeup; P->fwd = 0; P->inv = 0; \
 	P->spc = 0; P->descr = des_##name;
 #define ENTRYX } return P; } else {
@@ -349,10 +378,44 @@ typedef struct _pj_gi {
 
     struct CTABLE *ct;
 
+    void  *map_base;   /* memory mapping backing ct->cvs, or NULL if the */
+    size_t map_size;   /* data was read into the heap. */
+
+    const unsigned char *tile_data; /* mapped file data of a tiled grid */
+    struct CTABLE **tiles; /* tiles converted so far, NULL if not tiled */
+    ILP   tile_lim;    /* number of tiles, see pj_gridinfo_tile() */
+
+    int   pins;        /* users of the data, see pj_gridinfo_pin() */
+    int   evicting;    /* set while the data is being unloaded */
+    long  last_used;   /* grid clock at the latest pin */
+    size_t data_size;  /* bytes of data loaded, 0 if none */
+    struct _pj_gi *resident_prev; /* grids with data_size > 0 */
+    struct _pj_gi *resident_next;
+
     struct _pj_gi *next;
     struct _pj_gi *child;
 } PJ_GRIDINFO;
 
+typedef struct {
+    PJ_GRIDINFO *gi;
+    int   child_count; /* child entries following a grid, -1 for a child */
+} PJ_GRIDINDEX_ENTRY;
+
+typedef struct _pj_gridindex {
+    LP    extent_ll;   /* union of the grid extents */
+    LP    extent_ur;
+    LP    ll;          /* lower left corner of the first bucket */
+    LP    del;         /* size of a bucket */
+    ILP   lim;         /* number of buckets */
+    double slack;      /* tolerance for points on bucket edges */
+    int   *start;      /* per bucket offset into entries, lim.lam*lim.phi+1 */
+    PJ_GRIDINDEX_ENTRY *entries;
+    PJ_GRIDINFO **resolved; /* per bucket grid valid for all its points */
+} PJ_GRIDINDEX;
+
+/* maximum number of index buckets along each axis */
+#define PJ_GRIDINDEX_MAX_BUCKETS 64
+
 /* procedure prototypes */
 double dmstor(const char *, char **);
 double dmstor_ctx(projCtx ctx, const char *, char **);
@@ -362,6 +425,9 @@ double adjlon(double);
 double aacos(projCtx,double), aasin(projCtx,double), asqrt(double), aatan2(double, double);
 PVALUE pj_param(projCtx ctx, paralist *, const char *);
 paralist *pj_mkparam(char *);
+void pj_free_paralist(paralist *);
+void pj_param_index(paralist *);
+void pj_param_index_free(paralist *);
 int pj_ell_set(projCtx ctx, paralist *, double *, double *);
 int pj_datum_set(projCtx,paralist *, PJ *);
 int pj_prime_meridian_set(paralist *, PJ *);
@@ -370,6 +436,10 @@ int pj_angular_units_set(paralist *, PJ *);
 paralist *pj_clone_paralist( const paralist* );
 paralist*pj_search_initcache( const char *filekey );
 void pj_insert_initcache( const char *filekey, const paralist *list);
+int pj_can_clone_pj( PJ * );
+PJ *pj_clone_pj( projCtx ctx, PJ * );
+PJ *pj_search_pjcache( projCtx ctx, const char *key );
+PJ *pj_insert_pjcache( const char *key, PJ * );
 
 double *pj_enfn(double);
 double pj_mlfn(double, double, double, double *);
@@ -413,12 +483,18 @@ int bch2bps(projUV, projUV, projUV **, int, int);
 /* nadcon related protos */
 LP nad_intr(LP, struct CTABLE *);
 LP nad_cvt(LP, int, struct CTABLE *);
+#define NAD_BATCH 64 /* points per block of the batch interpolation */
+#define PJ_GRID_TILE 64 /* cells per side of the tiles of a tiled grid */
+void nad_intr_batch(struct CTABLE *, int, int, const double *, const double *,
+                    double *, double *);
+void nad_cvt_batch(double *, double *, long, int, struct CTABLE *);
 struct CTABLE *nad_init(projCtx ctx, char *);
 struct CTABLE *nad_ctable_init( projCtx ctx, FILE * fid );
 int nad_ctable_load( projCtx ctx, struct CTABLE *, FILE * fid );
 struct CTABLE *nad_ctable2_init( projCtx ctx, FILE * fid );
 int nad_ctable2_load( projCtx ctx, struct CTABLE *, FILE * fid );
 void nad_free(struct CTABLE *);
+void nad_swap_words(void *, int, long);
 
 /* higher level handling of datum grid shift files */
 
@@ -437,10 +513,18 @@ int pj_apply_gridshift_3( projCtx ctx,
                           double *x, double *y, double *z );
 
 PJ_GRIDINFO **pj_gridlist_from_nadgrids( projCtx, const char *, int * );
+PJ_GRIDINDEX *pj_gridindex_create( PJ_GRIDINFO **, int, int );
+int pj_gridindex_bucket( PJ_GRIDINDEX *, LP );
+void pj_gridindex_free( PJ_GRIDINDEX * );
 void pj_deallocate_grids();
 
 PJ_GRIDINFO *pj_gridinfo_init( projCtx, const char * );
 int pj_gridinfo_load( projCtx, PJ_GRIDINFO * );
+int pj_gridinfo_load_tiled( projCtx, PJ_GRIDINFO * );
+struct CTABLE *pj_gridinfo_tile( projCtx, PJ_GRIDINFO *, int tile );
+int pj_gridinfo_pin( projCtx, PJ_GRIDINFO *, int tiled );
+void pj_gridinfo_unpin( PJ_GRIDINFO * );
+int pj_gridinfo_prewarm( projCtx, PJ_GRIDINFO *, LP ll, LP ur );
 void pj_gridinfo_free( projCtx, PJ_GRIDINFO * );
 
 void *proj_mdist_ini(double);
@@ -40,7 +40,12 @@
 
 - (void)sendSensorDataToPDR:(FakeCMDeviceMotion *) dm {
     
-    [pdr didReceiveDeviceMotion:(CMDeviceMotion*)dm timestamp:dm.timestamp];   
+    DeviceMotionSample sample = {0};
+    sample.timestamp = dm.timestamp;
+    sample.quaternion = dm.attitude.quaternion;
+    sample.userAcceleration = dm.userAcceleration;
+    
+    [pdr didReceiveDeviceMotionBatch:&sample count:1];
     static int counter = 0;
     counter++;
     //if (counter % 100 == 1)
@@ -54,10 +59,15 @@
                                                                              northingDelta:1
                                                                                     origin:pdr.positionForExchange.absolutePosition
                                                                                  Deviation:3];
-    [pdr didReceivePosition:peerLocation
-                     ofPeer:@"foobar"
-                 isRealName:NO];
+    PositionAdvertisement advertisement;
+    [peerLocation getAdvertisement:&advertisement];
     [peerLocation release];
+    
+    //the position is fused on the PDR queue, like one received by BLE_P2PExchange
+    [pdr enqueuePeerPosition:&advertisement
+                      ofPeer:@"foobar"
+                  isRealName:NO
+                    accepted:nil];
 }
 
 - (void)sendInPocketToVC:(NSNumber *)isInPocket {